@@ -1,27 +1,32 @@
 #pragma once
-#include <unordered_set>
-#include <queue>
+#include <vector>
+#include <chrono>
+#include <random>
 #include "pureEntityData.h"
-
-
-struct CompareGameObjectX
-{
-    bool operator()(Entity* a, Entity* b); // min-heap behavior
-};
+#include "pathSearch.h"
+#include "pathService.h"
+#include "pathCache.h"
+#include "navHierarchy.h"
+#include "flowField.h"
 
 class AstarAlgorithm
 {
     PureEntityData* entityData;
-    bool containsInOpenList(Entity* gameobject);
 public:
     AstarAlgorithm();
     ~AstarAlgorithm();
-    
+
     static AstarAlgorithm* _instance;
-    // storage
-    std::priority_queue<Entity*, std::vector<Entity*>, CompareGameObjectX> openList;
-    std::unordered_set<Entity*> closedList;
-    std::unordered_set<Entity*> openSet;
+
+    /// shared with the path workers, replaced rather than modified
+    std::shared_ptr<const NavGrid> grid;
+    PathSearch search;
+    PathCache cache;
+    /// used instead of plain A* on grids of at least HierarchyMinSize nodes per side. Shared with
+    /// the path workers like the grid, copied before a change while a search still holds it
+    std::shared_ptr<NavHierarchy> hierarchy;
+    static constexpr int HierarchyMinSize = 32;
+    FlowFieldCache flowFields;
 
     //singleton instance
     static AstarAlgorithm* Instance();
@@ -29,26 +34,46 @@ public:
 
     // Method
 
-    std::vector<Entity*> findPath(Entity* start, Entity* end);
+    /// bake the grid from the nav volume, done automatically when the volume is recreated
+    void BuildGrid();
+    /// call after nav volume cells' blocked flags changed, patches the grid and drops cached paths through the cells
+    void UpdateCellOccupancy(std::vector<int> const& cells);
+    /// path from cell start to cell end, excluding start
+    std::vector<int> findPath(int start, int end, PathAlgorithm algorithm = PathAlgorithm::AStar);
+    /// solve on the path workers instead of the calling thread, cached paths are returned right away
+    std::future<PathResult> RequestPath(int start, int end, PathAlgorithm algorithm = PathAlgorithm::AStar);
+    /// cache a solved path and return its cells
+    std::vector<int> ResolvePath(PathResult const& result);
+    /// direction to take from position towards the node closest to target, from the target node's
+    /// flow field. Zero at the target node or if it can't be reached.
+    glm::vec3 FlowDirection(glm::vec3 const& position, glm::vec3 const& target);
     int getDistance(Entity* objectA, Entity* objectB);
-    std::vector<Entity*> retracePath(Entity* startObject, Entity* endObject);
+
+    struct BenchmarkResult
+    {
+        int numNodes = 0;
+        int numQueries = 0;
+        double milliseconds = 0;
+        /// time spent building the hierarchy before the first query
+        double buildMilliseconds = 0;
+        long long expanded = 0;
+        long long pushed = 0;
+    };
+    /// run random queries on a size^3 grid. Walls adds blocked planes with a few holes in them.
+    static BenchmarkResult Benchmark(int size, int numQueries, bool hierarchical = false, bool walls = false, PathAlgorithm algorithm = PathAlgorithm::AStar);
+
+private:
+    /// rebuild the grid if the nav volume was recreated since it was baked
+    void EnsureGrid();
+    /// A* requests on large grids go through the hierarchy, other algorithms search the grid
+    bool UseHierarchy(PathAlgorithm algorithm) const { return algorithm == PathAlgorithm::AStar && grid->size >= HierarchyMinSize; }
+    uint32_t gridGeneration = 0;
+    std::vector<int> changedCells;
+    NavHierarchy::Scratch hierarchyScratch;
 };
 
 AstarAlgorithm* AstarAlgorithm::_instance = nullptr;
 
-
-inline bool CompareGameObjectX::operator()(Entity* a, Entity* b)
-{
-    auto* aComp = a->GetComponent<Components::AI>();
-    auto* bComp = b->GetComponent<Components::AI>();
-    return aComp->FCost() > bComp->FCost(); // Lower fCost = higher priority
-}
-
-inline bool AstarAlgorithm::containsInOpenList(Entity* gameobject)
-{
-    return openSet.find(gameobject) != openSet.end();
-}
-
 inline AstarAlgorithm::AstarAlgorithm()
 {
     entityData = PureEntityData::instance();
@@ -76,101 +101,194 @@ inline void AstarAlgorithm::destroy()
         _instance = nullptr;
     }
 }
-inline std::vector<Entity*> AstarAlgorithm::findPath(Entity* start, Entity* end)
-{
-    openList = {};
-    openSet.clear();
-    closedList.clear();
-
-    openList.push(start);
-    openSet.insert(start);
-    Entity* current = nullptr;
 
-    while (!openList.empty())
+inline void AstarAlgorithm::BuildGrid()
+{
+    NavVolume const& volume = entityData->navVolume;
+    auto newGrid = std::make_shared<NavGrid>();
+    newGrid->size = volume.GetSize();
+    newGrid->origin = volume.GetOrigin();
+    newGrid->spacing = volume.GetSpacing();
+    newGrid->positions.resize(volume.NumCells());
+    newGrid->blocked.resize(volume.NumCells());
+    for (int cell = 0; cell < volume.NumCells(); cell++)
     {
-        current = openList.top();
-        openList.pop();
-        openSet.erase(current);
-
-        if (current->id == end->id)
-        {
-            return retracePath(start, end);
-        }
-        closedList.insert(current);
-
-        auto* currentNav = current->GetComponent<Components::AI>();
-        if(current->eType == EntityType::Node)
-        if (!currentNav)
-            continue; // skip entities without AI component
-
-        for (Entity* neighbor : entityData->getNeighbors(current))
-        {
-
-            if (closedList.contains(neighbor))
-                continue;
+        newGrid->positions[cell] = volume.CellPosition(cell);
+        newGrid->blocked[cell] = volume.IsBlocked(cell);
+    }
+    newGrid->BakeAdjacency();
+    grid = newGrid;
+    gridGeneration = volume.GetGeneration();
+    // built right away, not by the first query
+    hierarchy = std::make_shared<NavHierarchy>();
+    hierarchy->SetGrid(grid);
+    cache.Clear();
+    flowFields.Clear();
+}
 
-            auto* neighborNav = neighbor->GetComponent<Components::AI>();
-            if (!neighborNav)
-                continue;
+inline void AstarAlgorithm::EnsureGrid()
+{
+    if (!grid || gridGeneration != entityData->navVolume.GetGeneration())
+        BuildGrid();
+}
 
+inline void AstarAlgorithm::UpdateCellOccupancy(std::vector<int> const& cells)
+{
+    if (!grid || gridGeneration != entityData->navVolume.GetGeneration())
+    {
+        BuildGrid();
+        return;
+    }
 
-            int newMovementCostToNeighbor = currentNav->gCost + getDistance(current, neighbor);
+    // one copy for the whole batch, searches in flight keep the old snapshot
+    std::shared_ptr<NavGrid> newGrid;
+    changedCells.clear();
+    for (int cell : cells)
+    {
+        uint8_t const blocked = entityData->navVolume.IsBlocked(cell);
+        if (grid->blocked[cell] == blocked)
+            continue;
+        if (!newGrid)
+            newGrid = std::make_shared<NavGrid>(*grid);
+        newGrid->blocked[cell] = blocked;
+        changedCells.push_back(cell);
+    }
+    if (!newGrid)
+        return;
+
+    // rebake once every flag is set, corners between two changed cells see both
+    for (int cell : changedCells)
+        newGrid->RebakeAround(cell);
+    grid = newGrid;
+    if (hierarchy.use_count() > 1)
+        hierarchy = std::make_shared<NavHierarchy>(*hierarchy);
+    for (int cell : changedCells)
+    {
+        hierarchy->UpdateNode(grid, cell);
+        flowFields.UpdateNode(*grid, cell);
+        // freeing a cell leaves cached paths valid, they may just no longer be the shortest
+        if (grid->blocked[cell])
+            cache.InvalidateNode(cell);
+    }
+    hierarchy->Refresh();
+}
 
-            if (newMovementCostToNeighbor < neighborNav->gCost || !containsInOpenList(neighbor))
-            {
-                neighborNav->gCost = newMovementCostToNeighbor;
-                neighborNav->hCost = getDistance(neighbor, end);
+inline std::vector<int> AstarAlgorithm::findPath(int start, int end, PathAlgorithm algorithm)
+{
+    EnsureGrid();
+
+    // volume cells and grid nodes share their indices
+    PathResult result;
+    result.start = start;
+    result.goal = end;
+    if (cache.Lookup(start, end, result.nodes))
+        result.found = result.cached = true;
+    else if (UseHierarchy(algorithm))
+        result.found = hierarchy->FindPath(start, end, result.nodes, hierarchyScratch);
+    else
+        result.found = search.FindPath(*grid, start, end, result.nodes, algorithm);
+    return ResolvePath(result);
+}
 
-                neighborNav->parentNode = current;
+inline std::future<PathResult> AstarAlgorithm::RequestPath(int start, int end, PathAlgorithm algorithm)
+{
+    EnsureGrid();
 
-                if (!containsInOpenList(neighbor))
-                {
-                    openList.push(neighbor);
-                    openSet.insert(neighbor);
-                }
-            }
-        }
+    PathResult result;
+    if (cache.Lookup(start, end, result.nodes))
+    {
+        result.start = start;
+        result.goal = end;
+        result.found = result.cached = true;
+        std::promise<PathResult> ready;
+        ready.set_value(std::move(result));
+        return ready.get_future();
     }
+    if (UseHierarchy(algorithm))
+        return PathService::Instance()->Request(std::shared_ptr<const NavHierarchy>(hierarchy), start, end);
+    return PathService::Instance()->Request(grid, start, end, algorithm);
+}
 
-    return retracePath(start, current);
+inline std::vector<int> AstarAlgorithm::ResolvePath(PathResult const& result)
+{
+    if (result.found && !result.cached && grid && gridGeneration == entityData->navVolume.GetGeneration())
+    {
+        // the path was solved on an older snapshot if a cell on it got blocked meanwhile
+        bool const stillOpen = std::none_of(result.nodes.begin(), result.nodes.end(), [this](int index) { return grid->blocked[index]; });
+        if (stillOpen)
+            cache.Insert(result.start, result.goal, result.nodes);
+    }
+    return result.nodes;
 }
 
+inline glm::vec3 AstarAlgorithm::FlowDirection(glm::vec3 const& position, glm::vec3 const& target)
+{
+    EnsureGrid();
+    if (grid->NumNodes() == 0)
+        return glm::vec3(0);
+
+    std::shared_ptr<const FlowField> field = flowFields.Get(*grid, grid->NodeAt(target));
+    return field->Direction(*grid, grid->NodeAt(position));
+}
 
 inline int AstarAlgorithm::getDistance(Entity* objectA, Entity* objectB)
 {
     //Heuristic Formula
     auto transA = objectA->GetComponent<Components::TransformComponent>();
     auto transB = objectB->GetComponent<Components::TransformComponent>();
-
-    int dx = abs(static_cast<int>(transA->transform[3].x - transB->transform[3].x));
-    int dy = abs(static_cast<int>(transA->transform[3].y - transB->transform[3].y));
-    int dz = abs(static_cast<int>(transA->transform[3].z - transB->transform[3].z));
-
-    int minD = std::min({ dx, dy, dz });
-    int maxD = std::max({ dx, dy, dz });
-
-    int midD = dx + dy + dz - minD - maxD;
-
-    return 17 * minD + 14 * (midD - minD) + 10 * (maxD - midD);
+    return NavDistance(glm::vec3(transA->transform[3]), glm::vec3(transB->transform[3]));
 }
 
-inline std::vector<Entity*> AstarAlgorithm::retracePath(Entity* startObject, Entity* endObject)
+inline AstarAlgorithm::BenchmarkResult AstarAlgorithm::Benchmark(int size, int numQueries, bool hierarchical, bool walls, PathAlgorithm algorithm)
 {
-    std::vector<Entity*> path;
-    Entity* current = endObject;
-    while (current != startObject)
+    auto benchGrid = std::make_shared<NavGrid>(NavGrid::CreateUniform(size, 30.0f));
+    if (walls)
     {
-
-        auto* currentComp = current->GetComponent<Components::AI>();
-        if (!currentComp || currentComp->parentNode == nullptr)
-            break; // prevent infinite loop if broken chain
-
-
-        path.push_back(current);
-        current = currentComp->parentNode;
+        // a wall every 8 nodes along x, holes are 2x2 and spread out
+        for (int i = 0; i < benchGrid->NumNodes(); i++)
+        {
+            int const x = i % size;
+            int const y = (i / size) % size;
+            int const z = i / (size * size);
+            bool const hole = y % 16 < 2 && z % 16 < 2 && (x / 8 + y / 16 + z / 16) % 3 == 0;
+            benchGrid->blocked[i] = x % 8 == 4 && !hole;
+        }
+        benchGrid->BakeAdjacency();
     }
-
-    std::reverse(path.begin(), path.end());
-    return path;
+    PathSearch benchSearch;
+    NavHierarchy benchHierarchy;
+    NavHierarchy::Scratch hierarchyScratch;
+    std::vector<int> path;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> pick(0, benchGrid->NumNodes() - 1);
+
+    BenchmarkResult result;
+    result.numNodes = benchGrid->NumNodes();
+    result.numQueries = numQueries;
+    if (hierarchical)
+    {
+        // the abstract graph is built up front, it is not part of the per query cost
+        auto const buildStart = std::chrono::steady_clock::now();
+        benchHierarchy.SetGrid(benchGrid);
+        result.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+    }
+    auto const timeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < numQueries; i++)
+    {
+        int const start = pick(rng);
+        int const goal = pick(rng);
+        if (hierarchical)
+        {
+            benchHierarchy.FindPath(start, goal, path, hierarchyScratch);
+            result.expanded += hierarchyScratch.expanded;
+        }
+        else
+        {
+            benchSearch.FindPath(*benchGrid, start, goal, path, algorithm);
+            result.expanded += benchSearch.expanded;
+            result.pushed += benchSearch.pushed;
+        }
+    }
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+    return result;
 }
-
@@ -0,0 +1,131 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+/**
+    Level of detail for AI ticking. Agents are bucketed by how much they
+    matter to the player: Near ones tick every frame, Medium and Far ones
+    only every tickIntervals[lod] seconds and get the time they missed as
+    their dt.
+
+    Near ticks always run. Whatever is left of budgetMilliseconds after them
+    goes to the due lower level agents, the ones that waited longest first,
+    so a frame that runs out of budget hands the rest on to the next one.
+*/
+class AIScheduler
+{
+public:
+    enum Lod : uint8_t
+    {
+        Near,
+        Medium,
+        Far,
+        NumLods
+    };
+
+    static AIScheduler* Instance()
+    {
+        static AIScheduler instance;
+        return &instance;
+    }
+
+    AIScheduler(const AIScheduler&) = delete;
+    void operator=(const AIScheduler&) = delete;
+
+    /// bucket of an agent at distance from the player
+    Lod Classify(float distance, bool visible, bool inCombat) const;
+
+    /// true if waited seconds since the last tick make an agent of the level due
+    bool IsDue(Lod lod, float waited) const { return waited >= tickIntervals[lod]; }
+
+    /// forget the agents queued last frame
+    void BeginFrame();
+    /// queue the agent if waited seconds since its last tick make it due
+    void Add(int agent, Lod lod, float waited);
+    /// tick(agent) for every agent that gets its turn this frame
+    template<class TICK> void Run(TICK&& tick);
+
+    /// up to this far Near, beyond it Medium while in view, everything else Far
+    float nearDistance = 60.0f;
+    float farDistance = 200.0f;
+    /// cosine of the view cone's half angle
+    float viewConeCos = 0.5f;
+    /// seconds between ticks, per level
+    float tickIntervals[NumLods] = { 0.0f, 0.1f, 0.5f };
+    /// time all AI ticks together may take per frame
+    double budgetMilliseconds = 2.0;
+    /// longest dt handed to a tick, so a starved agent doesn't jump
+    float maxTickDt = 0.5f;
+
+    /// stats of the last frame
+    int numAgents[NumLods] = {};
+    int numTicked[NumLods] = {};
+    int numDeferred = 0;
+    double lastMilliseconds = 0;
+
+private:
+    AIScheduler() {}
+
+    struct Entry
+    {
+        int agent;
+        Lod lod;
+        float overdue;
+    };
+    std::vector<Entry> queue;
+};
+
+inline AIScheduler::Lod AIScheduler::Classify(float distance, bool visible, bool inCombat) const
+{
+    if (inCombat || distance <= nearDistance)
+        return Near;
+    if (visible && distance <= farDistance)
+        return Medium;
+    return Far;
+}
+
+inline void AIScheduler::BeginFrame()
+{
+    queue.clear();
+    std::fill(std::begin(numAgents), std::end(numAgents), 0);
+    std::fill(std::begin(numTicked), std::end(numTicked), 0);
+    numDeferred = 0;
+}
+
+inline void AIScheduler::Add(int agent, Lod lod, float waited)
+{
+    numAgents[lod]++;
+    if (IsDue(lod, waited))
+        queue.push_back({ agent, lod, waited - tickIntervals[lod] });
+}
+
+template<class TICK>
+inline void AIScheduler::Run(TICK&& tick)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto elapsed = [start]()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::sort(queue.begin(), queue.end(), [](Entry const& a, Entry const& b)
+    {
+        if ((a.lod == Near) != (b.lod == Near))
+            return a.lod == Near;
+        return a.overdue > b.overdue;
+    });
+    for (Entry const& entry : queue)
+    {
+        if (entry.lod != Near && elapsed() >= budgetMilliseconds)
+        {
+            numDeferred++;
+            continue;
+        }
+        tick(entry.agent);
+        numTicked[entry.lod]++;
+    }
+    lastMilliseconds = elapsed();
+}
@@ -17,6 +17,10 @@
 #include <render/physics.cc>
 #include <render/cameramanager.h>
 #include "render/particlesystem.h"
+#include "projectileSystem.h"
+#include "pathService.h"
+#include "perception.h"
+#include "sensorScheduler.h"
 
 
 class Entity;
@@ -53,10 +57,18 @@ namespace Components
 		EntityType UsingEntityType = EntityType::Unknown;
 
 		Physics::ColliderMeshId collidermeshId;
-		Physics::ColliderId colliderID;
-		glm::vec3 EndPointsNodes[6];
+		Physics::ColliderId colliderID = Physics::ColliderId::Invalid();
+		// nav cells within reach of the collider as of the last occupancy update, empty while max < min
+		glm::ivec3 navCellsMin = glm::ivec3(0);
+		glm::ivec3 navCellsMax = glm::ivec3(-1);
+		// transform and bounds the distance field was last baked with
+		glm::mat4 fieldTransform = glm::mat4(1.0f);
+		glm::vec3 fieldBoundsMin = glm::vec3(0);
+		glm::vec3 fieldBoundsMax = glm::vec3(0);
+		bool inDistanceField = false;
 		std::vector<glm::vec3> colliderEndPoints;  // Reserve space for 17 elements
 		glm::vec3 rayCastPoints[50];
+		SensorCache sensorCache; // last result of every sensor ray, refreshed by the SensorScheduler
 
 
 		Core::CVar* r_Raycasts = Core::CVarCreate(Core::CVarType::CVar_Int, "r_Raycasts", "0");
@@ -75,9 +87,10 @@ namespace Components
 	public:
 		static constexpr ComponentType TYPE = ComponentType::RIGIDBODY;
 
-		glm::vec3 velocity;
-		glm::vec3 angularVelocity;
-		float mass;
+		Physics::RigidBodyId rigidBodyId = Physics::RigidBodyId::Invalid();
+		glm::vec3 velocity = glm::vec3(0.0f);
+		glm::vec3 angularVelocity = glm::vec3(0.0f);
+		float mass = 1.0f;
 
 
 
@@ -136,12 +149,6 @@ namespace Components
 		Render::ParticleEmitter* particleCanonRight = nullptr;
 		float emitterOffset = -0.5f;
 		float canonEmitterOffset = 0.5f;
-
-		glm::vec3 leftCanonPos;   // current position of left cannon particle
-		glm::vec3 rightCanonPos;  // current position of right cannon particle
-		float travelLeft = 0.0f;  // distance traveled by left particle
-		float travelRight = 0.0f; // distance traveled by right particle
-		bool hasFired = false;
 	
 		// Allow external access to the emitter data (either as public member or getter method)
 	
@@ -149,6 +156,24 @@ namespace Components
 	
 	//----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+	class WeaponComponent : public ComponentBase
+	{
+	public:
+		static constexpr ComponentType TYPE = ComponentType::WEAPON;
+		float canonOffset = 0.365f;       // sideways offset of each cannon from the ship center
+		float canonForwardOffset = 0.5f;  // muzzle distance ahead of the ship center
+		float projectileSpeed = 50.0f;
+		float projectileLifetime = 0.2f;  // 10 units of reach at projectileSpeed
+		float cooldown = 0.25f;
+		float cooldownTimer = 0.0f;
+
+		// newest shot of each cannon, the cannon emitters follow these
+		ProjectileId leftProjectile = ProjectileId::Invalid();
+		ProjectileId rightProjectile = ProjectileId::Invalid();
+	};
+
+	//----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 	class PlayerInputComponent : public ComponentBase
 	{
 	public:
@@ -172,21 +197,6 @@ namespace Components
 		PlayerInputComponent() {}
 	};
 	
-	class AINavNodeComponent : public ComponentBase
-	{
-	public:
-		static constexpr ComponentType TYPE = ComponentType::NAVNODE;
-		Core::CVar* r_draw_path = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_path", "0");
-
-		Core::CVar* r_draw_Node_Axis = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_Node_Axis", "0");
-		Core::CVar* r_draw_Node_Axis_id = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_Node_Axis_id", " - 1");
-
-		glm::vec3 EndPoints[6];
-		bool isCollidedAsteroids = false;
-		
-
-	};
-
 	class AIinputController : public ComponentBase
 	{
 	public:
@@ -217,25 +227,28 @@ namespace Components
 		bool isForward = false;
 		bool isBoosting = false;
 		bool isShooting = false;
+
+		// collision free velocity from this frame's avoidance pass, the ship moves with it instead of linearVelocity
+		glm::vec3 avoidanceVelocity = glm::vec3(0.0f);
+		bool hasAvoidanceVelocity = false;
 	};
 	class AI : public ComponentBase
 	{
 	public:
 		static constexpr ComponentType TYPE = ComponentType::AI;
 		//ai stuff
-		Entity* parentNode = nullptr;
-
-		std::vector<Entity*> path;
-		Entity* closestNodeFromShip;
-
-		int gCost = 0;  // Cost from start to current node
-		int hCost = 0;  // Heuristic cost from current node to end
-		int FCost() const { return gCost + hCost; }
+		std::vector<int> path; // nav volume cells
+		std::future<PathResult> pathRequest; // pending search on the path workers
+		int closestNodeFromShip = -1;
 
 		int pathIndex = 0;
 		float nodeArrivalTimer = 0.0f;
 		bool hasReachedTheStartNode = false;
 		bool closestNodeCalled = false;
+
+		uint8_t lod = 0; // AIScheduler::Lod the ship was last bucketed into
+		float timeSinceTick = 0.0f; // game time since its AI last ran
+		PerceptionContacts contacts; // sensed by the perception stage before the AI ticks
 	};
 
 	class State : public ComponentBase
@@ -245,6 +258,7 @@ namespace Components
 
 		bool isRespawning = false;
 		bool isAvoidingAsteroids = false;
+		bool isCollidingAsteroids = false; // set by the contact pass when the ship collider touches an asteroid
 		bool isDestroyed = false;
 		float avoidanceCooldown = 0.01f;
 		float avoidanceTime = 0.0f;
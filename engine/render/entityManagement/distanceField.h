@@ -0,0 +1,245 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include "glm.hpp"
+#include "spatialHash.h"
+
+struct DistanceObstacle
+{
+    glm::vec3 boundsMin = glm::vec3(0);
+    glm::vec3 boundsMax = glm::vec3(0);
+};
+
+//------------------------------------------------------------------------------
+/**
+    Sparse signed distance volume over a set of obstacles. Space is cut into
+    bricks of BrickCells^3 voxels, and only bricks within maxDistance of an
+    obstacle are stored. Each brick keeps its own border samples, so any
+    lookup is one hash find and eight samples from one brick. Anything
+    without a brick is at least maxDistance away from every obstacle.
+
+    Bricks are rebaked only where they were marked dirty, so an obstacle that
+    moves costs the bricks around its old and new place.
+*/
+class DistanceField
+{
+public:
+    static constexpr int BrickCells = 8;
+    static constexpr int BrickSamples = BrickCells + 1;
+
+    void Clear();
+    /// queue every brick within maxDistance of the box for the next Rebake
+    void MarkDirty(glm::vec3 const& min, glm::vec3 const& max);
+    /// recompute the queued bricks. distance(obstacle, point) is the signed distance to obstacle's surface
+    template<class DISTANCE> void Rebake(std::vector<DistanceObstacle> const& obstacles, DISTANCE&& distance);
+
+    /// signed distance to the closest obstacle, capped at maxDistance
+    float Distance(glm::vec3 const& position) const;
+    /// distance and its gradient, which points away from the closest obstacle. Zero gradient where there is no brick
+    float Sample(glm::vec3 const& position, glm::vec3& gradient) const;
+    /// sphere trace from start to end, true if the segment reaches a surface
+    bool SegmentCast(glm::vec3 const& start, glm::vec3 const& end, float& hitDistance) const;
+
+    int GetNumBricks() const { return (int)brickIndices.size(); }
+
+    /// voxel edge length, Clear before changing it
+    float voxelSize = 1.0f;
+    /// width of the band around obstacles that is stored
+    float maxDistance = 8.0f;
+
+    /// stats of the last rebake
+    int lastBricksBaked = 0;
+    double lastMilliseconds = 0;
+
+private:
+    float BrickSize() const { return voxelSize * BrickCells; }
+    glm::ivec3 BrickOf(glm::vec3 const& position) const { return glm::ivec3(glm::floor(position / BrickSize())); }
+    /// first sample of the brick at the position, nullptr if there is none. local is the position in voxels from the brick's corner
+    float const* FindBrick(glm::vec3 const& position, glm::vec3& local) const;
+    void FreeBrick(uint64_t key);
+
+    /// key -> brick, brick i owns samples [i * BrickSamples^3, (i + 1) * BrickSamples^3)
+    std::unordered_map<uint64_t, int> brickIndices;
+    std::vector<float> samples;
+    std::vector<int> freeBricks;
+
+    std::vector<std::pair<uint64_t, glm::ivec3>> dirtyBricks;
+    std::vector<int> candidates;
+    std::vector<float> bakedSamples;
+};
+
+inline void DistanceField::Clear()
+{
+    brickIndices.clear();
+    samples.clear();
+    freeBricks.clear();
+    dirtyBricks.clear();
+}
+
+inline void DistanceField::MarkDirty(glm::vec3 const& min, glm::vec3 const& max)
+{
+    glm::ivec3 const from = BrickOf(min - glm::vec3(maxDistance));
+    glm::ivec3 const to = BrickOf(max + glm::vec3(maxDistance));
+    for (int z = from.z; z <= to.z; z++)
+        for (int y = from.y; y <= to.y; y++)
+            for (int x = from.x; x <= to.x; x++)
+            {
+                glm::ivec3 const brick(x, y, z);
+                dirtyBricks.push_back({ SpatialHash::CellKey(brick), brick });
+            }
+}
+
+inline void DistanceField::FreeBrick(uint64_t key)
+{
+    auto it = brickIndices.find(key);
+    if (it == brickIndices.end())
+        return;
+    freeBricks.push_back(it->second);
+    brickIndices.erase(it);
+}
+
+template<class DISTANCE>
+inline void DistanceField::Rebake(std::vector<DistanceObstacle> const& obstacles, DISTANCE&& distance)
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    std::sort(dirtyBricks.begin(), dirtyBricks.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+    dirtyBricks.erase(std::unique(dirtyBricks.begin(), dirtyBricks.end(), [](auto const& a, auto const& b) { return a.first == b.first; }), dirtyBricks.end());
+
+    int const samplesPerBrick = BrickSamples * BrickSamples * BrickSamples;
+    bakedSamples.resize(samplesPerBrick);
+    for (auto const& dirty : dirtyBricks)
+    {
+        // only obstacles that can come within maxDistance of the brick matter
+        glm::vec3 const brickMin = glm::vec3(dirty.second) * BrickSize();
+        glm::vec3 const reachMin = brickMin - glm::vec3(maxDistance);
+        glm::vec3 const reachMax = brickMin + glm::vec3(BrickSize() + maxDistance);
+        candidates.clear();
+        for (int i = 0; i < (int)obstacles.size(); i++)
+        {
+            if (glm::all(glm::lessThanEqual(obstacles[i].boundsMin, reachMax)) && glm::all(glm::greaterThanEqual(obstacles[i].boundsMax, reachMin)))
+                candidates.push_back(i);
+        }
+
+        bool inBand = false;
+        if (!candidates.empty())
+        {
+            for (int z = 0; z < BrickSamples; z++)
+                for (int y = 0; y < BrickSamples; y++)
+                    for (int x = 0; x < BrickSamples; x++)
+                    {
+                        glm::vec3 const position = brickMin + glm::vec3(x, y, z) * voxelSize;
+                        float closest = maxDistance;
+                        for (int obstacle : candidates)
+                        {
+                            closest = std::min(closest, distance(obstacle, position));
+                        }
+                        bakedSamples[x + y * BrickSamples + z * BrickSamples * BrickSamples] = closest;
+                        inBand |= closest < maxDistance;
+                    }
+        }
+        if (!inBand)
+        {
+            FreeBrick(dirty.first);
+            continue;
+        }
+
+        auto it = brickIndices.find(dirty.first);
+        int brick;
+        if (it != brickIndices.end())
+            brick = it->second;
+        else if (!freeBricks.empty())
+        {
+            brick = freeBricks.back();
+            freeBricks.pop_back();
+            brickIndices[dirty.first] = brick;
+        }
+        else
+        {
+            brick = (int)(samples.size() / samplesPerBrick);
+            samples.resize(samples.size() + samplesPerBrick);
+            brickIndices[dirty.first] = brick;
+        }
+        std::copy(bakedSamples.begin(), bakedSamples.end(), samples.begin() + (size_t)brick * samplesPerBrick);
+    }
+
+    lastBricksBaked = (int)dirtyBricks.size();
+    dirtyBricks.clear();
+    lastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+inline float const* DistanceField::FindBrick(glm::vec3 const& position, glm::vec3& local) const
+{
+    glm::ivec3 const brick = BrickOf(position);
+    auto it = brickIndices.find(SpatialHash::CellKey(brick));
+    if (it == brickIndices.end())
+        return nullptr;
+    local = glm::clamp((position - glm::vec3(brick) * BrickSize()) / voxelSize, glm::vec3(0.0f), glm::vec3((float)BrickCells));
+    return samples.data() + (size_t)it->second * BrickSamples * BrickSamples * BrickSamples;
+}
+
+inline float DistanceField::Distance(glm::vec3 const& position) const
+{
+    glm::vec3 gradient;
+    return Sample(position, gradient);
+}
+
+inline float DistanceField::Sample(glm::vec3 const& position, glm::vec3& gradient) const
+{
+    glm::vec3 local;
+    float const* brick = FindBrick(position, local);
+    if (!brick)
+    {
+        gradient = glm::vec3(0.0f);
+        return maxDistance;
+    }
+
+    glm::ivec3 const cell = glm::min(glm::ivec3(local), glm::ivec3(BrickCells - 1));
+    glm::vec3 const t = local - glm::vec3(cell);
+    int const dy = BrickSamples;
+    int const dz = BrickSamples * BrickSamples;
+    float const* c = brick + cell.x + cell.y * dy + cell.z * dz;
+    float const c000 = c[0], c100 = c[1], c010 = c[dy], c110 = c[dy + 1];
+    float const c001 = c[dz], c101 = c[dz + 1], c011 = c[dy + dz], c111 = c[dy + dz + 1];
+
+    // derivative of the trilinear blend along each axis
+    gradient.x = glm::mix(glm::mix(c100 - c000, c110 - c010, t.y), glm::mix(c101 - c001, c111 - c011, t.y), t.z);
+    gradient.y = glm::mix(glm::mix(c010 - c000, c110 - c100, t.x), glm::mix(c011 - c001, c111 - c101, t.x), t.z);
+    gradient.z = glm::mix(glm::mix(c001 - c000, c101 - c100, t.x), glm::mix(c011 - c010, c111 - c110, t.x), t.y);
+    gradient /= voxelSize;
+
+    float const x00 = glm::mix(c000, c100, t.x);
+    float const x10 = glm::mix(c010, c110, t.x);
+    float const x01 = glm::mix(c001, c101, t.x);
+    float const x11 = glm::mix(c011, c111, t.x);
+    return glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+}
+
+inline bool DistanceField::SegmentCast(glm::vec3 const& start, glm::vec3 const& end, float& hitDistance) const
+{
+    float const length = glm::length(end - start);
+    if (length <= 0.0f)
+    {
+        hitDistance = 0.0f;
+        return Distance(start) <= 0.0f;
+    }
+
+    // the field never overestimates by much, so stepping by it can't jump a surface
+    glm::vec3 const dir = (end - start) / length;
+    float const minStep = 0.5f * voxelSize;
+    for (float t = 0.0f; t <= length; )
+    {
+        float const d = Distance(start + dir * t);
+        if (d <= 0.0f)
+        {
+            hitDistance = t;
+            return true;
+        }
+        t += std::max(d, minStep);
+    }
+    hitDistance = length;
+    return false;
+}
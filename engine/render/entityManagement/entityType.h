@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 enum class EntityType
 {
@@ -6,7 +7,6 @@ enum class EntityType
 	SpaceShip,
 	EnemyShip,
 	Asteroid,
-	Node,
 	// Add other types as needed
 };
 
@@ -25,3 +25,11 @@ enum class AIState
 	Roaming,
 	Fleeing
 };
+
+// Collider mask bits, used to filter raycasts against the physics world
+enum class CollisionLayer : uint16_t
+{
+	NONE = 0,
+	ASTEROID = 1 << 0,
+	SHIP = 1 << 1
+};
@@ -0,0 +1,261 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <memory>
+#include <functional>
+#include <climits>
+#include "pathSearch.h"
+
+//------------------------------------------------------------------------------
+/**
+    Shortest path tree of a NavGrid towards one goal node. next[i] is the
+    neighbour to step to from node i, so any number of agents heading for
+    the same goal share one Dijkstra pass and sample it in constant time.
+
+    A change of one node's blocked flag is repaired in place: the part of the
+    tree that hung off an edge that no longer exists is cut loose and
+    reattached, and anything the change opened up is relaxed from the nodes
+    around it.
+*/
+struct FlowField
+{
+    int goal = -1;
+    /// path cost to the goal, INT_MAX where it can't be reached
+    std::vector<int> cost;
+    /// -1 at the goal and where it can't be reached
+    std::vector<int> next;
+
+    void Build(NavGrid const& grid, int goal);
+    /// call after grid was rebaked around node
+    void UpdateNode(NavGrid const& grid, int node);
+    /// unit direction from the node towards the goal, zero if there is none
+    glm::vec3 Direction(NavGrid const& grid, int node) const;
+
+private:
+    void SetupDirections(NavGrid const& grid);
+    /// edge from the node in dir, -1 if there is none
+    int Neighbor(NavGrid const& grid, int node, int dir) const;
+    /// best next step over the node's edges, true if it lowered its cost
+    bool Reattach(NavGrid const& grid, int node);
+    /// Dijkstra outwards from whatever is in open
+    void Propagate(NavGrid const& grid);
+
+    int dirOffsets[27];
+    using Item = std::pair<int, int>; // cost, node
+    std::vector<Item> open;
+};
+
+//------------------------------------------------------------------------------
+/**
+    LRU set of flow fields keyed by goal node. Node changes are forwarded to
+    every cached field.
+*/
+class FlowFieldCache
+{
+public:
+    explicit FlowFieldCache(size_t capacity = 8) : capacity(capacity) {}
+
+    std::shared_ptr<const FlowField> Get(NavGrid const& grid, int goal);
+    void UpdateNode(NavGrid const& grid, int node);
+    void Clear() { fields.clear(); }
+
+    uint64_t builds = 0;
+    uint64_t hits = 0;
+    size_t GetNumFields() const { return fields.size(); }
+
+private:
+    size_t capacity;
+    /// most recently used first
+    std::list<std::shared_ptr<FlowField>> fields;
+};
+
+inline void FlowField::SetupDirections(NavGrid const& grid)
+{
+    for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+                dirOffsets[NavGrid::Direction(dx, dy, dz)] = dx + dy * grid.size + dz * grid.size * grid.size;
+}
+
+inline int FlowField::Neighbor(NavGrid const& grid, int node, int dir) const
+{
+    return (grid.edgeMasks[node] & (1u << dir)) ? node + dirOffsets[dir] : -1;
+}
+
+inline void FlowField::Build(NavGrid const& grid, int goal)
+{
+    SetupDirections(grid);
+    this->goal = goal;
+    cost.assign(grid.NumNodes(), INT_MAX);
+    next.assign(grid.NumNodes(), -1);
+    cost[goal] = 0;
+    open.clear();
+    open.push_back({ 0, goal });
+    Propagate(grid);
+}
+
+inline void FlowField::Propagate(NavGrid const& grid)
+{
+    int const size = grid.size;
+    std::make_heap(open.begin(), open.end(), std::greater<Item>());
+    while (!open.empty())
+    {
+        std::pop_heap(open.begin(), open.end(), std::greater<Item>());
+        Item const item = open.back();
+        open.pop_back();
+        int const current = item.second;
+        if (item.first > cost[current])
+            continue;
+
+        // walk the edges backwards, a node is reached from every neighbour with an edge into it
+        int const cx = current % size;
+        int const cy = (current / size) % size;
+        int const cz = current / (size * size);
+        for (int dir = 0; dir < 27; dir++)
+        {
+            int const dx = dir % 3 - 1;
+            int const dy = (dir / 3) % 3 - 1;
+            int const dz = dir / 9 - 1;
+            if (dir == 13 || cx + dx < 0 || cx + dx >= size || cy + dy < 0 || cy + dy >= size || cz + dz < 0 || cz + dz >= size)
+                continue;
+            int const from = current + dirOffsets[dir];
+            // the opposite of dir points back at current
+            if (!(grid.edgeMasks[from] & (1u << (26 - dir))))
+                continue;
+            int const newCost = item.first + NavDistance(grid.positions[from], grid.positions[current]);
+            if (newCost < cost[from])
+            {
+                cost[from] = newCost;
+                next[from] = current;
+                open.push_back({ newCost, from });
+                std::push_heap(open.begin(), open.end(), std::greater<Item>());
+            }
+        }
+    }
+}
+
+inline bool FlowField::Reattach(NavGrid const& grid, int node)
+{
+    if (node == goal)
+        return false;
+    bool lowered = false;
+    for (int dir = 0; dir < 27; dir++)
+    {
+        int const neighbor = Neighbor(grid, node, dir);
+        if (neighbor == -1 || cost[neighbor] == INT_MAX)
+            continue;
+        int const newCost = cost[neighbor] + NavDistance(grid.positions[node], grid.positions[neighbor]);
+        if (newCost < cost[node])
+        {
+            cost[node] = newCost;
+            next[node] = neighbor;
+            lowered = true;
+        }
+    }
+    return lowered;
+}
+
+inline void FlowField::UpdateNode(NavGrid const& grid, int node)
+{
+    SetupDirections(grid);
+    int const size = grid.size;
+    int const x = node % size;
+    int const y = (node / size) % size;
+    int const z = node / (size * size);
+
+    // every edge that changed starts next to the node
+    std::vector<int> region;
+    for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, size - 1); nz++)
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, size - 1); ny++)
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, size - 1); nx++)
+                region.push_back(nx + ny * size + nz * size * size);
+
+    // cut the subtrees that hung off a removed edge
+    std::vector<int> cut;
+    for (int cell : region)
+    {
+        if (next[cell] == -1)
+            continue;
+        int const to = next[cell];
+        int const dir = NavGrid::Direction(to % size - cell % size, (to / size) % size - (cell / size) % size, to / (size * size) - cell / (size * size));
+        if (!(grid.edgeMasks[cell] & (1u << dir)))
+        {
+            cost[cell] = INT_MAX;
+            next[cell] = -1;
+            cut.push_back(cell);
+        }
+    }
+    for (int i = 0; i < (int)cut.size(); i++)
+    {
+        int const parent = cut[i];
+        int const px = parent % size;
+        int const py = (parent / size) % size;
+        int const pz = parent / (size * size);
+        for (int dir = 0; dir < 27; dir++)
+        {
+            int const dx = dir % 3 - 1;
+            int const dy = (dir / 3) % 3 - 1;
+            int const dz = dir / 9 - 1;
+            if (dir == 13 || px + dx < 0 || px + dx >= size || py + dy < 0 || py + dy >= size || pz + dz < 0 || pz + dz >= size)
+                continue;
+            int const child = parent + dirOffsets[dir];
+            if (next[child] == parent)
+            {
+                cost[child] = INT_MAX;
+                next[child] = -1;
+                cut.push_back(child);
+            }
+        }
+    }
+
+    // reattach the cut nodes and anything that got cheaper, then spread from there
+    open.clear();
+    for (int cell : cut)
+    {
+        Reattach(grid, cell);
+        if (cost[cell] != INT_MAX)
+            open.push_back({ cost[cell], cell });
+    }
+    for (int cell : region)
+    {
+        if (Reattach(grid, cell))
+            open.push_back({ cost[cell], cell });
+    }
+    Propagate(grid);
+}
+
+inline glm::vec3 FlowField::Direction(NavGrid const& grid, int node) const
+{
+    if (next[node] == -1)
+        return glm::vec3(0);
+    return glm::normalize(grid.positions[next[node]] - grid.positions[node]);
+}
+
+inline std::shared_ptr<const FlowField> FlowFieldCache::Get(NavGrid const& grid, int goal)
+{
+    for (auto it = fields.begin(); it != fields.end(); it++)
+    {
+        if ((*it)->goal == goal && (int)(*it)->cost.size() == grid.NumNodes())
+        {
+            fields.splice(fields.begin(), fields, it);
+            hits++;
+            return fields.front();
+        }
+    }
+
+    auto field = std::make_shared<FlowField>();
+    field->Build(grid, goal);
+    builds++;
+    fields.push_front(field);
+    if (fields.size() > capacity)
+        fields.pop_back();
+    return field;
+}
+
+inline void FlowFieldCache::UpdateNode(NavGrid const& grid, int node)
+{
+    for (auto& field : fields)
+    {
+        field->UpdateNode(grid, node);
+    }
+}
@@ -0,0 +1,414 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include "glm.hpp"
+#include "spatialHash.h"
+#include "parallelFor.h"
+
+struct AvoidanceAgent
+{
+    glm::vec3 position = glm::vec3(0);
+    glm::vec3 velocity = glm::vec3(0);
+    /// velocity the agent would take if nothing was around
+    glm::vec3 preferredVelocity = glm::vec3(0);
+    float radius = 1.0f;
+    float maxSpeed = 0.0f;
+    /// false for obstacles and agents that don't take part, the others then avoid them on their own
+    bool avoids = true;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Optimal reciprocal collision avoidance. Every neighbour within reach
+    turns into a half space of velocities that keep the two apart for
+    timeHorizon seconds, each side taking half of the needed change. The new
+    velocity is the one closest to the preferred velocity in all of them,
+    found with an incremental 3D linear program. If no such velocity exists
+    the one that violates the half spaces least is taken instead.
+
+    Agents are hashed into a uniform grid for the neighbour lookup. Each
+    agent's velocity only depends on the previous state of the others, so
+    the solve is split across threads once there are enough agents.
+*/
+class LocalAvoidance
+{
+public:
+    static LocalAvoidance* Instance()
+    {
+        static LocalAvoidance instance;
+        return &instance;
+    }
+
+    LocalAvoidance(const LocalAvoidance&) = delete;
+    void operator=(const LocalAvoidance&) = delete;
+
+    void Clear() { agents.clear(); }
+    /// returns the agent's index for GetVelocity
+    int AddAgent(AvoidanceAgent const& agent);
+    /// compute the new velocity of every agent that avoids
+    void Solve(float dt);
+    /// new velocity of the agent, its current one if it doesn't avoid
+    glm::vec3 const& GetVelocity(int agent) const { return newVelocities[agent]; }
+    int GetNumAgents() const { return (int)agents.size(); }
+
+    /// gap between two agents' surfaces up to which they see each other
+    float neighborDistance = 15.0f;
+    /// closest neighbours taken into account
+    int maxNeighbors = 10;
+    /// how far ahead collisions are avoided, in seconds
+    float timeHorizon = 2.0f;
+
+    /// stats of the last solve
+    double lastMilliseconds = 0;
+    int lastNumThreads = 0;
+
+private:
+    LocalAvoidance() {}
+
+    struct Plane
+    {
+        glm::vec3 point;
+        glm::vec3 normal;
+    };
+    struct Line
+    {
+        glm::vec3 point;
+        glm::vec3 direction;
+    };
+    /// per thread scratch
+    struct Scratch
+    {
+        std::vector<std::pair<float, int>> neighbors; // gap between the surfaces, agent
+        std::vector<Plane> planes;
+        std::vector<Plane> projPlanes;
+    };
+
+    glm::ivec3 CellOf(glm::vec3 const& position) const { return glm::ivec3(glm::floor(position / cellSize)); }
+    void BuildGrid();
+    void FindNeighbors(int agent, Scratch& scratch) const;
+    glm::vec3 SolveAgent(int agent, float dt, Scratch& scratch) const;
+    void SolveRange(int begin, int end, float dt);
+
+    static bool LinearProgram1(std::vector<Plane> const& planes, size_t planeNo, Line const& line, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result);
+    static bool LinearProgram2(std::vector<Plane> const& planes, size_t planeNo, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result);
+    /// returns the number of planes satisfied, planes.size() on success
+    static size_t LinearProgram3(std::vector<Plane> const& planes, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result);
+    static void LinearProgram4(std::vector<Plane> const& planes, size_t beginPlane, float radius, glm::vec3& result, std::vector<Plane>& projPlanes);
+
+    static constexpr float Epsilon = 1e-5f;
+    /// below this many agents the solve stays on the calling thread
+    static constexpr int ParallelMinAgents = 128;
+
+    std::vector<AvoidanceAgent> agents;
+    std::vector<glm::vec3> newVelocities;
+    /// (cell key, agent) sorted by key
+    std::vector<std::pair<uint64_t, int>> cells;
+    float cellSize = 1.0f;
+};
+
+inline int LocalAvoidance::AddAgent(AvoidanceAgent const& agent)
+{
+    agents.push_back(agent);
+    return (int)agents.size() - 1;
+}
+
+inline void LocalAvoidance::BuildGrid()
+{
+    // large enough that every agent within reach is in one of the 27 cells around
+    float maxRadius = 0.0f;
+    for (AvoidanceAgent const& agent : agents)
+    {
+        maxRadius = std::max(maxRadius, agent.radius);
+    }
+    cellSize = std::max(neighborDistance + 2.0f * maxRadius, Epsilon);
+
+    cells.resize(agents.size());
+    for (int i = 0; i < (int)agents.size(); i++)
+    {
+        cells[i] = { SpatialHash::CellKey(CellOf(agents[i].position)), i };
+    }
+    std::sort(cells.begin(), cells.end());
+}
+
+inline void LocalAvoidance::FindNeighbors(int agent, Scratch& scratch) const
+{
+    AvoidanceAgent const& self = agents[agent];
+    glm::ivec3 const center = CellOf(self.position);
+    scratch.neighbors.clear();
+    for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                uint64_t const key = SpatialHash::CellKey(center + glm::ivec3(dx, dy, dz));
+                auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(key, 0));
+                for (; it != cells.end() && it->first == key; it++)
+                {
+                    int const other = it->second;
+                    if (other == agent)
+                        continue;
+                    glm::vec3 const relativePosition = agents[other].position - self.position;
+                    float const reach = neighborDistance + self.radius + agents[other].radius;
+                    float const distSq = glm::dot(relativePosition, relativePosition);
+                    if (distSq < reach * reach)
+                        scratch.neighbors.push_back({ std::sqrt(distSq) - self.radius - agents[other].radius, other });
+                }
+            }
+
+    // ranked by gap rather than distance, so a large obstacle isn't crowded out by small agents in front of its center
+    if ((int)scratch.neighbors.size() > maxNeighbors)
+    {
+        std::nth_element(scratch.neighbors.begin(), scratch.neighbors.begin() + maxNeighbors, scratch.neighbors.end());
+        scratch.neighbors.resize(maxNeighbors);
+    }
+}
+
+inline glm::vec3 LocalAvoidance::SolveAgent(int agent, float dt, Scratch& scratch) const
+{
+    AvoidanceAgent const& self = agents[agent];
+    FindNeighbors(agent, scratch);
+
+    float const invTimeHorizon = 1.0f / timeHorizon;
+    scratch.planes.clear();
+    for (auto const& neighbor : scratch.neighbors)
+    {
+        AvoidanceAgent const& other = agents[neighbor.second];
+        glm::vec3 const relativePosition = other.position - self.position;
+        glm::vec3 const relativeVelocity = self.velocity - other.velocity;
+        float const distSq = glm::dot(relativePosition, relativePosition);
+        float const combinedRadius = self.radius + other.radius;
+        float const combinedRadiusSq = combinedRadius * combinedRadius;
+
+        Plane plane;
+        glm::vec3 u;
+        if (distSq > combinedRadiusSq)
+        {
+            // no collision yet, vector from the cutoff center to the relative velocity
+            glm::vec3 const w = relativeVelocity - invTimeHorizon * relativePosition;
+            float const wLengthSq = glm::dot(w, w);
+            float const dotProduct = glm::dot(w, relativePosition);
+            if (dotProduct < 0.0f && dotProduct * dotProduct > combinedRadiusSq * wLengthSq)
+            {
+                // project on the cutoff sphere
+                float const wLength = std::sqrt(wLengthSq);
+                glm::vec3 const unitW = w / wLength;
+                plane.normal = unitW;
+                u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+            }
+            else
+            {
+                // project on the cone
+                float const a = distSq;
+                float const b = glm::dot(relativePosition, relativeVelocity);
+                glm::vec3 const cross = glm::cross(relativePosition, relativeVelocity);
+                float const c = glm::dot(relativeVelocity, relativeVelocity) - glm::dot(cross, cross) / (distSq - combinedRadiusSq);
+                float const t = (b + std::sqrt(std::max(b * b - a * c, 0.0f))) / a;
+                glm::vec3 const ww = relativeVelocity - t * relativePosition;
+                float const wwLength = glm::length(ww);
+                glm::vec3 const unitWW = wwLength > Epsilon ? ww / wwLength : -relativePosition / std::sqrt(distSq);
+                plane.normal = unitWW;
+                u = (combinedRadius * t - wwLength) * unitWW;
+            }
+        }
+        else
+        {
+            // already overlapping, get apart within this step
+            float const invTimeStep = 1.0f / dt;
+            glm::vec3 const w = relativeVelocity - invTimeStep * relativePosition;
+            float const wLength = glm::length(w);
+            glm::vec3 const unitW = wLength > Epsilon ? w / wLength : glm::vec3(0, 1, 0);
+            plane.normal = unitW;
+            u = (combinedRadius * invTimeStep - wLength) * unitW;
+        }
+
+        // the other side takes half, unless it doesn't avoid at all
+        float const responsibility = other.avoids ? 0.5f : 1.0f;
+        plane.point = self.velocity + responsibility * u;
+        scratch.planes.push_back(plane);
+    }
+
+    glm::vec3 result;
+    size_t const planeFail = LinearProgram3(scratch.planes, self.maxSpeed, self.preferredVelocity, false, result);
+    if (planeFail < scratch.planes.size())
+        LinearProgram4(scratch.planes, planeFail, self.maxSpeed, result, scratch.projPlanes);
+    return result;
+}
+
+inline void LocalAvoidance::SolveRange(int begin, int end, float dt)
+{
+    Scratch scratch;
+    for (int i = begin; i < end; i++)
+    {
+        newVelocities[i] = agents[i].avoids ? SolveAgent(i, dt, scratch) : agents[i].velocity;
+    }
+}
+
+inline void LocalAvoidance::Solve(float dt)
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    int const numAgents = (int)agents.size();
+    newVelocities.resize(numAgents);
+    dt = std::max(dt, Epsilon);
+    BuildGrid();
+
+    int const numThreads = ParallelFor::Run(numAgents, ParallelMinAgents, [this, dt](int begin, int end) { SolveRange(begin, end, dt); });
+
+    lastNumThreads = numThreads;
+    lastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+inline bool LocalAvoidance::LinearProgram1(std::vector<Plane> const& planes, size_t planeNo, Line const& line, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result)
+{
+    float const dotProduct = glm::dot(line.point, line.direction);
+    float const discriminant = dotProduct * dotProduct + radius * radius - glm::dot(line.point, line.point);
+    if (discriminant < 0.0f)
+        return false; // max speed sphere fully invalidates the line
+
+    float const sqrtDiscriminant = std::sqrt(discriminant);
+    float tLeft = -dotProduct - sqrtDiscriminant;
+    float tRight = -dotProduct + sqrtDiscriminant;
+    for (size_t i = 0; i < planeNo; i++)
+    {
+        float const numerator = glm::dot(planes[i].point - line.point, planes[i].normal);
+        float const denominator = glm::dot(line.direction, planes[i].normal);
+        if (denominator * denominator <= Epsilon)
+        {
+            // line is (almost) parallel to the plane
+            if (numerator > 0.0f)
+                return false;
+            continue;
+        }
+
+        float const t = numerator / denominator;
+        if (denominator >= 0.0f)
+            tLeft = std::max(tLeft, t);
+        else
+            tRight = std::min(tRight, t);
+        if (tLeft > tRight)
+            return false;
+    }
+
+    if (directionOpt)
+    {
+        result = glm::dot(optVelocity, line.direction) > 0.0f ? line.point + tRight * line.direction : line.point + tLeft * line.direction;
+    }
+    else
+    {
+        float const t = glm::dot(line.direction, optVelocity - line.point);
+        result = line.point + glm::clamp(t, tLeft, tRight) * line.direction;
+    }
+    return true;
+}
+
+inline bool LocalAvoidance::LinearProgram2(std::vector<Plane> const& planes, size_t planeNo, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result)
+{
+    Plane const& plane = planes[planeNo];
+    float const planeDist = glm::dot(plane.point, plane.normal);
+    float const planeDistSq = planeDist * planeDist;
+    float const radiusSq = radius * radius;
+    if (planeDistSq > radiusSq)
+        return false; // max speed sphere fully invalidates the plane
+
+    float const planeRadiusSq = radiusSq - planeDistSq;
+    glm::vec3 const planeCenter = planeDist * plane.normal;
+    if (directionOpt)
+    {
+        glm::vec3 const planeOptVelocity = optVelocity - glm::dot(optVelocity, plane.normal) * plane.normal;
+        float const planeOptVelocityLengthSq = glm::dot(planeOptVelocity, planeOptVelocity);
+        if (planeOptVelocityLengthSq <= Epsilon)
+            result = planeCenter;
+        else
+            result = planeCenter + std::sqrt(planeRadiusSq / planeOptVelocityLengthSq) * planeOptVelocity;
+    }
+    else
+    {
+        // project the optimum onto the plane, then back into the circle if it left it
+        result = optVelocity + glm::dot(plane.point - optVelocity, plane.normal) * plane.normal;
+        if (glm::dot(result, result) > radiusSq)
+        {
+            glm::vec3 const planeResult = result - planeCenter;
+            result = planeCenter + std::sqrt(planeRadiusSq / glm::dot(planeResult, planeResult)) * planeResult;
+        }
+    }
+
+    for (size_t i = 0; i < planeNo; i++)
+    {
+        if (glm::dot(planes[i].normal, planes[i].point - result) <= 0.0f)
+            continue;
+
+        // result violates plane i, the optimum lies on the line where the two meet
+        glm::vec3 const crossProduct = glm::cross(planes[i].normal, plane.normal);
+        if (glm::dot(crossProduct, crossProduct) <= Epsilon)
+            return false; // planes are parallel
+
+        Line line;
+        line.direction = glm::normalize(crossProduct);
+        glm::vec3 const lineNormal = glm::cross(line.direction, plane.normal);
+        line.point = plane.point + (glm::dot(planes[i].point - plane.point, planes[i].normal) / glm::dot(lineNormal, planes[i].normal)) * lineNormal;
+        if (!LinearProgram1(planes, i, line, radius, optVelocity, directionOpt, result))
+            return false;
+    }
+    return true;
+}
+
+inline size_t LocalAvoidance::LinearProgram3(std::vector<Plane> const& planes, float radius, glm::vec3 const& optVelocity, bool directionOpt, glm::vec3& result)
+{
+    if (directionOpt)
+        result = optVelocity * radius; // optVelocity is a unit direction here
+    else if (glm::dot(optVelocity, optVelocity) > radius * radius)
+        result = glm::normalize(optVelocity) * radius;
+    else
+        result = optVelocity;
+
+    for (size_t i = 0; i < planes.size(); i++)
+    {
+        if (glm::dot(planes[i].normal, planes[i].point - result) > 0.0f)
+        {
+            glm::vec3 const tempResult = result;
+            if (!LinearProgram2(planes, i, radius, optVelocity, directionOpt, result))
+            {
+                result = tempResult;
+                return i;
+            }
+        }
+    }
+    return planes.size();
+}
+
+inline void LocalAvoidance::LinearProgram4(std::vector<Plane> const& planes, size_t beginPlane, float radius, glm::vec3& result, std::vector<Plane>& projPlanes)
+{
+    float distance = 0.0f;
+    for (size_t i = beginPlane; i < planes.size(); i++)
+    {
+        if (glm::dot(planes[i].normal, planes[i].point - result) <= distance)
+            continue;
+
+        // minimize the largest violation, planes j < i are taken relative to plane i
+        projPlanes.clear();
+        for (size_t j = 0; j < i; j++)
+        {
+            Plane plane;
+            glm::vec3 const crossProduct = glm::cross(planes[j].normal, planes[i].normal);
+            if (glm::dot(crossProduct, crossProduct) <= Epsilon)
+            {
+                if (glm::dot(planes[i].normal, planes[j].normal) > 0.0f)
+                    continue; // same direction
+                plane.point = 0.5f * (planes[i].point + planes[j].point);
+            }
+            else
+            {
+                glm::vec3 const lineNormal = glm::cross(crossProduct, planes[i].normal);
+                plane.point = planes[i].point + (glm::dot(planes[j].point - planes[i].point, planes[j].normal) / glm::dot(lineNormal, planes[j].normal)) * lineNormal;
+            }
+            plane.normal = glm::normalize(planes[j].normal - planes[i].normal);
+            projPlanes.push_back(plane);
+        }
+
+        glm::vec3 const tempResult = result;
+        if (LinearProgram3(projPlanes, radius, planes[i].normal, true, result) < projPlanes.size())
+            result = tempResult; // only fails from floating point error, keep the last result
+        distance = glm::dot(planes[i].normal, planes[i].point - result);
+    }
+}
@@ -0,0 +1,550 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <climits>
+#include <cfloat>
+#include "pathSearch.h"
+
+//------------------------------------------------------------------------------
+/**
+    Hierarchical abstraction of a NavGrid (HPA*). The grid is cut into cubic
+    clusters. Where two face-adjacent clusters touch, every connected open
+    region of the shared face gets one entrance: a node pair straddling the
+    border. The entrance nodes of a cluster are connected by their shortest
+    path cost inside the cluster. A query searches this small abstract graph
+    first and then refines only the clusters the abstract path runs through.
+
+    The graph is built as soon as the grid is set. A node change only marks
+    the faces and clusters around it, Refresh rebuilds them. Queries are
+    const and keep their state in a Scratch, so a snapshot of the hierarchy
+    can be searched on worker threads while the owner goes on updating.
+    Clusters are shared between copies, a copy only duplicates the faces.
+*/
+class NavHierarchy
+{
+public:
+    /// per thread search state
+    struct Scratch
+    {
+        // SearchCluster state, indexed by position in the searched cluster
+        glm::ivec3 localMin;
+        glm::ivec3 localExtent;
+        std::vector<int> localDist;
+        std::vector<int> localParent;
+        std::vector<std::pair<int, int>> open;
+
+        /// abstract nodes expanded, grid nodes settled inside clusters and clusters refined by the last query
+        int expanded = 0;
+        int settled = 0;
+        int refined = 0;
+    };
+
+    explicit NavHierarchy(int clusterSize = 10) : clusterSize(clusterSize) {}
+
+    /// use a new grid and build everything for it
+    void SetGrid(std::shared_ptr<const NavGrid> grid);
+    /// use a new snapshot of the same grid in which the given node changed, Refresh once all changes are in
+    void UpdateNode(std::shared_ptr<const NavGrid> grid, int node);
+    /// rebuild the faces and clusters UpdateNode marked
+    void Refresh();
+
+    /// same contract as PathSearch::FindPath, except that nothing is written if goal is unreachable.
+    /// Paths are close to, but not always, the shortest. Call Refresh after changes first.
+    bool FindPath(int start, int goal, std::vector<int>& path, Scratch& scratch) const;
+
+    int GetNumAbstractNodes() const;
+
+private:
+    struct Cluster
+    {
+        /// entrance nodes inside the cluster
+        std::vector<int> nodes;
+        /// nodes in neighbouring clusters each entrance node connects to
+        std::vector<std::vector<int>> partners;
+        /// nodes.size()^2 path costs inside the cluster, INT_MAX if there is none
+        std::vector<int> costs;
+    };
+
+    int ClusterOf(int node) const;
+    int Slot(Cluster const& cluster, int node) const;
+    /// face between the cluster and its neighbour in +axis
+    void BuildFace(int cluster, int axis);
+    void BuildCluster(int cluster);
+    /// search from source that stays inside the cluster, stops once target is settled
+    void SearchCluster(int cluster, int source, int target, Scratch& scratch) const;
+    int LocalIndex(int node, Scratch const& scratch) const;
+
+    std::shared_ptr<const NavGrid> grid;
+    int clusterSize;
+    int clustersPerSide = 0;
+    /// rebuilt clusters are replaced, never modified, so copies can share them
+    std::vector<std::shared_ptr<const Cluster>> clusters;
+    std::vector<uint8_t> dirtyClusters;
+    /// entrance pairs (low side, high side), cluster * 3 + axis
+    std::vector<std::vector<std::pair<int, int>>> faces;
+    std::vector<uint8_t> dirtyFaces;
+    bool anyDirty = false;
+    Scratch buildScratch;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void NavHierarchy::SetGrid(std::shared_ptr<const NavGrid> grid)
+{
+    this->grid = std::move(grid);
+    clustersPerSide = (this->grid->size + clusterSize - 1) / clusterSize;
+    int const numClusters = clustersPerSide * clustersPerSide * clustersPerSide;
+    clusters.assign(numClusters, nullptr);
+    dirtyClusters.assign(numClusters, 1);
+    faces.assign(numClusters * 3, {});
+    dirtyFaces.assign(numClusters * 3, 1);
+    anyDirty = true;
+    Refresh();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void NavHierarchy::UpdateNode(std::shared_ptr<const NavGrid> grid, int node)
+{
+    if (!this->grid || this->grid->size != grid->size)
+    {
+        SetGrid(std::move(grid));
+        return;
+    }
+    this->grid = std::move(grid);
+
+    int const size = this->grid->size;
+    int const coords[3] = { node % size, (node / size) % size, node / (size * size) };
+    int const cluster = ClusterOf(node);
+    int const steps[3] = { 1, clustersPerSide, clustersPerSide * clustersPerSide };
+    dirtyClusters[cluster] = 1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int const local = coords[axis] % clusterSize;
+        int const clusterCoord = coords[axis] / clusterSize;
+        if ((local == clusterSize - 1 || coords[axis] == size - 1) && clusterCoord + 1 < clustersPerSide)
+        {
+            dirtyFaces[cluster * 3 + axis] = 1;
+            dirtyClusters[cluster + steps[axis]] = 1;
+        }
+        if (local == 0 && clusterCoord > 0)
+        {
+            dirtyFaces[(cluster - steps[axis]) * 3 + axis] = 1;
+            dirtyClusters[cluster - steps[axis]] = 1;
+        }
+    }
+    anyDirty = true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int NavHierarchy::GetNumAbstractNodes() const
+{
+    int count = 0;
+    for (auto const& cluster : clusters)
+        count += (int)cluster->nodes.size();
+    return count;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int NavHierarchy::ClusterOf(int node) const
+{
+    int const size = grid->size;
+    int const x = (node % size) / clusterSize;
+    int const y = ((node / size) % size) / clusterSize;
+    int const z = (node / (size * size)) / clusterSize;
+    return x + y * clustersPerSide + z * clustersPerSide * clustersPerSide;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int NavHierarchy::Slot(Cluster const& cluster, int node) const
+{
+    for (int i = 0; i < (int)cluster.nodes.size(); i++)
+    {
+        if (cluster.nodes[i] == node)
+            return i;
+    }
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Faces first, the clusters read their entrances from them.
+*/
+inline void NavHierarchy::Refresh()
+{
+    if (!anyDirty)
+        return;
+    for (int face = 0; face < (int)faces.size(); face++)
+    {
+        if (dirtyFaces[face])
+        {
+            BuildFace(face / 3, face % 3);
+            dirtyFaces[face] = 0;
+        }
+    }
+    for (int cluster = 0; cluster < (int)clusters.size(); cluster++)
+    {
+        if (dirtyClusters[cluster])
+        {
+            BuildCluster(cluster);
+            dirtyClusters[cluster] = 0;
+        }
+    }
+    anyDirty = false;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Open pairs on the face are flood filled into connected regions, the pair
+    closest to a region's centre becomes its entrance.
+*/
+inline void NavHierarchy::BuildFace(int cluster, int axis)
+{
+    std::vector<std::pair<int, int>>& entrances = faces[cluster * 3 + axis];
+    entrances.clear();
+
+    int const size = grid->size;
+    int const c[3] = { cluster % clustersPerSide, (cluster / clustersPerSide) % clustersPerSide, cluster / (clustersPerSide * clustersPerSide) };
+    if (c[axis] + 1 >= clustersPerSide)
+        return;
+
+    // the two axes spanning the face
+    int const u = (axis + 1) % 3;
+    int const v = (axis + 2) % 3;
+    int const uMin = c[u] * clusterSize;
+    int const vMin = c[v] * clusterSize;
+    int const uCount = std::min(size, uMin + clusterSize) - uMin;
+    int const vCount = std::min(size, vMin + clusterSize) - vMin;
+    int const strides[3] = { 1, size, size * size };
+
+    auto lowNode = [&](int i, int j)
+    {
+        return ((c[axis] + 1) * clusterSize - 1) * strides[axis] + (uMin + i) * strides[u] + (vMin + j) * strides[v];
+    };
+    auto isOpen = [&](int i, int j)
+    {
+        int const low = lowNode(i, j);
+        return !grid->blocked[low] && !grid->blocked[low + strides[axis]];
+    };
+
+    std::vector<uint8_t> visited(uCount * vCount, 0);
+    std::vector<int> region;
+    for (int start = 0; start < uCount * vCount; start++)
+    {
+        if (visited[start] || !isOpen(start % uCount, start / uCount))
+            continue;
+
+        region.clear();
+        region.push_back(start);
+        visited[start] = 1;
+        float cu = 0.0f, cv = 0.0f;
+        for (int r = 0; r < (int)region.size(); r++)
+        {
+            int const i = region[r] % uCount;
+            int const j = region[r] / uCount;
+            cu += i;
+            cv += j;
+            int const neighbors[4][2] = { { i - 1, j }, { i + 1, j }, { i, j - 1 }, { i, j + 1 } };
+            for (auto const& n : neighbors)
+            {
+                if (n[0] < 0 || n[0] >= uCount || n[1] < 0 || n[1] >= vCount)
+                    continue;
+                int const cell = n[0] + n[1] * uCount;
+                if (!visited[cell] && isOpen(n[0], n[1]))
+                {
+                    visited[cell] = 1;
+                    region.push_back(cell);
+                }
+            }
+        }
+        cu /= region.size();
+        cv /= region.size();
+
+        int best = region[0];
+        float bestDistance = FLT_MAX;
+        for (int cell : region)
+        {
+            float const du = cell % uCount - cu;
+            float const dv = cell / uCount - cv;
+            if (du * du + dv * dv < bestDistance)
+            {
+                bestDistance = du * du + dv * dv;
+                best = cell;
+            }
+        }
+        int const low = lowNode(best % uCount, best / uCount);
+        entrances.push_back({ low, low + strides[axis] });
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void NavHierarchy::BuildCluster(int index)
+{
+    auto built = std::make_shared<Cluster>();
+    Cluster& cluster = *built;
+
+    auto addEntrance = [&](int node, int partner)
+    {
+        int slot = Slot(cluster, node);
+        if (slot < 0)
+        {
+            slot = (int)cluster.nodes.size();
+            cluster.nodes.push_back(node);
+            cluster.partners.emplace_back();
+        }
+        cluster.partners[slot].push_back(partner);
+    };
+
+    int const steps[3] = { 1, clustersPerSide, clustersPerSide * clustersPerSide };
+    int const c[3] = { index % clustersPerSide, (index / clustersPerSide) % clustersPerSide, index / (clustersPerSide * clustersPerSide) };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (auto const& entrance : faces[index * 3 + axis])
+            addEntrance(entrance.first, entrance.second);
+        if (c[axis] > 0)
+        {
+            for (auto const& entrance : faces[(index - steps[axis]) * 3 + axis])
+                addEntrance(entrance.second, entrance.first);
+        }
+    }
+
+    int const n = (int)cluster.nodes.size();
+    cluster.costs.assign(n * n, INT_MAX);
+    for (int i = 0; i < n; i++)
+    {
+        SearchCluster(index, cluster.nodes[i], -1, buildScratch);
+        for (int j = 0; j < n; j++)
+        {
+            cluster.costs[i * n + j] = buildScratch.localDist[LocalIndex(cluster.nodes[j], buildScratch)];
+        }
+    }
+    clusters[index] = std::move(built);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int NavHierarchy::LocalIndex(int node, Scratch const& scratch) const
+{
+    int const size = grid->size;
+    int const x = node % size - scratch.localMin.x;
+    int const y = (node / size) % size - scratch.localMin.y;
+    int const z = node / (size * size) - scratch.localMin.z;
+    return x + y * scratch.localExtent.x + z * scratch.localExtent.x * scratch.localExtent.y;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void NavHierarchy::SearchCluster(int cluster, int source, int target, Scratch& scratch) const
+{
+    int const size = grid->size;
+    glm::ivec3 const c(cluster % clustersPerSide, (cluster / clustersPerSide) % clustersPerSide, cluster / (clustersPerSide * clustersPerSide));
+    glm::ivec3 const localMin = c * clusterSize;
+    glm::ivec3 const localExtent = glm::min(localMin + clusterSize, glm::ivec3(size)) - localMin;
+    int const numLocal = localExtent.x * localExtent.y * localExtent.z;
+    scratch.localMin = localMin;
+    scratch.localExtent = localExtent;
+    std::vector<int>& localDist = scratch.localDist;
+    std::vector<int>& localParent = scratch.localParent;
+    std::vector<std::pair<int, int>>& open = scratch.open;
+    localDist.assign(numLocal, INT_MAX);
+    localParent.assign(numLocal, -1);
+
+    // with a target this turns into A*, the open list is ordered by cost plus estimate
+    glm::vec3 const targetPos = target >= 0 ? grid->positions[target] : glm::vec3(0);
+    auto estimate = [&](int node) { return target >= 0 ? NavDistance(grid->positions[node], targetPos) : 0; };
+
+    using Item = std::pair<int, int>; // cost + estimate, grid index
+    open.clear();
+    localDist[LocalIndex(source, scratch)] = 0;
+    open.push_back({ estimate(source), source });
+    while (!open.empty())
+    {
+        std::pop_heap(open.begin(), open.end(), std::greater<Item>());
+        Item const item = open.back();
+        open.pop_back();
+        int const current = item.second;
+        int const currentCost = localDist[LocalIndex(current, scratch)];
+        if (item.first > currentCost + estimate(current))
+            continue;
+        scratch.settled++;
+        if (current == target)
+            return;
+
+        int const* costs = grid->EdgeCosts(current);
+        for (int const* edge = grid->EdgesBegin(current); edge != grid->EdgesEnd(current); edge++, costs++)
+        {
+            int const neighbor = *edge;
+            glm::ivec3 const cell = glm::ivec3(neighbor % size, (neighbor / size) % size, neighbor / (size * size)) - localMin;
+            if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, localExtent)))
+                continue;
+            int const local = cell.x + cell.y * localExtent.x + cell.z * localExtent.x * localExtent.y;
+            int const newCost = currentCost + *costs;
+            if (newCost < localDist[local])
+            {
+                localDist[local] = newCost;
+                localParent[local] = current;
+                open.push_back({ newCost + estimate(neighbor), neighbor });
+                std::push_heap(open.begin(), open.end(), std::greater<Item>());
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Start and goal join the abstract graph through their cost to the
+    entrances of their own cluster. The abstract path is then refined
+    between consecutive entries, inside one cluster at a time.
+*/
+inline bool NavHierarchy::FindPath(int start, int goal, std::vector<int>& path, Scratch& scratch) const
+{
+    scratch.expanded = 0;
+    scratch.settled = 0;
+    scratch.refined = 0;
+    if (!grid)
+        return false;
+
+    int const startCluster = ClusterOf(start);
+    int const goalCluster = ClusterOf(goal);
+    if (start == goal)
+    {
+        path.clear();
+        return true;
+    }
+    if (grid->blocked[goal])
+        return false;
+
+    // the direct route never leaves the cluster, but it may not be the only one
+    if (startCluster == goalCluster)
+    {
+        SearchCluster(startCluster, start, goal, scratch);
+        if (scratch.localDist[LocalIndex(goal, scratch)] != INT_MAX)
+        {
+            path.clear();
+            for (int node = goal; node != start; node = scratch.localParent[LocalIndex(node, scratch)])
+                path.push_back(node);
+            std::reverse(path.begin(), path.end());
+            scratch.refined = 1;
+            return true;
+        }
+    }
+
+    Cluster const& first = *clusters[startCluster];
+    std::vector<int> startCosts(first.nodes.size());
+    SearchCluster(startCluster, start, -1, scratch);
+    for (int i = 0; i < (int)first.nodes.size(); i++)
+        startCosts[i] = scratch.localDist[LocalIndex(first.nodes[i], scratch)];
+
+    Cluster const& last = *clusters[goalCluster];
+    std::vector<int> goalCosts(last.nodes.size());
+    SearchCluster(goalCluster, goal, -1, scratch);
+    for (int i = 0; i < (int)last.nodes.size(); i++)
+        goalCosts[i] = scratch.localDist[LocalIndex(last.nodes[i], scratch)];
+
+    // abstract A*, keyed by grid index
+    std::unordered_map<int, int> gCost;
+    std::unordered_map<int, int> parent;
+    std::unordered_set<int> closed;
+    using Item = std::pair<int, int>; // fCost, grid index
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+    glm::vec3 const goalPos = grid->positions[goal];
+    auto relax = [&](int from, int to, int cost)
+    {
+        if (cost == INT_MAX)
+            return;
+        int const newCost = gCost[from] + cost;
+        auto it = gCost.find(to);
+        if (it == gCost.end() || newCost < it->second)
+        {
+            gCost[to] = newCost;
+            parent[to] = from;
+            open.push({ newCost + NavDistance(grid->positions[to], goalPos), to });
+        }
+    };
+
+    gCost[start] = 0;
+    open.push({ NavDistance(grid->positions[start], goalPos), start });
+    bool found = false;
+    while (!open.empty())
+    {
+        Item const item = open.top();
+        open.pop();
+        int const current = item.second;
+        if (!closed.insert(current).second)
+            continue;
+        scratch.expanded++;
+        if (current == goal)
+        {
+            found = true;
+            break;
+        }
+
+        if (current == start)
+        {
+            for (int i = 0; i < (int)first.nodes.size(); i++)
+                relax(start, first.nodes[i], startCosts[i]);
+        }
+        int const cluster = ClusterOf(current);
+        Cluster const& owner = *clusters[cluster];
+        int const slot = Slot(owner, current);
+        if (slot >= 0)
+        {
+            int const n = (int)owner.nodes.size();
+            for (int i = 0; i < n; i++)
+            {
+                if (i != slot)
+                    relax(current, owner.nodes[i], owner.costs[slot * n + i]);
+            }
+            for (int partner : owner.partners[slot])
+                relax(current, partner, NavDistance(grid->positions[current], grid->positions[partner]));
+            if (cluster == goalCluster)
+                relax(current, goal, goalCosts[slot]);
+        }
+    }
+    if (!found)
+        return false;
+
+    std::vector<int> abstractPath;
+    for (int node = goal; node != start; node = parent[node])
+        abstractPath.push_back(node);
+    abstractPath.push_back(start);
+    std::reverse(abstractPath.begin(), abstractPath.end());
+
+    path.clear();
+    std::vector<int> segment;
+    for (int i = 1; i < (int)abstractPath.size(); i++)
+    {
+        int const from = abstractPath[i - 1];
+        int const to = abstractPath[i];
+        int const cluster = ClusterOf(from);
+        if (cluster != ClusterOf(to))
+        {
+            // crossing an entrance
+            path.push_back(to);
+            continue;
+        }
+        SearchCluster(cluster, from, to, scratch);
+        scratch.refined++;
+        segment.clear();
+        for (int node = to; node != from; node = scratch.localParent[LocalIndex(node, scratch)])
+            segment.push_back(node);
+        path.insert(path.end(), segment.rbegin(), segment.rend());
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "glm.hpp"
+
+//------------------------------------------------------------------------------
+/**
+    Dense voxel grid of navigation cells, size^3 cells spaced evenly from
+    origin. Index and position follow from each other, so a cell stores
+    nothing but its flags. The pathfinder bakes its NavGrid from this, and
+    the rest of the game addresses cells by index or world position.
+*/
+class NavVolume
+{
+public:
+    enum CellFlags : uint8_t
+    {
+        /// an asteroid is within reach of the cell
+        Blocked = 1 << 0,
+    };
+
+    void Create(int size, glm::vec3 const& origin, float spacing);
+
+    int GetSize() const { return size; }
+    int NumCells() const { return (int)flags.size(); }
+    glm::vec3 const& GetOrigin() const { return origin; }
+    float GetSpacing() const { return spacing; }
+    /// bumped by Create, anything baked from an older generation is stale
+    uint32_t GetGeneration() const { return generation; }
+
+    int CellIndex(glm::ivec3 const& coords) const { return coords.x + coords.y * size + coords.z * size * size; }
+    glm::ivec3 CellCoords(int cell) const { return glm::ivec3(cell % size, (cell / size) % size, cell / (size * size)); }
+    glm::vec3 CellPosition(int cell) const { return origin + glm::vec3(CellCoords(cell)) * spacing; }
+    /// cell closest to the position, clamped to the volume. -1 if the volume is empty
+    int CellAt(glm::vec3 const& position) const;
+    /// range of the cells whose positions lie in the box, false if there are none
+    bool CellRange(glm::vec3 const& min, glm::vec3 const& max, glm::ivec3& cellsMin, glm::ivec3& cellsMax) const;
+
+    bool IsBlocked(int cell) const { return (flags[cell] & Blocked) != 0; }
+    void SetBlocked(int cell, bool blocked);
+
+private:
+    int size = 0;
+    glm::vec3 origin = glm::vec3(0);
+    float spacing = 1.0f;
+    uint32_t generation = 0;
+    std::vector<uint8_t> flags;
+};
+
+inline void NavVolume::Create(int size, glm::vec3 const& origin, float spacing)
+{
+    this->size = size;
+    this->origin = origin;
+    this->spacing = spacing;
+    flags.assign((size_t)size * size * size, 0);
+    generation++;
+}
+
+inline int NavVolume::CellAt(glm::vec3 const& position) const
+{
+    if (flags.empty())
+        return -1;
+    glm::ivec3 const coords = glm::clamp(glm::ivec3(glm::round((position - origin) / spacing)), glm::ivec3(0), glm::ivec3(size - 1));
+    return CellIndex(coords);
+}
+
+inline bool NavVolume::CellRange(glm::vec3 const& min, glm::vec3 const& max, glm::ivec3& cellsMin, glm::ivec3& cellsMax) const
+{
+    cellsMin = glm::max(glm::ivec3(glm::ceil((min - origin) / spacing)), glm::ivec3(0));
+    cellsMax = glm::min(glm::ivec3(glm::floor((max - origin) / spacing)), glm::ivec3(size - 1));
+    return cellsMin.x <= cellsMax.x && cellsMin.y <= cellsMax.y && cellsMin.z <= cellsMax.z;
+}
+
+inline void NavVolume::SetBlocked(int cell, bool blocked)
+{
+    if (blocked)
+        flags[cell] |= Blocked;
+    else
+        flags[cell] &= ~Blocked;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+/**
+    Calls body(begin, end) over ranges that together cover [0, count). Below
+    minCount it all runs on the calling thread, otherwise the ranges are
+    split over up to MaxThreads threads. Returns the number of threads used.
+*/
+namespace ParallelFor
+{
+static constexpr int MaxThreads = 4;
+
+template<class BODY>
+inline int Run(int count, int minCount, BODY&& body)
+{
+    int const numThreads = count < minCount ? 1 : std::max(1, std::min(MaxThreads, (int)std::thread::hardware_concurrency()));
+    if (numThreads == 1)
+    {
+        body(0, count);
+        return 1;
+    }
+
+    // the calling thread takes the first range
+    std::vector<std::future<void>> ranges;
+    int const rangeSize = (count + numThreads - 1) / numThreads;
+    for (int begin = rangeSize; begin < count; begin += rangeSize)
+    {
+        ranges.push_back(std::async(std::launch::async, [&body, begin, end = std::min(begin + rangeSize, count)]() { body(begin, end); }));
+    }
+    body(0, std::min(rangeSize, count));
+    for (auto& range : ranges)
+    {
+        range.get();
+    }
+    return numThreads;
+}
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+/**
+    LRU cache of solved paths keyed by (start, goal). Any stretch of a
+    shortest path is itself a shortest path, so a query whose start and goal
+    both lie on a cached path in that order is answered from it too. Each
+    node keeps the keys of the entries that traverse it, so a change to the
+    node only drops those entries.
+*/
+class PathCache
+{
+public:
+    explicit PathCache(size_t capacity = 1024) : capacity(capacity) {}
+
+    /// writes the nodes after start up to and including goal to path on a hit
+    bool Lookup(int start, int goal, std::vector<int>& path);
+    /// cache a found path, path holds the nodes after start up to and including goal
+    void Insert(int start, int goal, std::vector<int> const& path);
+    /// drop every entry that traverses the node
+    void InvalidateNode(int node);
+    void Clear();
+
+    size_t GetNumEntries() const { return entries.size(); }
+    uint64_t hits = 0;
+    uint64_t subPathHits = 0;
+    uint64_t misses = 0;
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::vector<int> nodes; // start first, goal last
+    };
+
+    static uint64_t Key(int start, int goal) { return ((uint64_t)(uint32_t)start << 32) | (uint32_t)goal; }
+    void Erase(std::list<Entry>::iterator it);
+    std::vector<uint64_t>& NodeKeys(int node);
+
+    size_t capacity;
+    /// most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+    /// node -> keys of the entries that traverse it
+    std::vector<std::vector<uint64_t>> nodeKeys;
+};
+
+inline std::vector<uint64_t>& PathCache::NodeKeys(int node)
+{
+    if (node >= (int)nodeKeys.size())
+        nodeKeys.resize(node + 1);
+    return nodeKeys[node];
+}
+
+inline bool PathCache::Lookup(int start, int goal, std::vector<int>& path)
+{
+    auto it = lookup.find(Key(start, goal));
+    if (it != lookup.end())
+    {
+        entries.splice(entries.begin(), entries, it->second);
+        std::vector<int> const& nodes = it->second->nodes;
+        path.assign(nodes.begin() + 1, nodes.end());
+        hits++;
+        return true;
+    }
+
+    // look for a cached path that passes start and later goal
+    for (uint64_t key : NodeKeys(start))
+    {
+        auto entryIt = lookup.find(key);
+        if (entryIt == lookup.end())
+            continue;
+        std::vector<int> const& nodes = entryIt->second->nodes;
+        auto from = std::find(nodes.begin(), nodes.end(), start);
+        auto to = std::find(from, nodes.end(), goal);
+        if (to == nodes.end() || from == to)
+            continue;
+        entries.splice(entries.begin(), entries, entryIt->second);
+        path.assign(from + 1, to + 1);
+        subPathHits++;
+        return true;
+    }
+
+    misses++;
+    return false;
+}
+
+inline void PathCache::Insert(int start, int goal, std::vector<int> const& path)
+{
+    uint64_t const key = Key(start, goal);
+    auto it = lookup.find(key);
+    if (it != lookup.end())
+        Erase(it->second);
+
+    Entry entry;
+    entry.key = key;
+    entry.nodes.reserve(path.size() + 1);
+    entry.nodes.push_back(start);
+    entry.nodes.insert(entry.nodes.end(), path.begin(), path.end());
+    for (int node : entry.nodes)
+    {
+        NodeKeys(node).push_back(key);
+    }
+    entries.push_front(std::move(entry));
+    lookup[key] = entries.begin();
+
+    if (entries.size() > capacity)
+        Erase(std::prev(entries.end()));
+}
+
+inline void PathCache::InvalidateNode(int node)
+{
+    // copy, erasing edits the node's key list
+    std::vector<uint64_t> const keys = NodeKeys(node);
+    for (uint64_t key : keys)
+    {
+        auto it = lookup.find(key);
+        if (it != lookup.end())
+            Erase(it->second);
+    }
+}
+
+inline void PathCache::Clear()
+{
+    entries.clear();
+    lookup.clear();
+    nodeKeys.clear();
+}
+
+inline void PathCache::Erase(std::list<Entry>::iterator it)
+{
+    for (int node : it->nodes)
+    {
+        std::vector<uint64_t>& keys = nodeKeys[node];
+        auto keyIt = std::find(keys.begin(), keys.end(), it->key);
+        if (keyIt != keys.end())
+        {
+            *keyIt = keys.back();
+            keys.pop_back();
+        }
+    }
+    lookup.erase(it->key);
+    entries.erase(it);
+}
@@ -0,0 +1,567 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include "glm.hpp"
+
+//------------------------------------------------------------------------------
+/**
+    Flat snapshot of the nav node grid. Node i sits at grid cell
+    (i % size, (i / size) % size, i / (size * size)), the same layout the
+    NavVolume cells use.
+
+    The neighbour graph is baked into compressed rows: node i's edges are
+    edgeTargets/edgeCosts[edgeOffsets[i], edgeOffsets[i] + edgeCounts[i]).
+    Each row is sized for the node's neighbours on an empty grid, blocking
+    only ever removes edges, so a node can be rebaked in place. edgeMasks
+    holds the same edges as one bit per direction, see Direction. openMasks
+    also has the bits of directions that leave the grid set, so it only
+    differs between two nodes if their blocked surroundings do.
+*/
+struct NavGrid
+{
+    int size = 0;
+    std::vector<glm::vec3> positions;
+    std::vector<uint8_t> blocked;
+    /// position of node 0 and distance between neighbouring nodes
+    glm::vec3 origin = glm::vec3(0);
+    float spacing = 1.0f;
+
+    std::vector<int> edgeOffsets;
+    std::vector<uint8_t> edgeCounts;
+    std::vector<int> edgeTargets;
+    std::vector<int> edgeCosts;
+    std::vector<uint32_t> edgeMasks;
+    std::vector<uint32_t> openMasks;
+
+    int NumNodes() const { return (int)positions.size(); }
+    /// node closest to a world position, positions outside the grid are clamped to it
+    int NodeAt(glm::vec3 const& position) const;
+    int const* EdgesBegin(int node) const { return edgeTargets.data() + edgeOffsets[node]; }
+    int const* EdgesEnd(int node) const { return edgeTargets.data() + edgeOffsets[node] + edgeCounts[node]; }
+    int const* EdgeCosts(int node) const { return edgeCosts.data() + edgeOffsets[node]; }
+
+    /// build the neighbour graph from positions and blocked
+    void BakeAdjacency();
+    /// rebake the edges a change of the node's blocked flag affects
+    void RebakeAround(int node);
+
+    /// build a grid of size^3 nodes spaced evenly, without any entities behind it
+    static NavGrid CreateUniform(int size, float spacing);
+    /// bit of a step in edgeMasks, components are -1, 0 or 1
+    static int Direction(int dx, int dy, int dz) { return (dx + 1) + (dy + 1) * 3 + (dz + 1) * 9; }
+
+private:
+    void BakeNode(int node);
+};
+
+enum class PathAlgorithm
+{
+    AStar,
+    /// jump point search, pushes far fewer nodes on open space
+    JumpPoint
+};
+
+enum class PathSearchStatus
+{
+    Searching,
+    Found,
+    NotFound
+};
+
+//------------------------------------------------------------------------------
+/**
+    Scratch state of one A* search. Per node values are only valid while the
+    node's stamp equals the current search, so starting a new search is a
+    counter increment instead of a clear. A search can be run to completion
+    with FindPath, or sliced with Begin and Step.
+
+    With PathAlgorithm::JumpPoint, a node only adds the directions its
+    parent moved in, and each of them is followed in a straight line until
+    the goal, a change in the surrounding edges, or a turn that finds one.
+    Only the nodes where a line stops are pushed; parents link the ends of
+    straight lines, which GetPath fills back in.
+*/
+struct PathSearch
+{
+    std::vector<int> gCost;
+    std::vector<int> fCost;
+    std::vector<int> hCost;
+    std::vector<int> parent;
+    std::vector<uint32_t> stamp;
+    std::vector<uint8_t> closed;
+    /// binary min-heap on fCost, heapIndex[node] is the node's slot in it
+    std::vector<int> heap;
+    std::vector<int> heapIndex;
+    uint32_t searchId = 0;
+    /// nodes expanded and pushed to the open list since Begin
+    int expanded = 0;
+    int pushed = 0;
+
+    /// writes the nodes after start up to and including goal to path. If goal is unreachable,
+    /// the path leads to the expanded node closest to it and false is returned.
+    bool FindPath(NavGrid const& grid, int start, int goal, std::vector<int>& path, PathAlgorithm algorithm = PathAlgorithm::AStar);
+
+    /// start a search, the grid must stay alive until it is done
+    void Begin(NavGrid const& grid, int start, int goal, PathAlgorithm algorithm = PathAlgorithm::AStar);
+    /// expand at most maxExpansions nodes
+    PathSearchStatus Step(int maxExpansions);
+    /// path of the last search, see FindPath
+    void GetPath(std::vector<int>& path) const;
+
+private:
+    void Reset(int numNodes);
+    bool Less(int a, int b) const;
+    void SiftUp(int slot);
+    void SiftDown(int slot);
+    void Push(int node);
+    int Pop();
+    void Relax(int current, int neighbor, int cost);
+    void ExpandJumpPoints(int current);
+    /// follow dir from node, returns where the line stops or -1 if it runs into a wall
+    int Jump(int node, int dir) const;
+    /// true if stepping from node to next reaches edges a straight line could miss
+    bool EdgesChange(int node, int next) const { return grid->openMasks[node] != grid->openMasks[next]; }
+
+    /// a line is cut here even on open space, so a 3D diagonal stays affordable.
+    /// Blocked cells appearing or disappearing around a line also stop it, the
+    /// grid bounds are one flat wall and never do.
+    static constexpr int MaxJump = 16;
+
+    NavGrid const* grid = nullptr;
+    PathAlgorithm algorithm = PathAlgorithm::AStar;
+    /// grid index offset of each direction
+    int dirOffsets[27];
+    /// the directions made of some, but not all, of each direction's components
+    uint8_t subDirs[27][6];
+    uint8_t numSubDirs[27];
+
+    int start = -1;
+    int goal = -1;
+    int best = -1;
+    PathSearchStatus status = PathSearchStatus::NotFound;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Heuristic and step cost between two nodes.
+*/
+inline int NavDistance(glm::vec3 const& a, glm::vec3 const& b)
+{
+    int dx = abs(static_cast<int>(a.x - b.x));
+    int dy = abs(static_cast<int>(a.y - b.y));
+    int dz = abs(static_cast<int>(a.z - b.z));
+
+    int minD = std::min({ dx, dy, dz });
+    int maxD = std::max({ dx, dy, dz });
+
+    int midD = dx + dy + dz - minD - maxD;
+
+    return 17 * minD + 14 * (midD - minD) + 10 * (maxD - midD);
+}
+
+inline NavGrid NavGrid::CreateUniform(int size, float spacing)
+{
+    NavGrid grid;
+    grid.size = size;
+    grid.positions.resize(size * size * size);
+    grid.blocked.assign(size * size * size, 0);
+    grid.spacing = spacing;
+    for (int i = 0; i < (int)grid.positions.size(); i++)
+    {
+        grid.positions[i] = glm::vec3(i % size, (i / size) % size, i / (size * size)) * spacing;
+    }
+    grid.BakeAdjacency();
+    return grid;
+}
+
+inline int NavGrid::NodeAt(glm::vec3 const& position) const
+{
+    glm::ivec3 const cell = glm::clamp(glm::ivec3(glm::round((position - origin) / spacing)), glm::ivec3(0), glm::ivec3(size - 1));
+    return cell.x + cell.y * size + cell.z * size * size;
+}
+
+inline void NavGrid::BakeAdjacency()
+{
+    int const numNodes = NumNodes();
+    edgeOffsets.resize(numNodes + 1);
+    edgeCounts.assign(numNodes, 0);
+    edgeMasks.assign(numNodes, 0);
+    openMasks.assign(numNodes, 0);
+    edgeOffsets[0] = 0;
+    for (int i = 0; i < numNodes; i++)
+    {
+        // neighbours inside the grid bounds along each axis
+        int const x = i % size;
+        int const y = (i / size) % size;
+        int const z = i / (size * size);
+        int const nx = (x > 0) + (x < size - 1) + 1;
+        int const ny = (y > 0) + (y < size - 1) + 1;
+        int const nz = (z > 0) + (z < size - 1) + 1;
+        edgeOffsets[i + 1] = edgeOffsets[i] + nx * ny * nz - 1;
+    }
+    edgeTargets.resize(edgeOffsets[numNodes]);
+    edgeCosts.resize(edgeOffsets[numNodes]);
+    for (int i = 0; i < numNodes; i++)
+    {
+        BakeNode(i);
+    }
+}
+
+inline void NavGrid::RebakeAround(int node)
+{
+    // a diagonal is only cut by a node next to both of its ends
+    int const x = node % size;
+    int const y = (node / size) % size;
+    int const z = node / (size * size);
+    for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, size - 1); nz++)
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, size - 1); ny++)
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, size - 1); nx++)
+                BakeNode(nx + ny * size + nz * size * size);
+}
+
+inline void NavGrid::BakeNode(int node)
+{
+    int const cx = node % size;
+    int const cy = (node / size) % size;
+    int const cz = node / (size * size);
+    int const strides[3] = { 1, size, size * size };
+    int count = 0;
+    uint32_t mask = 0;
+    uint32_t outside = 0;
+    for (int dz = -1; dz <= 1; dz++)
+    {
+        int const nz = cz + dz;
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            int const ny = cy + dy;
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                int const nx = cx + dx;
+                if (dx == 0 && dy == 0 && dz == 0)
+                    continue;
+                if (nx < 0 || nx >= size || ny < 0 || ny >= size || nz < 0 || nz >= size)
+                {
+                    outside |= 1u << Direction(dx, dy, dz);
+                    continue;
+                }
+                int const neighbor = nx + ny * size + nz * size * size;
+                if (blocked[neighbor])
+                    continue;
+
+                // a diagonal may not cut a corner, every cell it passes next to must be open
+                int const d[3] = { dx, dy, dz };
+                int const moveAxes = (dx != 0) | (dy != 0) << 1 | (dz != 0) << 2;
+                bool cornerBlocked = false;
+                for (int axes = 1; axes < moveAxes && !cornerBlocked; axes++)
+                {
+                    if ((axes & moveAxes) != axes)
+                        continue;
+                    int step = 0;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        if (axes & (1 << axis))
+                            step += d[axis] * strides[axis];
+                    }
+                    cornerBlocked = blocked[node + step] != 0;
+                }
+                if (cornerBlocked)
+                    continue;
+
+                edgeTargets[edgeOffsets[node] + count] = neighbor;
+                edgeCosts[edgeOffsets[node] + count] = NavDistance(positions[node], positions[neighbor]);
+                count++;
+                mask |= 1u << Direction(dx, dy, dz);
+            }
+        }
+    }
+    edgeCounts[node] = (uint8_t)count;
+    edgeMasks[node] = mask;
+    openMasks[node] = mask | outside;
+}
+
+inline void PathSearch::Reset(int numNodes)
+{
+    if ((int)stamp.size() != numNodes)
+    {
+        gCost.assign(numNodes, 0);
+        fCost.assign(numNodes, 0);
+        hCost.assign(numNodes, 0);
+        parent.assign(numNodes, -1);
+        stamp.assign(numNodes, 0);
+        closed.assign(numNodes, 0);
+        heapIndex.assign(numNodes, -1);
+        searchId = 0;
+    }
+    // on wrap around, stamps from 2^32 searches ago would look current
+    if (++searchId == 0)
+    {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        searchId = 1;
+    }
+    heap.clear();
+    expanded = 0;
+    pushed = 0;
+}
+
+inline bool PathSearch::Less(int a, int b) const
+{
+    // ties go to the node closer to the goal
+    return fCost[a] < fCost[b] || (fCost[a] == fCost[b] && hCost[a] < hCost[b]);
+}
+
+inline void PathSearch::SiftUp(int slot)
+{
+    int const node = heap[slot];
+    while (slot > 0)
+    {
+        int const parentSlot = (slot - 1) / 2;
+        if (!Less(node, heap[parentSlot]))
+            break;
+        heap[slot] = heap[parentSlot];
+        heapIndex[heap[slot]] = slot;
+        slot = parentSlot;
+    }
+    heap[slot] = node;
+    heapIndex[node] = slot;
+}
+
+inline void PathSearch::SiftDown(int slot)
+{
+    int const node = heap[slot];
+    int const count = (int)heap.size();
+    while (true)
+    {
+        int child = slot * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && Less(heap[child + 1], heap[child]))
+            child++;
+        if (!Less(heap[child], node))
+            break;
+        heap[slot] = heap[child];
+        heapIndex[heap[slot]] = slot;
+        slot = child;
+    }
+    heap[slot] = node;
+    heapIndex[node] = slot;
+}
+
+inline void PathSearch::Push(int node)
+{
+    heap.push_back(node);
+    SiftUp((int)heap.size() - 1);
+    pushed++;
+}
+
+inline int PathSearch::Pop()
+{
+    int const top = heap[0];
+    heapIndex[top] = -1;
+    heap[0] = heap.back();
+    heap.pop_back();
+    if (!heap.empty())
+        SiftDown(0);
+    return top;
+}
+
+inline bool PathSearch::FindPath(NavGrid const& grid, int start, int goal, std::vector<int>& path, PathAlgorithm algorithm)
+{
+    Begin(grid, start, goal, algorithm);
+    PathSearchStatus const result = Step(INT_MAX);
+    GetPath(path);
+    return result == PathSearchStatus::Found;
+}
+
+inline void PathSearch::Begin(NavGrid const& grid, int start, int goal, PathAlgorithm algorithm)
+{
+    Reset(grid.NumNodes());
+    this->grid = &grid;
+    this->algorithm = algorithm;
+    for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+                dirOffsets[NavGrid::Direction(dx, dy, dz)] = dx + dy * grid.size + dz * grid.size * grid.size;
+    for (int dir = 0; dir < 27; dir++)
+    {
+        int const d[3] = { dir % 3 - 1, (dir / 3) % 3 - 1, dir / 9 - 1 };
+        int const moveAxes = (d[0] != 0) | (d[1] != 0) << 1 | (d[2] != 0) << 2;
+        numSubDirs[dir] = 0;
+        for (int axes = 1; axes < moveAxes; axes++)
+        {
+            if ((axes & moveAxes) != axes)
+                continue;
+            subDirs[dir][numSubDirs[dir]++] = (uint8_t)NavGrid::Direction(axes & 1 ? d[0] : 0, axes & 2 ? d[1] : 0, axes & 4 ? d[2] : 0);
+        }
+    }
+
+    this->start = start;
+    this->goal = goal;
+    this->best = start;
+    this->status = PathSearchStatus::Searching;
+
+    stamp[start] = searchId;
+    closed[start] = 0;
+    gCost[start] = 0;
+    hCost[start] = NavDistance(grid.positions[start], grid.positions[goal]);
+    fCost[start] = hCost[start];
+    parent[start] = -1;
+    Push(start);
+}
+
+inline PathSearchStatus PathSearch::Step(int maxExpansions)
+{
+    if (status != PathSearchStatus::Searching)
+        return status;
+
+    for (int i = 0; i < maxExpansions; i++)
+    {
+        if (heap.empty())
+        {
+            status = PathSearchStatus::NotFound;
+            return status;
+        }
+
+        int const current = Pop();
+        closed[current] = 1;
+        expanded++;
+        if (hCost[current] < hCost[best])
+            best = current;
+
+        if (current == goal)
+        {
+            status = PathSearchStatus::Found;
+            return status;
+        }
+
+        if (algorithm == PathAlgorithm::JumpPoint)
+        {
+            ExpandJumpPoints(current);
+            continue;
+        }
+        int const* costs = grid->EdgeCosts(current);
+        for (int const* edge = grid->EdgesBegin(current); edge != grid->EdgesEnd(current); edge++, costs++)
+        {
+            Relax(current, *edge, *costs);
+        }
+    }
+    return status;
+}
+
+inline void PathSearch::Relax(int current, int neighbor, int cost)
+{
+    bool const seen = stamp[neighbor] == searchId;
+    if (seen && closed[neighbor])
+        return;
+
+    int const newCost = gCost[current] + cost;
+    if (!seen)
+    {
+        stamp[neighbor] = searchId;
+        closed[neighbor] = 0;
+        gCost[neighbor] = newCost;
+        hCost[neighbor] = NavDistance(grid->positions[neighbor], grid->positions[goal]);
+        fCost[neighbor] = newCost + hCost[neighbor];
+        parent[neighbor] = current;
+        Push(neighbor);
+    }
+    else if (newCost < gCost[neighbor])
+    {
+        // decrease key, the node can only move up
+        gCost[neighbor] = newCost;
+        fCost[neighbor] = newCost + hCost[neighbor];
+        parent[neighbor] = current;
+        SiftUp(heapIndex[neighbor]);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    A node whose edges match the node it was entered from has nothing a
+    line through it could miss, so only the parent's direction and its
+    components are followed. Anywhere else, and at the start, every
+    direction is.
+*/
+inline void PathSearch::ExpandJumpPoints(int current)
+{
+    int const size = grid->size;
+    uint32_t const mask = grid->edgeMasks[current];
+    uint32_t directions = mask;
+    int const from = parent[current];
+    if (from != -1)
+    {
+        // step the parent line arrived with
+        int const dx = glm::sign(current % size - from % size);
+        int const dy = glm::sign((current / size) % size - (from / size) % size);
+        int const dz = glm::sign(current / (size * size) - from / (size * size));
+        int const previous = current - dx - dy * size - dz * size * size;
+        if (!EdgesChange(previous, current))
+        {
+            int const dir = NavGrid::Direction(dx, dy, dz);
+            directions = 1u << dir;
+            for (int i = 0; i < numSubDirs[dir]; i++)
+                directions |= 1u << subDirs[dir][i];
+            directions &= mask;
+        }
+    }
+
+    for (int dir = 0; dir < 27; dir++)
+    {
+        if (!(directions & (1u << dir)))
+            continue;
+        int const target = Jump(current, dir);
+        if (target == -1)
+            continue;
+        int cost = 0;
+        for (int node = current; node != target; node += dirOffsets[dir])
+            cost += NavDistance(grid->positions[node], grid->positions[node + dirOffsets[dir]]);
+        Relax(current, target, cost);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int PathSearch::Jump(int node, int dir) const
+{
+    int const offset = dirOffsets[dir];
+    for (int step = 0; step < MaxJump; step++)
+    {
+        if (!(grid->edgeMasks[node] & (1u << dir)))
+            return -1;
+        int const next = node + offset;
+        if (next == goal || EdgesChange(node, next))
+            return next;
+
+        // the line turns here if one of its components leads somewhere
+        for (int i = 0; i < numSubDirs[dir]; i++)
+        {
+            if (Jump(next, subDirs[dir][i]) != -1)
+                return next;
+        }
+        node = next;
+    }
+    return node;
+}
+
+inline void PathSearch::GetPath(std::vector<int>& path) const
+{
+    path.clear();
+    if (start < 0)
+        return;
+    int const size = grid->size;
+    int const last = status == PathSearchStatus::Found ? goal : best;
+    for (int node = last; node != start && node != -1; node = parent[node])
+    {
+        // parents are one step away for A*, and at the end of a straight line for jump points
+        int const from = parent[node];
+        int const dx = glm::sign(node % size - from % size);
+        int const dy = glm::sign((node / size) % size - (from / size) % size);
+        int const dz = glm::sign(node / (size * size) - from / (size * size));
+        for (int n = node; n != from; n -= dx + dy * size + dz * size * size)
+        {
+            path.push_back(n);
+        }
+    }
+    std::reverse(path.begin(), path.end());
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "pathSearch.h"
+#include "navHierarchy.h"
+
+struct PathResult
+{
+    std::vector<int> nodes; // grid indices after start, up to and including goal
+    int start = -1;
+    int goal = -1;
+    bool found = false;
+    bool cached = false; // served from the path cache
+};
+
+//------------------------------------------------------------------------------
+/**
+    Solves path requests on worker threads. Each worker owns its search
+    scratch, so any number of searches can run side by side. The workers
+    share an expansion budget that is refilled once per tick, which spreads
+    a burst of requests over several frames instead of stalling one.
+
+    Hierarchical searches can't be sliced. They wait for budget like any
+    other search, run to the end, and what they used beyond their slice is
+    taken from the next tick's budget.
+*/
+class PathService
+{
+public:
+    static PathService* Instance()
+    {
+        static PathService instance;
+        return &instance;
+    }
+
+    PathService(const PathService&) = delete;
+    void operator=(const PathService&) = delete;
+
+    /// queue a search. The grid is kept alive until the request is solved.
+    std::future<PathResult> Request(std::shared_ptr<const NavGrid> grid, int start, int goal, PathAlgorithm algorithm = PathAlgorithm::AStar);
+    /// queue a search on the hierarchy. It is kept alive until the request is solved, refresh it before.
+    std::future<PathResult> Request(std::shared_ptr<const NavHierarchy> hierarchy, int start, int goal);
+    /// refill the expansion budget, call once per frame
+    void Tick();
+
+    /// node expansions all workers may do per tick
+    int expansionsPerTick = 20000;
+
+    int GetNumPending();
+    /// expansions used during the last tick
+    int GetLastTickExpansions() const { return lastTickExpansions; }
+
+private:
+    PathService();
+    ~PathService();
+
+    struct Job
+    {
+        std::shared_ptr<const NavGrid> grid;
+        /// set for hierarchical searches, grid is unused then
+        std::shared_ptr<const NavHierarchy> hierarchy;
+        int start;
+        int goal;
+        PathAlgorithm algorithm;
+        std::promise<PathResult> promise;
+    };
+
+    void WorkerLoop();
+    /// queue the job and wake a worker
+    std::future<PathResult> Push(Job job);
+    /// blocks until budget is available, returns 0 on shutdown
+    int AcquireBudget(int wanted);
+    void ReturnBudget(int unused);
+    /// settle a slice that may have been overdrawn, the debt carries over to the next tick
+    void ChargeBudget(int granted, int used);
+
+    /// expansions a worker takes from the budget at a time
+    static constexpr int SliceSize = 256;
+
+    std::mutex lock;
+    std::condition_variable jobsReady;
+    std::condition_variable budgetReady;
+    std::deque<Job> jobs;
+    std::vector<std::thread> workers;
+    int budget = 0;
+    int lastTickExpansions = 0;
+    bool quit = false;
+};
+
+inline PathService::PathService()
+{
+    unsigned const numWorkers = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+    for (unsigned i = 0; i < numWorkers; i++)
+    {
+        workers.emplace_back(&PathService::WorkerLoop, this);
+    }
+}
+
+inline PathService::~PathService()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    jobsReady.notify_all();
+    budgetReady.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+inline std::future<PathResult> PathService::Request(std::shared_ptr<const NavGrid> grid, int start, int goal, PathAlgorithm algorithm)
+{
+    Job job;
+    job.grid = std::move(grid);
+    job.start = start;
+    job.goal = goal;
+    job.algorithm = algorithm;
+    return Push(std::move(job));
+}
+
+inline std::future<PathResult> PathService::Request(std::shared_ptr<const NavHierarchy> hierarchy, int start, int goal)
+{
+    Job job;
+    job.hierarchy = std::move(hierarchy);
+    job.start = start;
+    job.goal = goal;
+    job.algorithm = PathAlgorithm::AStar;
+    return Push(std::move(job));
+}
+
+inline std::future<PathResult> PathService::Push(Job job)
+{
+    std::future<PathResult> result = job.promise.get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+    }
+    jobsReady.notify_one();
+    return result;
+}
+
+inline void PathService::Tick()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // whatever is left over from the last tick was not needed, an overdraft is paid back
+        lastTickExpansions = expansionsPerTick - budget;
+        budget = expansionsPerTick + std::min(budget, 0);
+    }
+    budgetReady.notify_all();
+}
+
+inline int PathService::GetNumPending()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return (int)jobs.size();
+}
+
+inline int PathService::AcquireBudget(int wanted)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    budgetReady.wait(guard, [this] { return quit || budget > 0; });
+    if (quit)
+        return 0;
+    int const granted = std::min(wanted, budget);
+    budget -= granted;
+    return granted;
+}
+
+inline void PathService::ReturnBudget(int unused)
+{
+    if (unused <= 0)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        budget += unused;
+    }
+    budgetReady.notify_all();
+}
+
+inline void PathService::ChargeBudget(int granted, int used)
+{
+    if (used <= granted)
+    {
+        ReturnBudget(granted - used);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    budget -= used - granted;
+}
+
+inline void PathService::WorkerLoop()
+{
+    PathSearch search;
+    NavHierarchy::Scratch hierarchyScratch;
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            jobsReady.wait(guard, [this] { return quit || !jobs.empty(); });
+            if (quit)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        if (job.hierarchy)
+        {
+            int const granted = AcquireBudget(SliceSize);
+            if (granted == 0)
+                return;
+            PathResult result;
+            result.start = job.start;
+            result.goal = job.goal;
+            result.found = job.hierarchy->FindPath(job.start, job.goal, result.nodes, hierarchyScratch);
+            ChargeBudget(granted, hierarchyScratch.expanded + hierarchyScratch.settled);
+            job.promise.set_value(std::move(result));
+            continue;
+        }
+
+        search.Begin(*job.grid, job.start, job.goal, job.algorithm);
+        PathSearchStatus status = PathSearchStatus::Searching;
+        while (status == PathSearchStatus::Searching)
+        {
+            int const granted = AcquireBudget(SliceSize);
+            if (granted == 0)
+                return;
+            int const expandedBefore = search.expanded;
+            status = search.Step(granted);
+            ReturnBudget(granted - (search.expanded - expandedBefore));
+        }
+
+        PathResult result;
+        search.GetPath(result.nodes);
+        result.start = job.start;
+        result.goal = job.goal;
+        result.found = status == PathSearchStatus::Found;
+        job.promise.set_value(std::move(result));
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "spatialHash.h"
+#include "parallelFor.h"
+
+//------------------------------------------------------------------------------
+/**
+    What an AI ship knows about its surroundings this tick. Written by the
+    perception stage before any AI runs, the state functions only read it.
+*/
+struct PerceptionContacts
+{
+    /// live ships within sensing radius, closest first
+    std::vector<SpatialHit> ships;
+    /// those of them that have this ship as their target
+    std::vector<SpatialHit> threats;
+    /// asteroids within obstacle radius, closest first
+    std::vector<SpatialHit> obstacles;
+    /// closest live ship within target radius, nullptr if there is none
+    Entity* nearestShip = nullptr;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Runs the sensing of every AI ship that is about to tick in one batch.
+    Sensing a ship only reads the world and writes that ship's contacts, so
+    the batch is split across threads once there are enough ships.
+*/
+class Perception
+{
+public:
+    static Perception* Instance()
+    {
+        static Perception instance;
+        return &instance;
+    }
+
+    Perception(const Perception&) = delete;
+    void operator=(const Perception&) = delete;
+
+    /// sense(i) for every i below count
+    template<class SENSE> void Run(int count, SENSE&& sense);
+
+    /// how far ships see each other, and asteroids that count as obstacles
+    float sensingRadius = 30.0f;
+    float obstacleRadius = 15.0f;
+    /// how far a ship looks for a new target when nothing is within sensing radius
+    float targetRadius = 100.0f;
+    /// closest contacts kept per list
+    int maxContacts = 8;
+
+    /// stats of the last batch
+    int lastNumShips = 0;
+    int lastNumThreads = 0;
+    double lastMilliseconds = 0;
+
+private:
+    Perception() {}
+
+    static constexpr int ParallelMinShips = 64;
+};
+
+template<class SENSE>
+inline void Perception::Run(int count, SENSE&& sense)
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    auto senseRange = [&sense](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            sense(i);
+        }
+    };
+
+    int const numThreads = ParallelFor::Run(count, ParallelMinShips, senseRange);
+
+    lastNumShips = count;
+    lastNumThreads = numThreads;
+    lastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+}
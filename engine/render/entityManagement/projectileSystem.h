@@ -0,0 +1,257 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file projectileSystem.h
+
+    Fixed capacity projectile pool. State is kept in structure-of-arrays form
+    and packed in [0, numLive), so a tick costs one pass over the live
+    projectiles no matter how many ships are firing.
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <vector>
+#include "glm.hpp"
+#include "core/idpool.h"
+#include "../physics.h"
+
+struct ProjectileId
+{
+    uint32_t index : 22;
+    uint32_t generation : 10;
+
+    constexpr static ProjectileId Create(uint32_t id)
+    {
+        ProjectileId ret { id & 0x003FFFFF, (id & 0xFFC00000) >> 22 };
+        return ret;
+    }
+    static ProjectileId Create(uint32_t index, uint32_t generation)
+    {
+        ProjectileId ret;
+        ret.index = index;
+        ret.generation = generation;
+        return ret;
+    }
+    explicit constexpr operator uint32_t() const
+    {
+        return ((generation << 22) & 0xFFC00000ul) + (index & 0x003FFFFFul);
+    }
+    static constexpr ProjectileId Invalid()
+    {
+        return Create(0xFFFFFFFF);
+    }
+    const bool operator==(const ProjectileId& rhs) const { return uint32_t(*this) == uint32_t(rhs); }
+    const bool operator!=(const ProjectileId& rhs) const { return uint32_t(*this) != uint32_t(rhs); }
+};
+
+struct ProjectileHit
+{
+    Physics::ColliderId owner;  // collider of the ship that fired
+    Physics::ColliderId target; // collider that was hit
+    glm::vec3 point;
+};
+
+class ProjectileSystem
+{
+public:
+    static constexpr uint32_t Capacity = 1024;
+
+    static ProjectileSystem* Instance()
+    {
+        static ProjectileSystem instance;
+        return &instance;
+    }
+
+    ProjectileSystem(const ProjectileSystem&) = delete;
+    void operator=(const ProjectileSystem&) = delete;
+
+    /// spawn a projectile that ignores its owner's collider and only hits colliders in mask. Returns Invalid if the pool is full.
+    ProjectileId Spawn(glm::vec3 const& position, glm::vec3 const& velocity, float lifetime, Physics::ColliderId owner, uint16_t mask);
+    /// sweep, integrate and expire all live projectiles. Hits of this tick are available from GetHits.
+    void Update(float dt);
+    /// remove all projectiles
+    void Clear();
+
+    bool IsAlive(ProjectileId id) const;
+    glm::vec3 GetPosition(ProjectileId id) const;
+    glm::vec3 GetVelocity(ProjectileId id) const;
+    uint32_t GetNumLive() const { return numLive; }
+    std::vector<ProjectileHit> const& GetHits() const { return hits; }
+
+private:
+    ProjectileSystem();
+
+    void Remove(uint32_t slot);
+
+    alignas(16) float px[Capacity];
+    alignas(16) float py[Capacity];
+    alignas(16) float pz[Capacity];
+    alignas(16) float vx[Capacity];
+    alignas(16) float vy[Capacity];
+    alignas(16) float vz[Capacity];
+    alignas(16) float lifetimes[Capacity];
+    Physics::ColliderId owners[Capacity];
+    uint16_t masks[Capacity];
+    /// dense slot -> id index
+    uint32_t ids[Capacity];
+    /// id index -> dense slot
+    std::vector<uint32_t> slots;
+    Util::IdPool<ProjectileId> idPool;
+    uint32_t numLive = 0;
+
+    std::vector<ProjectileHit> hits;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline ProjectileSystem::ProjectileSystem()
+{
+    this->hits.reserve(64);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline ProjectileId
+ProjectileSystem::Spawn(glm::vec3 const& position, glm::vec3 const& velocity, float lifetime, Physics::ColliderId owner, uint16_t mask)
+{
+    if (this->numLive == Capacity)
+        return ProjectileId::Invalid();
+
+    ProjectileId id;
+    if (this->idPool.Allocate(id))
+        this->slots.push_back(0);
+
+    uint32_t const slot = this->numLive++;
+    this->slots[id.index] = slot;
+    this->ids[slot] = id.index;
+    this->px[slot] = position.x;
+    this->py[slot] = position.y;
+    this->pz[slot] = position.z;
+    this->vx[slot] = velocity.x;
+    this->vy[slot] = velocity.y;
+    this->vz[slot] = velocity.z;
+    this->lifetimes[slot] = lifetime;
+    this->owners[slot] = owner;
+    this->masks[slot] = mask;
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Each projectile is swept over the segment it covers this tick before it is
+    moved, so a hit is found even if the projectile would have passed through
+    its target between frames. Projectiles that hit something are expired
+    together with the ones that ran out of lifetime.
+*/
+inline void
+ProjectileSystem::Update(float dt)
+{
+    this->hits.clear();
+    uint32_t const n = this->numLive;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        glm::vec3 const start = glm::vec3(this->px[i], this->py[i], this->pz[i]);
+        glm::vec3 const end = start + glm::vec3(this->vx[i], this->vy[i], this->vz[i]) * dt;
+        Physics::RaycastPayload payload = Physics::SegmentCast(start, end, this->masks[i], this->owners[i]);
+        if (payload.hit)
+        {
+            this->hits.push_back({ this->owners[i], payload.collider, payload.hitPoint });
+            this->lifetimes[i] = 0.0f;
+        }
+    }
+
+    // straight run over the float arrays, vectorizes
+    float* __restrict pxs = this->px;
+    float* __restrict pys = this->py;
+    float* __restrict pzs = this->pz;
+    float const* __restrict vxs = this->vx;
+    float const* __restrict vys = this->vy;
+    float const* __restrict vzs = this->vz;
+    float* __restrict lts = this->lifetimes;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        pxs[i] += vxs[i] * dt;
+        pys[i] += vys[i] * dt;
+        pzs[i] += vzs[i] * dt;
+        lts[i] -= dt;
+    }
+
+    // walk backwards so the projectile swapped into a freed slot has already been visited
+    for (uint32_t i = n; i-- > 0;)
+    {
+        if (this->lifetimes[i] <= 0.0f)
+            this->Remove(i);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+ProjectileSystem::Clear()
+{
+    while (this->numLive > 0)
+        this->Remove(this->numLive - 1);
+    this->hits.clear();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline bool
+ProjectileSystem::IsAlive(ProjectileId id) const
+{
+    return this->idPool.IsValid(id);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline glm::vec3
+ProjectileSystem::GetPosition(ProjectileId id) const
+{
+    assert(this->IsAlive(id));
+    uint32_t const slot = this->slots[id.index];
+    return glm::vec3(this->px[slot], this->py[slot], this->pz[slot]);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline glm::vec3
+ProjectileSystem::GetVelocity(ProjectileId id) const
+{
+    assert(this->IsAlive(id));
+    uint32_t const slot = this->slots[id.index];
+    return glm::vec3(this->vx[slot], this->vy[slot], this->vz[slot]);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Swaps the last live projectile into the slot and recycles the id.
+*/
+inline void
+ProjectileSystem::Remove(uint32_t slot)
+{
+    uint32_t const index = this->ids[slot];
+    uint32_t const last = --this->numLive;
+    if (slot != last)
+    {
+        this->px[slot] = this->px[last];
+        this->py[slot] = this->py[last];
+        this->pz[slot] = this->pz[last];
+        this->vx[slot] = this->vx[last];
+        this->vy[slot] = this->vy[last];
+        this->vz[slot] = this->vz[last];
+        this->lifetimes[slot] = this->lifetimes[last];
+        this->owners[slot] = this->owners[last];
+        this->masks[slot] = this->masks[last];
+        this->ids[slot] = this->ids[last];
+        this->slots[this->ids[slot]] = slot;
+    }
+    this->idPool.Deallocate(ProjectileId::Create(index, this->idPool.generations[index]));
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "glm.hpp"
+#include "../physics.h"
+
+struct SensorRay
+{
+    glm::vec3 start = glm::vec3(0);
+    glm::vec3 end = glm::vec3(0);
+};
+
+//------------------------------------------------------------------------------
+/**
+    One ship's sensor results, kept between frames so that a ray that isn't
+    cast this frame answers with its last result.
+*/
+struct SensorCache
+{
+    struct Entry
+    {
+        Physics::RaycastPayload result;
+        SensorRay ray;
+        uint32_t castFrame = 0;
+        bool valid = false;
+    };
+    std::vector<Entry> entries;
+    /// next ray in round-robin order
+    int cursor = 0;
+
+    Physics::RaycastPayload const& Result(int ray) const { return entries[ray].result; }
+};
+
+//------------------------------------------------------------------------------
+/**
+    Spreads a ship's sensor rays over frames. Each frame a ship casts at most
+    raysPerShip rays, in this order:
+    - urgent rays: never cast, or their last hit was closer than urgentDistance
+    - the rest in round-robin order, starting where the last frame stopped
+    Rays that are coherent with their cached result are skipped outright. A
+    ray is coherent if it barely moved since it was cast and there are no
+    movers nearby. Every ray that isn't cast answers from the cache.
+
+    With validate set every ray is cast anyway, to count how often the
+    cached answer was wrong.
+*/
+class SensorScheduler
+{
+public:
+    static SensorScheduler* Instance()
+    {
+        static SensorScheduler instance;
+        return &instance;
+    }
+
+    SensorScheduler(const SensorScheduler&) = delete;
+    void operator=(const SensorScheduler&) = delete;
+
+    /// advance the frame and reset the stats
+    void BeginFrame();
+    /// refresh the cache for this frame's rays. cast(ray) returns a fresh result
+    template<class CAST> void Update(SensorCache& cache, SensorRay const* rays, int numRays, bool moversNearby, CAST&& cast);
+
+    /// most rays one ship casts per frame
+    int raysPerShip = 3;
+    /// rays whose last hit was closer than this are cast first
+    float urgentDistance = 4.0f;
+    /// how far a ray's end points may move before its result is no longer trusted without movers around
+    float coherenceTolerance = 0.25f;
+    /// obstacles whose surface moves slower than this don't count as movers
+    float moverSpeed = 0.5f;
+    /// cast everything as well and count the cached answers that were wrong
+    bool validate = false;
+
+    /// stats of the current frame, complete once all ships updated
+    int raysRequested = 0;
+    int raysCast = 0;
+    int raysPromoted = 0;
+    int raysSkipped = 0;
+    int raysValidated = 0;
+    int raysWrong = 0;
+    /// summed and largest age in frames of the results handed out
+    uint64_t staleFrames = 0;
+    uint32_t maxStaleFrames = 0;
+
+private:
+    SensorScheduler() {}
+
+    bool IsCoherent(SensorCache::Entry const& entry, SensorRay const& ray) const;
+
+    uint32_t frame = 1;
+    std::vector<int> urgent;
+};
+
+inline void SensorScheduler::BeginFrame()
+{
+    frame++;
+    raysRequested = 0;
+    raysCast = 0;
+    raysPromoted = 0;
+    raysSkipped = 0;
+    raysValidated = 0;
+    raysWrong = 0;
+    staleFrames = 0;
+    maxStaleFrames = 0;
+}
+
+inline bool SensorScheduler::IsCoherent(SensorCache::Entry const& entry, SensorRay const& ray) const
+{
+    float const toleranceSq = coherenceTolerance * coherenceTolerance;
+    glm::vec3 const startMoved = ray.start - entry.ray.start;
+    glm::vec3 const endMoved = ray.end - entry.ray.end;
+    return glm::dot(startMoved, startMoved) <= toleranceSq && glm::dot(endMoved, endMoved) <= toleranceSq;
+}
+
+template<class CAST>
+inline void SensorScheduler::Update(SensorCache& cache, SensorRay const* rays, int numRays, bool moversNearby, CAST&& cast)
+{
+    if ((int)cache.entries.size() != numRays)
+    {
+        cache.entries.assign(numRays, SensorCache::Entry());
+        cache.cursor = 0;
+    }
+    raysRequested += numRays;
+
+    int budget = raysPerShip;
+    auto castRay = [&](int i)
+    {
+        SensorCache::Entry& entry = cache.entries[i];
+        entry.result = cast(rays[i]);
+        entry.ray = rays[i];
+        entry.castFrame = frame;
+        entry.valid = true;
+        raysCast++;
+        budget--;
+    };
+
+    // urgent rays go first
+    urgent.clear();
+    for (int i = 0; i < numRays; i++)
+    {
+        SensorCache::Entry const& entry = cache.entries[i];
+        if (!entry.valid || (entry.result.hit && entry.result.hitDistance < urgentDistance))
+            urgent.push_back(i);
+    }
+    for (int i : urgent)
+    {
+        if (budget <= 0)
+            break;
+        castRay(i);
+        raysPromoted++;
+    }
+
+    // then the others that can't be trusted, round-robin
+    for (int step = 0; step < numRays && budget > 0; step++)
+    {
+        int const i = (cache.cursor + step) % numRays;
+        SensorCache::Entry const& entry = cache.entries[i];
+        if (entry.castFrame == frame)
+            continue;
+        if (!moversNearby && IsCoherent(entry, rays[i]))
+        {
+            raysSkipped++;
+            continue;
+        }
+        castRay(i);
+        cache.cursor = (i + 1) % numRays;
+    }
+
+    for (int i = 0; i < numRays; i++)
+    {
+        SensorCache::Entry const& entry = cache.entries[i];
+        uint32_t const age = entry.valid ? frame - entry.castFrame : 0;
+        staleFrames += age;
+        maxStaleFrames = std::max(maxStaleFrames, age);
+        if (validate && age > 0)
+        {
+            raysValidated++;
+            if (cast(rays[i]).hit != entry.result.hit)
+                raysWrong++;
+        }
+    }
+}
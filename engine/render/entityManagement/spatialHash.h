@@ -0,0 +1,229 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include "glm.hpp"
+#include "entityType.h"
+
+class Entity;
+
+struct SpatialHit
+{
+    Entity* entity = nullptr;
+    float distance = 0.0f;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Uniform hash grid over entity positions, rebuilt once per tick. Entries
+    are sorted by cell so each cell is one contiguous range, and a query only
+    visits the cells its radius touches instead of every entity.
+
+    Queries are const and use no shared scratch, so any number of threads
+    may run them at once between two builds.
+*/
+class SpatialHash
+{
+public:
+    static uint32_t TypeMask(EntityType type) { return 1u << (uint32_t)type; }
+    /// packs cell coordinates into a hash key, 21 bits per axis
+    static uint64_t CellKey(glm::ivec3 const& cell);
+
+    void Clear();
+    void Insert(Entity* entity, EntityType type, glm::vec3 const& position);
+    /// sort what was inserted into cells, call before querying
+    void Build();
+    /// drop an entity that was destroyed since the last build
+    void Remove(Entity* entity);
+
+    /// every entity of the types within radius, in no particular order
+    void QueryRadius(glm::vec3 const& center, float radius, uint32_t typeMask, std::vector<SpatialHit>& hits, Entity const* ignore = nullptr) const;
+    /// the k closest entities of the types within maxRadius that accept takes, closest first
+    template<class ACCEPT> void QueryNearest(glm::vec3 const& center, int k, float maxRadius, uint32_t typeMask, ACCEPT&& accept, std::vector<SpatialHit>& hits) const;
+    /// closest entity of the types within maxRadius that accept takes, nullptr if there is none
+    template<class ACCEPT> Entity* FindNearestIf(glm::vec3 const& center, float maxRadius, uint32_t typeMask, ACCEPT&& accept) const;
+    Entity* FindNearest(glm::vec3 const& center, float maxRadius, uint32_t typeMask, Entity const* ignore = nullptr) const;
+
+    int GetNumEntries() const { return (int)entries.size(); }
+    int GetNumCells() const { return (int)cellRanges.size(); }
+
+    /// edge length of a cell, about the radius of the common queries
+    float cellSize = 16.0f;
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        Entity* entity;
+        uint32_t typeMask;
+        glm::vec3 position;
+    };
+
+    glm::ivec3 CellOf(glm::vec3 const& position) const { return glm::ivec3(glm::floor(position / cellSize)); }
+    /// calls visit(entry) for every entry in the cell
+    template<class VISIT> void VisitCell(glm::ivec3 const& cell, VISIT&& visit) const;
+
+    std::vector<Entry> entries;
+    /// first entry, end entry
+    std::unordered_map<uint64_t, std::pair<int, int>> cellRanges;
+    /// cells that hold any entry, queries never look further
+    glm::ivec3 cellsMin = glm::ivec3(0);
+    glm::ivec3 cellsMax = glm::ivec3(-1);
+};
+
+inline uint64_t SpatialHash::CellKey(glm::ivec3 const& cell)
+{
+    // 21 bits per axis
+    uint64_t const x = (uint64_t)(cell.x + (1 << 20)) & 0x1FFFFF;
+    uint64_t const y = (uint64_t)(cell.y + (1 << 20)) & 0x1FFFFF;
+    uint64_t const z = (uint64_t)(cell.z + (1 << 20)) & 0x1FFFFF;
+    return x | (y << 21) | (z << 42);
+}
+
+inline void SpatialHash::Clear()
+{
+    entries.clear();
+    cellRanges.clear();
+    cellsMin = glm::ivec3(0);
+    cellsMax = glm::ivec3(-1);
+}
+
+inline void SpatialHash::Insert(Entity* entity, EntityType type, glm::vec3 const& position)
+{
+    entries.push_back({ CellKey(CellOf(position)), entity, TypeMask(type), position });
+}
+
+inline void SpatialHash::Build()
+{
+    std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) { return a.key < b.key; });
+
+    cellRanges.clear();
+    cellRanges.reserve(entries.size());
+    cellsMin = glm::ivec3(INT_MAX);
+    cellsMax = glm::ivec3(INT_MIN);
+    for (int i = 0; i < (int)entries.size(); i++)
+    {
+        if (i == 0 || entries[i].key != entries[i - 1].key)
+            cellRanges[entries[i].key] = { i, i };
+        cellRanges[entries[i].key].second = i + 1;
+
+        glm::ivec3 const cell = CellOf(entries[i].position);
+        cellsMin = glm::min(cellsMin, cell);
+        cellsMax = glm::max(cellsMax, cell);
+    }
+    if (entries.empty())
+    {
+        cellsMin = glm::ivec3(0);
+        cellsMax = glm::ivec3(-1);
+    }
+}
+
+inline void SpatialHash::Remove(Entity* entity)
+{
+    for (Entry& entry : entries)
+    {
+        if (entry.entity == entity)
+        {
+            entry.entity = nullptr;
+            entry.typeMask = 0;
+        }
+    }
+}
+
+template<class VISIT>
+inline void SpatialHash::VisitCell(glm::ivec3 const& cell, VISIT&& visit) const
+{
+    auto it = cellRanges.find(CellKey(cell));
+    if (it == cellRanges.end())
+        return;
+    for (int i = it->second.first; i < it->second.second; i++)
+    {
+        visit(entries[i]);
+    }
+}
+
+inline void SpatialHash::QueryRadius(glm::vec3 const& center, float radius, uint32_t typeMask, std::vector<SpatialHit>& hits, Entity const* ignore) const
+{
+    hits.clear();
+    glm::ivec3 const from = glm::max(CellOf(center - glm::vec3(radius)), cellsMin);
+    glm::ivec3 const to = glm::min(CellOf(center + glm::vec3(radius)), cellsMax);
+    float const radiusSq = radius * radius;
+    for (int z = from.z; z <= to.z; z++)
+        for (int y = from.y; y <= to.y; y++)
+            for (int x = from.x; x <= to.x; x++)
+            {
+                VisitCell(glm::ivec3(x, y, z), [&](Entry const& entry)
+                {
+                    if (!(entry.typeMask & typeMask) || entry.entity == ignore)
+                        return;
+                    glm::vec3 const offset = entry.position - center;
+                    float const distSq = glm::dot(offset, offset);
+                    if (distSq <= radiusSq)
+                        hits.push_back({ entry.entity, std::sqrt(distSq) });
+                });
+            }
+}
+
+template<class ACCEPT>
+inline void SpatialHash::QueryNearest(glm::vec3 const& center, int k, float maxRadius, uint32_t typeMask, ACCEPT&& accept, std::vector<SpatialHit>& hits) const
+{
+    hits.clear();
+    if (k <= 0 || entries.empty())
+        return;
+
+    // walk shells of cells outwards, everything past shell r is at least r cells away
+    glm::ivec3 const centerCell = CellOf(center);
+    glm::ivec3 const reach = glm::max(glm::abs(centerCell - cellsMin), glm::abs(cellsMax - centerCell));
+    int const lastRing = std::max(reach.x, std::max(reach.y, reach.z));
+    float const maxRadiusSq = maxRadius * maxRadius;
+    auto byDistance = [](SpatialHit const& a, SpatialHit const& b) { return a.distance < b.distance; };
+    auto visit = [&](Entry const& entry)
+    {
+        if (!(entry.typeMask & typeMask))
+            return;
+        glm::vec3 const offset = entry.position - center;
+        float const distSq = glm::dot(offset, offset);
+        if (distSq > maxRadiusSq || ((int)hits.size() == k && distSq >= hits.back().distance * hits.back().distance))
+            return;
+        if (!accept(entry.entity))
+            return;
+        SpatialHit const hit = { entry.entity, std::sqrt(distSq) };
+        if ((int)hits.size() == k)
+            hits.pop_back();
+        hits.insert(std::upper_bound(hits.begin(), hits.end(), hit, byDistance), hit);
+    };
+
+    for (int ring = 0; ring <= lastRing; ring++)
+    {
+        float const ringDistance = (ring - 1) * cellSize;
+        if (ringDistance > maxRadius || ((int)hits.size() == k && hits.back().distance <= ringDistance))
+            break;
+        for (int dz = -ring; dz <= ring; dz++)
+            for (int dy = -ring; dy <= ring; dy++)
+            {
+                // inside the shell only the two end cells of the row belong to it
+                bool const onFace = dz == -ring || dz == ring || dy == -ring || dy == ring;
+                int const step = onFace ? 1 : std::max(2 * ring, 1);
+                for (int dx = -ring; dx <= ring; dx += step)
+                {
+                    VisitCell(centerCell + glm::ivec3(dx, dy, dz), visit);
+                }
+            }
+    }
+}
+
+template<class ACCEPT>
+inline Entity* SpatialHash::FindNearestIf(glm::vec3 const& center, float maxRadius, uint32_t typeMask, ACCEPT&& accept) const
+{
+    std::vector<SpatialHit> hits;
+    QueryNearest(center, 1, maxRadius, typeMask, accept, hits);
+    return hits.empty() ? nullptr : hits[0].entity;
+}
+
+inline Entity* SpatialHash::FindNearest(glm::vec3 const& center, float maxRadius, uint32_t typeMask, Entity const* ignore) const
+{
+    return FindNearestIf(center, maxRadius, typeMask, [ignore](Entity* entity) { return entity != ignore; });
+}
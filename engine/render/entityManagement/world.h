@@ -6,6 +6,11 @@
 #include "render/renderdevice.h"
 #include <render/model.h>
 #include "pureEntityData.h"
+#include "projectileSystem.h"
+#include "localAvoidance.h"
+#include "aiScheduler.h"
+#include "spatialHash.h"
+#include "distanceField.h"
 #include <gtx/quaternion.hpp>
 #include <queue>
 #include <map>
@@ -27,9 +32,9 @@ public:
     ChunkAllocator<Components::AIinputController, 64> AiControllerChunk;
     ChunkAllocator<Components::ParticleEmitterComponent, 64> particleEmitterChunk;
     ChunkAllocator<Render::ParticleEmitter, 64> ChunkOfPartcles;
-    ChunkAllocator<Components::AINavNodeComponent, 64> navNodeChunk;
     ChunkAllocator<Components::State, 64> stateChunk;
     ChunkAllocator<Components::AI, 64> AIChunk;
+    ChunkAllocator<Components::WeaponComponent, 64> weaponChunk;
 
 
 
@@ -42,6 +47,53 @@ public:
 
     int randomIndex;
     float respawnTimer;
+
+    // nav cells re-tested and the ones that flipped in the last occupancy update
+    int navCellsRetested = 0;
+    int navCellsChanged = 0;
+
+    // ships and asteroids by position, rebuilt every tick for the neighbour queries
+    SpatialHash spatialHash;
+
+    // steer AI ships around each other and the asteroids with the avoidance pass
+    bool useLocalAvoidance = true;
+
+    // signed distance to the asteroid surfaces, rebaked around asteroids that moved
+    DistanceField distanceField;
+    // sense asteroids through the distance field rather than with rays
+    bool useDistanceField = true;
+    // AI ships are pushed away from asteroid surfaces closer than this
+    float asteroidClearance = 4.0f;
+
+    // debug drawing of the nav volume and the AI paths through it
+    Core::CVar* r_draw_path = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_path", "0");
+    Core::CVar* r_draw_Node_Axis = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_Node_Axis", "0");
+    Core::CVar* r_draw_Node_Axis_id = Core::CVarCreate(Core::CVarType::CVar_Int, "r_draw_Node_Axis_id", " - 1");
+
+    // convex hull shared by every ship collider, built on first use
+    Physics::ColliderMeshId shipColliderMesh = Physics::ColliderMeshId::Invalid();
+
+    static constexpr int NumAsteroidTypes = 6;
+    static constexpr const char* AsteroidModelPaths[NumAsteroidTypes] =
+    {
+        "assets/space/Asteroid_1.glb",
+        "assets/space/Asteroid_2.glb",
+        "assets/space/Asteroid_3.glb",
+        "assets/space/Asteroid_4.glb",
+        "assets/space/Asteroid_5.glb",
+        "assets/space/Asteroid_6.glb"
+    };
+    static constexpr const char* AsteroidColliderPaths[NumAsteroidTypes] =
+    {
+        "assets/space/Asteroid_1_physics.glb",
+        "assets/space/Asteroid_2_physics.glb",
+        "assets/space/Asteroid_3_physics.glb",
+        "assets/space/Asteroid_4_physics.glb",
+        "assets/space/Asteroid_5_physics.glb",
+        "assets/space/Asteroid_6_physics.glb"
+    };
+    // references taken by PreloadAsteroids, keeps the meshes resident between spawns
+    std::vector<Physics::ColliderMeshId> asteroidColliderMeshes;
     World();
     ~World();
 
@@ -70,21 +122,40 @@ public:
     Entity* CreatePlayerShip(bool isRespawning);
     Entity* CreateEnemyShip(bool isRespawning);
 
+    void PreloadAsteroids();
     Entity* CreateAsteroid(float spread);
-    Entity* CreatePathNode(float xOffset, float yOffset, float zOffset, float deltaXYZ);
+    /// size^3 nav cells spaced evenly from origin, occupancy is tested against the asteroids created so far
+    void CreateNavVolume(int size, glm::vec3 const& origin, float spacing);
 
-    Entity* randomGetNode();
-    Entity* getclosestNodeFromAIship(Entity* ship);
+    int randomGetNode();
+    int getclosestNodeFromAIship(Entity* ship);
 
 private:
 
-    void UpdateNode(Entity* entity, float dt);
-
     void UpdateShip(Entity* entity, float dt);
     void UpdateAiShip(Entity* entity, float dt);
 
     void UpdateAsteroid(Entity* entity, float dt);
-    void drawNode(Entity* entity);
+    void UpdateContacts();
+    /// true if any of the axis rays from the cell position hits an asteroid
+    bool TestCellOccupancy(glm::vec3 const& position);
+    /// re-test the nav cells around the asteroids and pass the ones that flipped on to the pathfinder
+    void UpdateNavOccupancy();
+    /// rebake the distance field around asteroids that moved or turned more than half a voxel since their last bake
+    void UpdateDistanceField();
+    /// one avoidance solve for all AI ships, from the velocities they preferred last frame
+    void UpdateLocalAvoidance(float dt);
+    /// tick the AI of every enemy ship its level of detail makes due, within the AI budget
+    void UpdateAiShips(float dt);
+    /// rebuild the spatial hash from this tick's ship and asteroid transforms
+    void UpdateSpatialHash();
+    /// fill the ship's contacts from the spatial hash, reads the world only
+    void SenseShip(Entity* ship, PerceptionContacts& contacts);
+    /// drop a destroyed ship from every contact list
+    void ForgetContact(Entity* ship);
+    void FireWeapon(Entity* entity);
+    void UpdateProjectiles(float dt);
+    void drawNavVolume();
     void draw(Entity* entity);
     void updateCamera(Entity* entity, float dt);
 
@@ -93,12 +164,17 @@ private:
     void fleeingState(Entity* entity, float dt);
 
     //AI functions
-    void moveToStartNode(Entity* entity, Components::TransformComponent* startNode, float dt);
+    void moveToStartNode(Entity* entity, glm::vec3 const& startNodePos, float dt);
     void drawPath(Entity* entity);
     void resetPath(Entity* entity);
     void followPath(Entity* entity, float dt);
     void updateShipMovementAndParticles(Entity* entity, float dt);
     bool IsShipNearby(Entity* entity, float detectionRadius, Entity*& outShip);
+
+    // cells queued for the occupancy re-test, marks keep cells shared by several asteroids from being tested twice
+    std::vector<int> navRetestCells;
+    std::vector<uint8_t> navRetestMarks;
+    std::vector<int> navChangedCells;
 };
 
 
@@ -218,10 +294,18 @@ inline Entity* World::GetEntity(uint32_t entityId)
 
 inline void World::Update(float dt)
 {
+    PathService::Instance()->Tick();
+    SensorScheduler::Instance()->BeginFrame();
+    Physics::IntegrateRigidBodies(dt);
     for (auto asteroid : pureEntityData->Asteroids)
     {
         UpdateAsteroid(asteroid, dt);
     }
+    UpdateContacts();
+    UpdateSpatialHash();
+    UpdateNavOccupancy();
+    UpdateDistanceField();
+    UpdateLocalAvoidance(dt);
 
     for (int i = 0; i < pureEntityData->ships.size(); i++)
     {
@@ -250,7 +334,6 @@ inline void World::Update(float dt)
         }
       
           // --- SAFE TO UPDATE ---
-        UpdateAiShip(ship, dt);
         UpdateShip(ship, dt);
         updateCamera(ship, dt);
 
@@ -259,12 +342,11 @@ inline void World::Update(float dt)
        
     }
 
-   
 
-    for (auto node : pureEntityData->nodes)
-    {
-        UpdateNode(node, dt);
-    }
+    UpdateAiShips(dt);
+    UpdateProjectiles(dt);
+
+    drawNavVolume();
 
 
     //draw Everything
@@ -286,6 +368,8 @@ inline void World::DestroyShip(uint32_t shipId, EntityType eType)
     if (it != pureEntityData->ships.end())
     {
         Entity* entityToDelete = *it;
+        spatialHash.Remove(entityToDelete);
+        ForgetContact(entityToDelete);
 
         auto ShipState = entityToDelete->GetComponent<Components::State>();
         ShipState->isDestroyed = true;
@@ -306,11 +390,24 @@ inline void World::DestroyShip(uint32_t shipId, EntityType eType)
             }
             else if (auto* colliderComp = dynamic_cast<Components::ColliderComponent*>(component))
             {
+                if (colliderComp->colliderID != Physics::ColliderId::Invalid())
+                {
+                    Physics::DestroyCollider(colliderComp->colliderID);
+                    colliderComp->colliderID = Physics::ColliderId::Invalid();
+                    // asteroids hold a reference on their shared collider mesh
+                    if (colliderComp->UsingEntityType == EntityType::Asteroid)
+                        Physics::UnloadColliderMesh(colliderComp->collidermeshId);
+                }
                 colliderChunk.Deallocate(colliderComp);
 
             }
             else if (auto* rigidBodyComp = dynamic_cast<Components::RigidBodyComponent*>(component))
             {
+                if (rigidBodyComp->rigidBodyId != Physics::RigidBodyId::Invalid())
+                {
+                    Physics::DestroyRigidBody(rigidBodyComp->rigidBodyId);
+                    rigidBodyComp->rigidBodyId = Physics::RigidBodyId::Invalid();
+                }
                 rigidBodyChunk.Deallocate(rigidBodyComp);
 
             }
@@ -351,6 +448,10 @@ inline void World::DestroyShip(uint32_t shipId, EntityType eType)
             {
                 AIChunk.Deallocate(aiComp);
             }
+            else if (auto* weaponComp = dynamic_cast<Components::WeaponComponent*>(component))
+            {
+                weaponChunk.Deallocate(weaponComp);
+            }
 
 
 
@@ -395,11 +496,24 @@ inline void World::DestroyEntity(uint32_t entityId, EntityType eType)
             }
             else if (auto* colliderComp = dynamic_cast<Components::ColliderComponent*>(component))
             {
+                if (colliderComp->colliderID != Physics::ColliderId::Invalid())
+                {
+                    Physics::DestroyCollider(colliderComp->colliderID);
+                    colliderComp->colliderID = Physics::ColliderId::Invalid();
+                    // asteroids hold a reference on their shared collider mesh
+                    if (colliderComp->UsingEntityType == EntityType::Asteroid)
+                        Physics::UnloadColliderMesh(colliderComp->collidermeshId);
+                }
                 colliderChunk.Deallocate(colliderComp);
 
             }
             else if (auto* rigidBodyComp = dynamic_cast<Components::RigidBodyComponent*>(component))
             {
+                if (rigidBodyComp->rigidBodyId != Physics::RigidBodyId::Invalid())
+                {
+                    Physics::DestroyRigidBody(rigidBodyComp->rigidBodyId);
+                    rigidBodyComp->rigidBodyId = Physics::RigidBodyId::Invalid();
+                }
                 rigidBodyChunk.Deallocate(rigidBodyComp);
 
             }
@@ -440,6 +554,10 @@ inline void World::DestroyEntity(uint32_t entityId, EntityType eType)
 
                 particleEmitterChunk.Deallocate(particleEmitterComp);
             }
+            else if (auto* weaponComp = dynamic_cast<Components::WeaponComponent*>(component))
+            {
+                weaponChunk.Deallocate(weaponComp);
+            }
 
 
 
@@ -480,10 +598,23 @@ inline void World::Cleanup()
                 }
                 else if (auto* colliderComp = dynamic_cast<Components::ColliderComponent*>(component))
                 {
+                    if (colliderComp->colliderID != Physics::ColliderId::Invalid())
+                    {
+                        Physics::DestroyCollider(colliderComp->colliderID);
+                        colliderComp->colliderID = Physics::ColliderId::Invalid();
+                        // asteroids hold a reference on their shared collider mesh
+                        if (colliderComp->UsingEntityType == EntityType::Asteroid)
+                            Physics::UnloadColliderMesh(colliderComp->collidermeshId);
+                    }
                     colliderChunk.Deallocate(colliderComp);
                 }
                 else if (auto* rigidBodyComp = dynamic_cast<Components::RigidBodyComponent*>(component))
                 {
+                    if (rigidBodyComp->rigidBodyId != Physics::RigidBodyId::Invalid())
+                    {
+                        Physics::DestroyRigidBody(rigidBodyComp->rigidBodyId);
+                        rigidBodyComp->rigidBodyId = Physics::RigidBodyId::Invalid();
+                    }
                     rigidBodyChunk.Deallocate(rigidBodyComp);
                 }
                 else if (auto* playerInputComp = dynamic_cast<Components::PlayerInputComponent*>(component))
@@ -516,14 +647,14 @@ inline void World::Cleanup()
 
                     particleEmitterChunk.Deallocate(particleEmitterComp);
                 }
-                else if (auto* aiNavNodeComp = dynamic_cast<Components::AINavNodeComponent*>(component))
-                {
-                    navNodeChunk.Deallocate(aiNavNodeComp);
-                }
                 else if (auto* aiComp = dynamic_cast<Components::AI*>(component))
                 {
                     AIChunk.Deallocate(aiComp);
                 }
+                else if (auto* weaponComp = dynamic_cast<Components::WeaponComponent*>(component))
+                {
+                    weaponChunk.Deallocate(weaponComp);
+                }
                 else if (auto* stateComp = dynamic_cast<Components::State*>(component))
                 {
                     stateChunk.Deallocate(stateComp);
@@ -538,6 +669,13 @@ inline void World::Cleanup()
 
     // Clear the entity list after deallocation
     pureEntityData->entities.clear();
+    ProjectileSystem::Instance()->Clear();
+
+    for (auto meshId : asteroidColliderMeshes)
+    {
+        Physics::UnloadColliderMesh(meshId);
+    }
+    asteroidColliderMeshes.clear();
 }
 
 inline void World::DestroyWorld()
@@ -662,11 +800,10 @@ inline  Entity* World::CreatePlayerShip(bool isRespawning)
     {
         spaceship = createEntity(EntityType::SpaceShip, isRespawning);
     }
-    //add random position from the nodes placed out
-    int randomIndex = rand() % pureEntityData->nodes.size();
-    auto nodeTransformComponent = pureEntityData->nodes[randomIndex]->GetComponent<Components::TransformComponent>();
+    //add random position from the nav cells
+    int randomIndex = rand() % pureEntityData->navVolume.NumCells();
     Components::TransformComponent* newTransform = transformChunk.Allocate();
-    newTransform->transform[3] = nodeTransformComponent->transform[3];
+    newTransform->transform[3] = glm::vec4(pureEntityData->navVolume.CellPosition(randomIndex), 1.0f);
 
     spaceship->AddComponent(newTransform, ComponentType::TRANSFORM, EntityType::SpaceShip);
 
@@ -682,6 +819,13 @@ inline  Entity* World::CreatePlayerShip(bool isRespawning)
     {
         collider->colliderEndPoints.push_back(colliderEndPoints[i]);
     }
+    if (shipColliderMesh == Physics::ColliderMeshId::Invalid())
+    {
+        shipColliderMesh = Physics::CreateConvexColliderMesh(collider->colliderEndPoints);
+    }
+    collider->collidermeshId = shipColliderMesh;
+    collider->colliderID = Physics::CreateCollider(shipColliderMesh, newTransform->transform, (uint16_t)CollisionLayer::SHIP, spaceship);
+    collider->UsingEntityType = EntityType::SpaceShip;
     for (int i = 0; i < sizeof(collider->rayCastPoints) / sizeof(glm::vec3); i++)
     {
         collider->rayCastPoints[i] = rayCastEndPoints[i];
@@ -695,6 +839,9 @@ inline  Entity* World::CreatePlayerShip(bool isRespawning)
     Components::PlayerInputComponent* controllinput = controlInputChunk.Allocate();
     spaceship->AddComponent(controllinput, ComponentType::INPUT, EntityType::SpaceShip);
 
+    Components::WeaponComponent* weapon = weaponChunk.Allocate();
+    spaceship->AddComponent(weapon, ComponentType::WEAPON, EntityType::SpaceShip);
+
     Components::ParticleEmitterComponent* particleEmitter = particleEmitterChunk.Allocate();
     spaceship->AddComponent(particleEmitter, ComponentType::PARTICLE_EMITTER, EntityType::SpaceShip);
 
@@ -868,11 +1015,10 @@ inline  Entity* World::CreateEnemyShip(bool isRespawning)
 
    
 
-    //add random position from the nodes placed out
-    int randomIndex = rand() % pureEntityData->nodes.size();
-    auto nodeTransformComponent = pureEntityData->nodes[randomIndex]->GetComponent<Components::TransformComponent>();
+    //add random position from the nav cells
+    int randomIndex = rand() % pureEntityData->navVolume.NumCells();
     Components::TransformComponent* newTransform = transformChunk.Allocate();
-    newTransform->transform[3] = nodeTransformComponent->transform[3];
+    newTransform->transform[3] = glm::vec4(pureEntityData->navVolume.CellPosition(randomIndex), 1.0f);
 
     AIspaceship->AddComponent(newTransform, ComponentType::TRANSFORM, EntityType::EnemyShip);
 
@@ -889,6 +1035,13 @@ inline  Entity* World::CreateEnemyShip(bool isRespawning)
     {
         collider->colliderEndPoints.push_back(colliderEndPoints[i]);
     }
+    if (shipColliderMesh == Physics::ColliderMeshId::Invalid())
+    {
+        shipColliderMesh = Physics::CreateConvexColliderMesh(collider->colliderEndPoints);
+    }
+    collider->collidermeshId = shipColliderMesh;
+    collider->colliderID = Physics::CreateCollider(shipColliderMesh, newTransform->transform, (uint16_t)CollisionLayer::SHIP, AIspaceship);
+    collider->UsingEntityType = EntityType::EnemyShip;
     for (int i = 0; i < sizeof(collider->rayCastPoints) / sizeof(glm::vec3); i++)
     {
         collider->rayCastPoints[i] = rayCastEndPoints[i];
@@ -905,6 +1058,9 @@ inline  Entity* World::CreateEnemyShip(bool isRespawning)
     Components::CameraComponent* camera = cameraChunk.Allocate();
     AIspaceship->AddComponent(camera, ComponentType::CAMERA, EntityType::EnemyShip);
 
+    Components::WeaponComponent* weapon = weaponChunk.Allocate();
+    AIspaceship->AddComponent(weapon, ComponentType::WEAPON, EntityType::EnemyShip);
+
     Components::ParticleEmitterComponent* particleEmitter = particleEmitterChunk.Allocate();
     AIspaceship->AddComponent(particleEmitter, ComponentType::PARTICLE_EMITTER, EntityType::EnemyShip);
 
@@ -975,42 +1131,36 @@ inline  Entity* World::CreateEnemyShip(bool isRespawning)
     return AIspaceship;
 
 }
+inline void World::PreloadAsteroids()
+{
+    std::vector<std::string> paths(std::begin(AsteroidColliderPaths), std::end(AsteroidColliderPaths));
+    asteroidColliderMeshes = Physics::PreloadColliderMeshes(paths);
+    for (int i = 0; i < NumAsteroidTypes; i++)
+    {
+        Render::LoadModel(AsteroidModelPaths[i]);
+    }
+}
 inline Entity* World::CreateAsteroid(float spread)
 {
-    Render::ModelId models[6] = {
-    Render::LoadModel("assets/space/Asteroid_1.glb"),
-    Render::LoadModel("assets/space/Asteroid_2.glb"),
-    Render::LoadModel("assets/space/Asteroid_3.glb"),
-    Render::LoadModel("assets/space/Asteroid_4.glb"),
-    Render::LoadModel("assets/space/Asteroid_5.glb"),
-    Render::LoadModel("assets/space/Asteroid_6.glb")
-    };
-
-    Physics::ColliderMeshId colliderMeshes[6] = {
-       Physics::LoadColliderMesh("assets/space/Asteroid_1_physics.glb"),
-       Physics::LoadColliderMesh("assets/space/Asteroid_2_physics.glb"),
-       Physics::LoadColliderMesh("assets/space/Asteroid_3_physics.glb"),
-       Physics::LoadColliderMesh("assets/space/Asteroid_4_physics.glb"),
-       Physics::LoadColliderMesh("assets/space/Asteroid_5_physics.glb"),
-       Physics::LoadColliderMesh("assets/space/Asteroid_6_physics.glb")
-    };
-
     Entity* asteroidEntity = createEntity(EntityType::Asteroid, false);
     if (asteroidEntity->eType == EntityType::Asteroid)
 
     {
 
-        size_t resourceIndex = (size_t)(Core::FastRandom() % 6);
+        // only the chosen resources are looked up, both registries return the loaded copy
+        size_t resourceIndex = (size_t)(Core::FastRandom() % NumAsteroidTypes);
+        Render::ModelId model = Render::LoadModel(AsteroidModelPaths[resourceIndex]);
+        Physics::ColliderMeshId colliderMesh = Physics::LoadColliderMesh(AsteroidColliderPaths[resourceIndex]);
         // Allocating stuff to the chunkAllocator
         Components::TransformComponent* newTransform = transformChunk.Allocate();
         asteroidEntity->AddComponent(newTransform, ComponentType::TRANSFORM, EntityType::Asteroid);
 
 
-        Components::RenderableComponent* renderable = renderableChunk.Allocate(models[resourceIndex]);
+        Components::RenderableComponent* renderable = renderableChunk.Allocate(model);
         asteroidEntity->AddComponent(renderable, ComponentType::RENDERABLE, EntityType::Asteroid);
 
 
-        Components::ColliderComponent* collider = colliderChunk.Allocate(colliderMeshes[resourceIndex]);
+        Components::ColliderComponent* collider = colliderChunk.Allocate(colliderMesh);
         asteroidEntity->AddComponent(collider, ComponentType::COLLIDER, EntityType::Asteroid);
 
 
@@ -1037,123 +1187,37 @@ inline Entity* World::CreateAsteroid(float spread)
         //GIVE THE TRANSFORM ROTATIONSPEED
         float rotationSpeed = Core::RandomFloat() * 1.0f + 9.0f;  // Random speed between 1 and 9
         newTransform->rotationSpeed = rotationSpeed;
-        collider->colliderID = Physics::CreateCollider(colliderMeshes[resourceIndex], newTransform->transform);
+        collider->colliderID = Physics::CreateCollider(colliderMesh, newTransform->transform, (uint16_t)CollisionLayer::ASTEROID, asteroidEntity);
         collider->UsingEntityType = EntityType::Asteroid;
 
+        // spin around the random axis, the rigid body drives both transform and collider from here on
+        Components::RigidBodyComponent* rigidBody = rigidBodyChunk.Allocate();
+        asteroidEntity->AddComponent(rigidBody, ComponentType::RIGIDBODY, EntityType::Asteroid);
+        rigidBody->angularVelocity = newTransform->rotationAxis * glm::radians(rotationSpeed);
+        rigidBody->rigidBodyId = Physics::CreateRigidBody(newTransform->transform, rigidBody->mass, collider->colliderID);
+        Physics::SetVelocity(rigidBody->rigidBodyId, rigidBody->velocity, rigidBody->angularVelocity);
+
     }
     return asteroidEntity;
 }
-inline Entity* World::CreatePathNode(float xOffset, float yOffset, float zOffset, float deltaXYZ)
+inline void World::CreateNavVolume(int size, glm::vec3 const& origin, float spacing)
 {
-    const glm::vec3 EndPoints[6] =
-    {
-        glm::vec3(-1.0f, 0.0f, 0.0f),  // left
-        glm::vec3(1.0f, 0.0f, 0.0f),  // right
-
-        glm::vec3(0.0f, -1.0f, 0.0f),  // down
-        glm::vec3(0.0f, 1.0f, 0.0f),  // up
-
-        glm::vec3(0.0f, 0.0f, -1.0f),  // backward
-        glm::vec3(0.0f, 0.0f, 1.0f),  // forward
-
-
-    };
-
-
-    Entity* node = createEntity(EntityType::Node, false);
-    Components::ColliderComponent* colComp = colliderChunk.Allocate();
-    node->AddComponent(colComp, ComponentType::COLLIDER, EntityType::Node);
-    for (int i = 0; i < sizeof(EndPoints) / sizeof(glm::vec3); i++)
-    {
-        colComp->EndPointsNodes[i] = EndPoints[i];
-    }
-    Components::TransformComponent* newTransform = transformChunk.Allocate();
-    node->AddComponent(newTransform, ComponentType::TRANSFORM, EntityType::Node);
-    newTransform->transform[3] = glm::vec4(-100.0f + xOffset * deltaXYZ, -100.0f + yOffset * deltaXYZ, -100.0f + zOffset * deltaXYZ, 0);
-
-    Components::AI* AINodes = AIChunk.Allocate(); // use for the enemy ship to track path
-    node->AddComponent(AINodes, ComponentType::AI, EntityType::Node);
-
-    Components::AINavNodeComponent* NodeComp = navNodeChunk.Allocate();
-    node->AddComponent(NodeComp, ComponentType::NAVNODE, EntityType::Node);
-    for (int i = 0; i < sizeof(EndPoints) / sizeof(glm::vec3); i++)
-    {
-        NodeComp->EndPoints[i] = EndPoints[i];
-    }
-
-    for (int i = 0; i < sizeof(colComp->EndPointsNodes) / sizeof(glm::vec3); i++)
+    NavVolume& volume = pureEntityData->navVolume;
+    volume.Create(size, origin, spacing);
+    for (int cell = 0; cell < volume.NumCells(); cell++)
     {
-        glm::vec3 pos = glm::vec3(newTransform->transform[3]);
-        glm::vec3 dir = newTransform->transform * glm::vec4(glm::normalize(colComp->EndPointsNodes[i]), 0.0f);
-        float len = glm::length(colComp->EndPointsNodes[i]);
-        Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(newTransform->transform[3]), dir, len);
-
-        // debug draw collision rays
-        //Debug::DrawLine(pos, pos + dir * len, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-
-        if (payload.hit)
-        {
-            Debug::DrawDebugText("Node_hit_asteroids", payload.hitPoint, glm::vec4(1, 1, 1, 1));
-            for (auto entityIn : pureEntityData->Asteroids)
-            {
-                auto entComp = entityIn->GetComponent<Components::ColliderComponent>();
-                if (payload.collider == entComp->colliderID && entityIn->eType == EntityType::Asteroid)
-                {
-                    NodeComp->isCollidedAsteroids = true;
-
-                }
-            }
-        }
-
+        volume.SetBlocked(cell, TestCellOccupancy(volume.CellPosition(cell)));
     }
-
-
-    //give it to the map too
-    pureEntityData->gridNodes[node->id] = node;
-
-    return node;
-
-
 }
-inline Entity* World::randomGetNode()
+inline int World::randomGetNode()
 {
-    randomIndex = std::rand() % pureEntityData->nodes.size();
-    return pureEntityData->gridNodes[randomIndex];
+    randomIndex = std::rand() % pureEntityData->navVolume.NumCells();
+    return randomIndex;
 }
-inline Entity* World::getclosestNodeFromAIship(Entity* ship)
+inline int World::getclosestNodeFromAIship(Entity* ship)
 {
-    Entity* closestNode = nullptr;
-    float minDistanceSquared = std::numeric_limits<float>::max();  // Use squared distance to avoid sqrt
     auto shipPosition = glm::vec3(ship->GetComponent<Components::TransformComponent>()->transform[3]);
-
-    for (auto& node : pureEntityData->nodes)
-    {
-        // Ensure the node has a TransformComponent and is valid
-        auto nodeTransform = node->GetComponent<Components::TransformComponent>();
-
-
-        // Get the position of the node
-        auto nodePosition = glm::vec3(nodeTransform->transform[3]);
-
-        // Calculate the squared distance
-        glm::vec3 vectorShipPos2NodePos = nodePosition - shipPosition;
-        float distanceSquared = glm::dot(vectorShipPos2NodePos, vectorShipPos2NodePos);
-
-        // Update closest node if a new minimum distance is found
-        if (distanceSquared <= minDistanceSquared)
-        {
-            minDistanceSquared = distanceSquared;
-            closestNode = node;
-        }
-    }
-
-    return closestNode;
-
-
-}
-inline void World::UpdateNode(Entity* entity, float dt)
-{
-    drawNode(entity);
+    return pureEntityData->navVolume.CellAt(shipPosition);
 }
 inline void World::UpdateShip(Entity* entity, float dt)
 {
@@ -1232,241 +1296,33 @@ inline void World::UpdateShip(Entity* entity, float dt)
             particleComponent->particleEmitterRight->data.endSpeed = 0.0f + (3.0f * t);
 
             //canons for ship
-
-            float isSpacePressed = playerInputComponent->kbd->held[Input::Key::Space] ? 1.0f : 0.0f;
-
-     
-            // Cannon base positions (used for reset)
-            const float CanonPosOffset = 0.365f;
-            glm::vec3 leftOrigin = glm::vec3(transformComponent->transform[3] + transformComponent->transform[0] * -CanonPosOffset + transformComponent->transform[2] * particleComponent->canonEmitterOffset);
-            glm::vec3 rightOrigin = glm::vec3(transformComponent->transform[3] + transformComponent->transform[0] * CanonPosOffset + transformComponent->transform[2] * particleComponent->canonEmitterOffset);
-
-            // Initialize emitter positions if first frame
-            if (particleComponent->travelLeft == 0.0f) particleComponent->leftCanonPos = leftOrigin;
-            if (particleComponent->travelRight == 0.0f) particleComponent->rightCanonPos = rightOrigin;
-
-            particleComponent->particleCanonLeft->data.randomTimeOffsetDist = 0.01;
-            particleComponent->particleCanonRight->data.randomTimeOffsetDist = 0.01; 
-            particleComponent->particleCanonLeft->data.startSpeed = -50.0f;
-            particleComponent->particleCanonLeft->data.endSpeed = -50.0f;
-            particleComponent->particleCanonRight->data.startSpeed = -50.0f;
-            particleComponent->particleCanonRight->data.endSpeed = -50.0f;
-
-            const float maxDistance = 5000.0f;
-
             static bool lastSpaceState = false;
-            bool currentSpaceState = (isSpacePressed >= 1.0f);
+            bool currentSpaceState = playerInputComponent->kbd->held[Input::Key::Space];
 
             // Trigger firing only on key press
             if (currentSpaceState && !lastSpaceState)
-            {
-                particleComponent->particleCanonLeft->data.looping = 1;
-                particleComponent->particleCanonRight->data.looping = 1;
-                particleComponent->hasFired = true;
-            }
+                FireWeapon(entity);
 
             // Save state for next frame
             lastSpaceState = currentSpaceState;
 
-            // Only set direction when starting a new shot
-            if (particleComponent->hasFired)
-            {
-                Entity* closestEntity = nullptr;
-                Components::TransformComponent* closestTComp = nullptr;
-
-                // --- Update direction once per shot (based on ship rotation) ---
-                if (particleComponent->travelLeft == 0.0f)
-                    particleComponent->particleCanonLeft->data.dir = glm::vec4(-glm::vec3(transformComponent->transform[2]), 0);
-
-                if (particleComponent->travelRight == 0.0f)
-                    particleComponent->particleCanonRight->data.dir = glm::vec4(-glm::vec3(transformComponent->transform[2]), 0);
-
-                glm::vec3 leftDir = glm::normalize(glm::vec3(particleComponent->particleCanonLeft->data.dir));
-                glm::vec3 rightDir = glm::normalize(glm::vec3(particleComponent->particleCanonRight->data.dir));
-
-                float speedLeft = particleComponent->particleCanonLeft->data.startSpeed;
-                float speedRight = particleComponent->particleCanonRight->data.startSpeed;
-
-                // --- Simulate bullet travel ---
-                particleComponent->leftCanonPos += leftDir * speedLeft * dt;
-                particleComponent->rightCanonPos += rightDir * speedRight * dt;
-
-                particleComponent->travelLeft += glm::abs(speedLeft) * dt * 500.0f;
-                particleComponent->travelRight += glm::abs(speedRight) * dt * 500.0f;
-
-                // --- Find closest target ship ---
-                float minDistSq = std::numeric_limits<float>::max();
-                for (auto entityIn : pureEntityData->ships)
-                {
-                    if (entityIn->eType == EntityType::SpaceShip) // skip self/player
-                        continue;
-
-                    auto tComp = entityIn->GetComponent<Components::TransformComponent>();
-                    if (!tComp) continue;
-
-                    glm::vec3 targetPos = glm::vec3(tComp->transform[3]);
-                    glm::vec3 originAvg = 0.5f * (
-                        glm::vec3(particleComponent->particleCanonLeft->data.origin) +
-                        glm::vec3(particleComponent->particleCanonRight->data.origin)
-                        );
-
-                    float distSq = glm::length2(targetPos - originAvg);
-                    if (distSq < minDistSq)
-                    {
-                        minDistSq = distSq;
-                        closestEntity = entityIn;
-                        closestTComp = tComp;
-                    }
-                }
-
-                bool colliderIsClose = (closestEntity && glm::sqrt(minDistSq) < 1.5f);
-
-                glm::vec3 leftStart = particleComponent->leftCanonPos;
-                glm::vec3 rightStart = particleComponent->rightCanonPos;
-
-                // --- Debug rays to visualize travel ---
-                Debug::DrawLine(leftStart, leftStart + leftDir * 200.0f, 1.0f, glm::vec4(1, 0, 0, 1), glm::vec4(1, 0, 0, 1));
-                Debug::DrawLine(rightStart, rightStart + rightDir * 200.0f, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1));
-
-                // --- Now target the enemy collider endpoints ---
-                if (closestEntity)
-                {
-                    auto enemyCollider = closestEntity->GetComponent<Components::ColliderComponent>();
-                    if (enemyCollider)
-                    {
-                        for (auto& endpoint : enemyCollider->colliderEndPoints)
-                        {
-                            glm::vec3 worldEndpoint = glm::vec3(closestTComp->transform * glm::vec4(endpoint, 1.0f));
-
-                            // Pick cannon origin (alternate for left/right)
-                            glm::vec3 cannonOrigin = glm::vec3(particleComponent->particleCanonLeft->data.origin);
-                            glm::vec3 dirToEndpoint = glm::normalize(worldEndpoint - cannonOrigin);
-                            float len = glm::length(worldEndpoint - cannonOrigin);
-
-                            Debug::DrawLine(cannonOrigin, cannonOrigin + dirToEndpoint * len, 1.0f,
-                                glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, 1, 1));
-                        }
-                    }
-                   
-                }
-                auto closestEnemyState = closestEntity->GetComponent<Components::State>();
-                 if (colliderIsClose && closestEntity->eType == EntityType::EnemyShip && !closestEnemyState->isRespawning)
-                    {
-
-                        std::cout << "AI CANNON HIT ENEMY ENDPOINT! Ship ID: " << closestEntity->id << std::endl;
-
-                        particleComponent->hasFired = false;
-                        particleComponent->leftCanonPos = leftOrigin;
-                        particleComponent->rightCanonPos = rightOrigin;
-                        particleComponent->travelLeft = 0.0f;
-                        particleComponent->travelRight = 0.0f;
-                        particleComponent->hasFired = false;
-                        particleComponent->particleCanonLeft->data.looping = 0;
-                        particleComponent->particleCanonRight->data.looping = 0;
-
-                        if (closestEnemyState->isRespawning) return; // stop if already respawning
-                        // Respawn + destroy logic
-                        savedEnemyIDs.push(closestEntity->id);
-                        closestEnemyState->isRespawning = true;
-                        CreateEnemyShip(true);
-                        DestroyShip(closestEntity->id, closestEntity->eType);
-                        DestroyEntity(closestEntity->id, closestEntity->eType);
-         
-                       
-                    }
-
-                // --- Reset if exceeded max travel distance ---
-                if (particleComponent->travelLeft >= maxDistance || particleComponent->travelRight >= maxDistance)
-                {
-                    particleComponent->leftCanonPos = leftOrigin;
-                    particleComponent->rightCanonPos = rightOrigin;
-                    particleComponent->travelLeft = 0.0f;
-                    particleComponent->travelRight = 0.0f;
-                    particleComponent->hasFired = false;
-                    particleComponent->particleCanonLeft->data.looping = 0;
-                    particleComponent->particleCanonRight->data.looping = 0;
-                }
-            }
-
-            // Update emitter origins
-            particleComponent->particleCanonLeft->data.origin = glm::vec4(particleComponent->leftCanonPos, 1.0f);
-            particleComponent->particleCanonRight->data.origin = glm::vec4(particleComponent->rightCanonPos, 1.0f);
-
-            glm::vec3 leftDir = glm::normalize(glm::vec3(particleComponent->particleCanonLeft->data.dir));
-            glm::vec3 rightDir = glm::normalize(glm::vec3(particleComponent->particleCanonRight->data.dir));
-
-            
-
-            //check collisions asteroids
-            glm::mat4 rotation = glm::mat4(transformComponent->orientation);
-            bool hit = false;
-
-            bool colliderIsClose = false;
-            Entity* closeEntity;
-            Components::TransformComponent* closeTComp;
-
-            auto shipPos = glm::vec3(transformComponent->transform[3]);
-
-            for (auto entityIn : pureEntityData->Asteroids)
-            {
-                closeTComp = entityIn->GetComponent<Components::TransformComponent>();
-                auto closestPos = glm::vec3(closeTComp->transform[3]);
-
-                auto closestposLenght = glm::length(closestPos - shipPos);
-
-                if (closestposLenght < 8.0f && closeTComp != nullptr)
-                {
-
-                    colliderIsClose = true;
-                    closeEntity = entityIn;
-                    break;
-                }
-            }
-
             auto entityState = entity->GetComponent<Components::State>();
 
-            for (int i = 0; i < colliderComponent->colliderEndPoints.size(); i++)
+            // asteroid hits come from the contact pass, which has already tested the ship collider this frame
+            if (entityState->isCollidingAsteroids)
             {
-                glm::vec3 pos = glm::vec3(transformComponent->transform[3]);
-                glm::vec3 dir = transformComponent->transform * glm::vec4(glm::normalize(colliderComponent->colliderEndPoints[i]), 0.0f);
-                float len = glm::length(colliderComponent->colliderEndPoints[i]);
-                // debug draw collision rays
-                int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
-
-                if (colliderIsClose)
-                {
-                    if (menuIsUsingRayCasts == 1.0f)
-                    {
-                        Debug::DrawLine(pos, pos + dir * len, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-                    }
-                    Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(transformComponent->transform[3]), dir, len);
-                    if (payload.hit)
-                    {
-                        Debug::DrawDebugText("HIT", payload.hitPoint, glm::vec4(1, 1, 1, 1));
-
-                        auto entComp = closeEntity->GetComponent<Components::ColliderComponent>();
-                        if (payload.collider == entComp->colliderID && closeEntity->eType == EntityType::Asteroid)
-                        {
-                            // Stop particle emitters
-                            particleComponent->particleCanonLeft->data.looping = 0;
-                            particleComponent->particleCanonRight->data.looping = 0;
+                // Stop particle emitters
+                particleComponent->particleCanonLeft->data.looping = 0;
+                particleComponent->particleCanonRight->data.looping = 0;
 
-                            // Save and flag for respawn
-                            savedIDs.push(entity->id);
+                // Save and flag for respawn
+                savedIDs.push(entity->id);
 
-                           
-                            entityState->isRespawning = true;
-
-                            CreatePlayerShip(true);
-                            DestroyShip(entity->id, entity->eType);
-                            DestroyEntity(entity->id, entity->eType);
-
-
-                            return;
-                        }
-
-                    }
-                }
+                entityState->isRespawning = true;
+                CreatePlayerShip(true);
+                DestroyShip(entity->id, entity->eType);
+                DestroyEntity(entity->id, entity->eType);
+                return;
             }
 
             glm::mat4 transform = transformComponent->transform;
@@ -1487,71 +1343,63 @@ inline void World::UpdateShip(Entity* entity, float dt)
             // === Forward rays (center) ===
             glm::vec3 fStart = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[0], 1.0f));
             glm::vec3 fEnd = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[1], 1.0f));
-            float fLength = glm::length(fEnd - fStart);
 
 
             glm::vec3 f1Start = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[2], 1.0f));
             glm::vec3 f1End = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[3], 1.0f));
-            float f1Length = glm::length(f1End - f1Start);
 
 
             glm::vec3 f2Start = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[4], 1.0f));
             glm::vec3 f2End = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[5], 1.0f));
-            float f2Length = glm::length(f2End - f2Start);
 
 
             // === Up ray (center) ===
             glm::vec3 uStart = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[6], 1.0f));
             glm::vec3 uEnd = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[7], 1.0f));
-            float uLength = glm::length(uEnd - uStart);
 
 
             // === Down ray (center) ===
             glm::vec3 dStart = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[8], 1.0f));
             glm::vec3 dEnd = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[9], 1.0f));
-            float dLength = glm::length(dEnd - dStart);
 
             // === Left rays ===
             glm::vec3 lStart = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[30], 1.0f));
             glm::vec3 lEnd = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[31], 1.0f));
-            float lLength = glm::length(lEnd - lStart);
 
 
             glm::vec3 l1Start = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[32], 1.0f));
             glm::vec3 l1End = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[33], 1.0f));
-            float l1Length = glm::length(l1End - l1Start);
 
 
 
             // === Right rays ===
             glm::vec3 rStart = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[34], 1.0f));
             glm::vec3 rEnd = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[35], 1.0f));
-            float rLength = glm::length(rEnd - rStart);
 
 
 
             glm::vec3 r1Start = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[36], 1.0f));
             glm::vec3 r1End = glm::vec3(transform * glm::vec4(colliderComponent->rayCastPoints[37], 1.0f));
-            float r1Length = glm::length(r1End - r1Start);
 
 
-            bool colliderIsCloseSensor = false;
-            Entity* theCloseEntity;
-            Components::TransformComponent* theCloseTcomp;
-
             auto shipPosition = glm::vec3(transformComponent->transform[3]);
-            for (auto entityIn : pureEntityData->Asteroids)
+            // the player ship has no AI component and so no contacts, it asks the spatial hash directly
+            SensorScheduler* sensorScheduler = SensorScheduler::Instance();
+            std::vector<SpatialHit> closeAsteroids;
+            spatialHash.QueryRadius(shipPosition, 15.0f, SpatialHash::TypeMask(EntityType::Asteroid), closeAsteroids);
+            bool colliderIsCloseSensor = !closeAsteroids.empty();
+            // cached sensor results only stay trustworthy while nothing around moves
+            bool moversNearby = false;
+            for (SpatialHit const& hit : closeAsteroids)
             {
-                theCloseTcomp = entityIn->GetComponent<Components::TransformComponent>();
-                auto closestPos = glm::vec3(closeTComp->transform[3]);
-                auto closestposLenght = glm::length(closestPos - shipPosition);
-                if (closestposLenght <= 15.0f && closeTComp != nullptr)
-                {
-
-                    colliderIsCloseSensor = true;
-                    theCloseEntity = entityIn;
-                    break;
-                }
+                auto rigidBody = hit.entity->GetComponent<Components::RigidBodyComponent>();
+                auto asteroidCollider = hit.entity->GetComponent<Components::ColliderComponent>();
+                if (!rigidBody || !asteroidCollider || !Physics::IsValid(asteroidCollider->colliderID))
+                    continue;
+                glm::vec3 boundsMin, boundsMax;
+                Physics::GetBounds(asteroidCollider->colliderID, boundsMin, boundsMax);
+                float const surfaceSpeed = glm::length(rigidBody->velocity) + glm::length(rigidBody->angularVelocity) * 0.5f * (boundsMax.x - boundsMin.x);
+                moversNearby |= surfaceSpeed > sensorScheduler->moverSpeed;
             }
             int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
 
@@ -1563,15 +1411,39 @@ inline void World::UpdateShip(Entity* entity, float dt)
                 elapsedTime += dt;
                 if (elapsedTime >= delayTime)
                 {
-                    pf = Physics::Raycast(fStart, fEnd, fLength);
-                    pf1 = Physics::Raycast(f1Start, f1End, f1Length);
-                    pf2 = Physics::Raycast(f2Start, f2End, f2Length);
-                    pu = Physics::Raycast(uStart, uEnd, uLength);
-                    pd = Physics::Raycast(dStart, dEnd, dLength);
-                    pl = Physics::Raycast(lStart, lEnd, lLength);
-                    pl1 = Physics::Raycast(l1Start, l1End, l1Length);
-                    pr = Physics::Raycast(rStart, rEnd, rLength);
-                    pr1 = Physics::Raycast(r1Start, r1End, r1Length);
+                    Physics::ScopedQueryTag queryTag(Physics::QueryTag::AISensing);
+                    // the distance field answers a sensor with a few samples along it, the ray is the fallback
+                    auto sense = [this](glm::vec3 const& start, glm::vec3 const& end, float length)
+                    {
+                        if (!useDistanceField)
+                            return Physics::Raycast(start, glm::normalize(end - start), length, (uint16_t)CollisionLayer::ASTEROID);
+                        Physics::RaycastPayload payload;
+                        payload.hit = distanceField.SegmentCast(start, end, payload.hitDistance);
+                        payload.hitPoint = start + (end - start) * (payload.hitDistance / std::max(length, 1e-6f));
+                        return payload;
+                    };
+                    // a few rays per frame, the rest answer from the last time they were cast
+                    SensorRay const sensorRays[9] =
+                    {
+                        { fStart, fEnd }, { f1Start, f1End }, { f2Start, f2End },
+                        { uStart, uEnd }, { dStart, dEnd },
+                        { lStart, lEnd }, { l1Start, l1End },
+                        { rStart, rEnd }, { r1Start, r1End }
+                    };
+                    SensorCache& sensorCache = colliderComponent->sensorCache;
+                    sensorScheduler->Update(sensorCache, sensorRays, 9, moversNearby, [&sense](SensorRay const& ray)
+                    {
+                        return sense(ray.start, ray.end, glm::length(ray.end - ray.start));
+                    });
+                    pf = sensorCache.Result(0);
+                    pf1 = sensorCache.Result(1);
+                    pf2 = sensorCache.Result(2);
+                    pu = sensorCache.Result(3);
+                    pd = sensorCache.Result(4);
+                    pl = sensorCache.Result(5);
+                    pl1 = sensorCache.Result(6);
+                    pr = sensorCache.Result(7);
+                    pr1 = sensorCache.Result(8);
                     elapsedTime = 0.0f;
                 }
 
@@ -1705,144 +1577,590 @@ inline void World::UpdateAiShip(Entity* entity, float dt)
         }
     }
 }
-inline void World::UpdateAsteroid(Entity* entity, float dt)
+inline void World::UpdateAiShips(float dt)
 {
-    if (entity->eType == EntityType::Asteroid) // asteroids
-    {
-        auto transformComponent = entity->GetComponent<Components::TransformComponent>();
-        auto colliderComponent = entity->GetComponent<Components::ColliderComponent>();
-        auto renderComponent = entity->GetComponent<Components::RenderableComponent>();
+    AIScheduler* scheduler = AIScheduler::Instance();
+    scheduler->BeginFrame();
 
-        // Apply rotation to the asteroid's transform matrix
-        transformComponent->transform = glm::rotate(transformComponent->transform, dt * glm::radians(transformComponent->rotationSpeed), transformComponent->rotationAxis);
+    // relevance is measured from the player ship, the camera rides along with it
+    Entity* player = nullptr;
+    for (auto ship : pureEntityData->ships)
+    {
+        if (ship->eType == EntityType::SpaceShip)
+        {
+            player = ship;
+            break;
+        }
+    }
+    glm::vec3 playerPosition(0.0f);
+    glm::vec3 playerForward(0.0f, 0.0f, 1.0f);
+    if (auto playerTransform = player ? player->GetComponent<Components::TransformComponent>() : nullptr)
+    {
+        playerPosition = glm::vec3(playerTransform->transform[3]);
+        playerForward = playerTransform->orientation * glm::vec3(0, 0, 1);
+    }
 
-        // Ensure that the rotation is preserved correctly and the matrix remains valid
-        // This part normalizes the basis vectors (rows of the transform matrix)
-        transformComponent->transform = glm::mat4(glm::normalize(transformComponent->transform[0]),
-            glm::normalize(transformComponent->transform[1]),
-            glm::normalize(transformComponent->transform[2]),
-            transformComponent->transform[3]);
+    // respawning ships push onto the ship list while the AI runs, so queue the ships themselves
+    std::vector<Entity*> aiShips;
+    for (auto ship : pureEntityData->ships)
+    {
+        auto aiComponent = ship->GetComponent<Components::AI>();
+        auto aiInputComponent = ship->GetComponent<Components::AIinputController>();
+        auto transformComponent = ship->GetComponent<Components::TransformComponent>();
+        auto stateComponent = ship->GetComponent<Components::State>();
+        if (ship->eType != EntityType::EnemyShip || !aiComponent || !aiInputComponent || !transformComponent || !stateComponent || stateComponent->isDestroyed)
+            continue;
 
-        // Update the collider's transform with the updated mesh transform
-        Physics::SetTransform(colliderComponent->colliderID, transformComponent->transform);
+        glm::vec3 const toShip = glm::vec3(transformComponent->transform[3]) - playerPosition;
+        float const distance = glm::length(toShip);
+        bool const visible = player && distance > 0.0f && glm::dot(toShip / distance, playerForward) >= scheduler->viewConeCos;
+        bool const inCombat = aiInputComponent->currentState == AIState::ChasingEnemy || aiInputComponent->currentState == AIState::Fleeing;
+        aiComponent->lod = scheduler->Classify(player ? distance : 0.0f, visible, inCombat);
+        // unclamped, so a deferred ship keeps moving up the queue
+        aiComponent->timeSinceTick += dt;
 
+        scheduler->Add((int)aiShips.size(), (AIScheduler::Lod)aiComponent->lod, aiComponent->timeSinceTick);
+        aiShips.push_back(ship);
+    }
 
+    // sense for every ship that may tick, in one batch before any of them acts
+    std::vector<Entity*> sensingShips;
+    for (auto ship : aiShips)
+    {
+        auto aiComponent = ship->GetComponent<Components::AI>();
+        if (scheduler->IsDue((AIScheduler::Lod)aiComponent->lod, aiComponent->timeSinceTick))
+            sensingShips.push_back(ship);
     }
+    Perception::Instance()->Run((int)sensingShips.size(), [this, &sensingShips](int i)
+    {
+        SenseShip(sensingShips[i], sensingShips[i]->GetComponent<Components::AI>()->contacts);
+    });
+
+    // a ship's AI only ever destroys the ship itself, the others stay valid
+    scheduler->Run([this, &aiShips, scheduler](int agent)
+    {
+        Entity* ship = aiShips[agent];
+        auto aiComponent = ship->GetComponent<Components::AI>();
+        float const aiDt = std::min(aiComponent->timeSinceTick, scheduler->maxTickDt);
+        aiComponent->timeSinceTick = 0.0f;
+        UpdateAiShip(ship, aiDt);
+    });
 }
-inline void World::drawNode(Entity* entity)
+inline void World::UpdateSpatialHash()
 {
-    auto navNodeComponent = entity->GetComponent< Components::AINavNodeComponent>();
-    if (entity->eType == EntityType::Node) // nodes
+    spatialHash.Clear();
+    for (auto ship : pureEntityData->ships)
     {
-        int drawId = Core::CVarReadInt(navNodeComponent->r_draw_Node_Axis_id);
-        int drawBool = Core::CVarReadInt(navNodeComponent->r_draw_Node_Axis);
-        auto transformComponent = entity->GetComponent<Components::TransformComponent>();
-        if (drawId >= 0 && drawBool == 1)
-        {
-            for (size_t i = 0; i < pureEntityData->nodes.size(); i++)
-            {
-                if (entity->id == drawId)
-                {
-                    glm::vec3 pos = glm::vec3(transformComponent->transform[3]);
-
-                    // -X(Red)
-                    glm::vec3 dirXminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[0]), 0.0f);
-                    float lenXminus = glm::length(navNodeComponent->EndPoints[0]);
-                    Debug::DrawLine(pos, pos + dirXminus * lenXminus, 10.0f, glm::vec4(1, 0, 0, 1), glm::vec4(1, 0, 0, 1), Debug::RenderMode::AlwaysOnTop);
-
-                    // +X (Light Red)
-                    glm::vec3 dirXplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[1]), 0.0f);
-                    float lenXplus = glm::length(navNodeComponent->EndPoints[1]);
-                    Debug::DrawLine(pos, pos + dirXplus * lenXplus, 10.0f, glm::vec4(1.5f, 0.4f, 0.4f, 1), glm::vec4(1.5f, 0.4f, 0.4f, 1), Debug::RenderMode::AlwaysOnTop);
-
-                    // -Y (Green)
-                    glm::vec3 dirYminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[2]), 0.0f);
-                    float lenYminus = glm::length(navNodeComponent->EndPoints[2]);
-                    Debug::DrawLine(pos, pos + dirYminus * lenYminus, 10.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-
-                    // +Y (Light Green)
-                    glm::vec3 dirYplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[3]), 0.0f);
-                    float lenYplus = glm::length(navNodeComponent->EndPoints[3]);
-                    Debug::DrawLine(pos, pos + dirYplus * lenYplus, 10.0f, glm::vec4(0.4f, 1.5f, 0.4f, 1), glm::vec4(0.4f, 1.5f, 0.4f, 1), Debug::RenderMode::AlwaysOnTop);
-
-                    // -Z (Blue)
-                    glm::vec3 dirZminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[4]), 0.0f);
-                    float lenZminus = glm::length(navNodeComponent->EndPoints[4]);
-                    Debug::DrawLine(pos, pos + dirZminus * lenZminus, 10.0f, glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, 1, 1), Debug::RenderMode::AlwaysOnTop);
-
-                    // +Z (Light Blue)
-                    glm::vec3 dirZplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[5]), 0.0f);
-                    float lenZplus = glm::length(navNodeComponent->EndPoints[5]);
-                    Debug::DrawLine(pos, pos + dirZplus * lenZplus, 10.0f, glm::vec4(0.4f, 0.4f, 1.5f, 1), glm::vec4(0.4f, 0.4f, 1.5f, 1), Debug::RenderMode::AlwaysOnTop);
-                    Debug::DrawDebugText(std::to_string(entity->id).c_str(), entity->GetComponent<Components::TransformComponent>()->transform[3], { 0.9f,0.9f,1,1 });
-                }
-            }
-        }
+        auto transformComponent = ship->GetComponent<Components::TransformComponent>();
+        auto stateComponent = ship->GetComponent<Components::State>();
+        if (!transformComponent || !stateComponent || stateComponent->isDestroyed)
+            continue;
+        spatialHash.Insert(ship, ship->eType, glm::vec3(transformComponent->transform[3]));
+    }
+    for (auto asteroid : pureEntityData->Asteroids)
+    {
+        auto transformComponent = asteroid->GetComponent<Components::TransformComponent>();
+        if (!transformComponent)
+            continue;
+        spatialHash.Insert(asteroid, asteroid->eType, glm::vec3(transformComponent->transform[3]));
+    }
+    spatialHash.Build();
+}
+inline void World::SenseShip(Entity* ship, PerceptionContacts& contacts)
+{
+    Perception const* perception = Perception::Instance();
+    glm::vec3 const position = glm::vec3(ship->GetComponent<Components::TransformComponent>()->transform[3]);
 
-        if (drawId < 0 && drawBool == 1)
-        {
-            glm::vec3 pos = glm::vec3(transformComponent->transform[3]);
-
-            // -X(Red)
-            glm::vec3 dirXminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[0]), 0.0f);
-            float lenXminus = glm::length(navNodeComponent->EndPoints[0]);
-            Debug::DrawLine(pos, pos + dirXminus * lenXminus, 1.0f, glm::vec4(1, 0, 0, 1), glm::vec4(1, 0, 0, 1), Debug::RenderMode::AlwaysOnTop);
-
-            // +X (Light Red)
-            glm::vec3 dirXplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[1]), 0.0f);
-            float lenXplus = glm::length(navNodeComponent->EndPoints[1]);
-            Debug::DrawLine(pos, pos + dirXplus * lenXplus, 1.0f, glm::vec4(1.5f, 0.4f, 0.4f, 1), glm::vec4(1.5f, 0.4f, 0.4f, 1), Debug::RenderMode::AlwaysOnTop);
-
-            // -Y (Green)
-            glm::vec3 dirYminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[2]), 0.0f);
-            float lenYminus = glm::length(navNodeComponent->EndPoints[2]);
-            Debug::DrawLine(pos, pos + dirYminus * lenYminus, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-
-            // +Y (Light Green)
-            glm::vec3 dirYplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[3]), 0.0f);
-            float lenYplus = glm::length(navNodeComponent->EndPoints[3]);
-            Debug::DrawLine(pos, pos + dirYplus * lenYplus, 1.0f, glm::vec4(0.4f, 1.5f, 0.4f, 1), glm::vec4(0.4f, 1.5f, 0.4f, 1), Debug::RenderMode::AlwaysOnTop);
-
-            // -Z (Blue)
-            glm::vec3 dirZminus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[4]), 0.0f);
-            float lenZminus = glm::length(navNodeComponent->EndPoints[4]);
-            Debug::DrawLine(pos, pos + dirZminus * lenZminus, 1.0f, glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, 1, 1), Debug::RenderMode::AlwaysOnTop);
-
-            // +Z (Light Blue)
-            glm::vec3 dirZplus = transformComponent->transform * glm::vec4(glm::normalize(navNodeComponent->EndPoints[5]), 0.0f);
-            float lenZplus = glm::length(navNodeComponent->EndPoints[5]);
-            Debug::DrawLine(pos, pos + dirZplus * lenZplus, 1.0f, glm::vec4(0.4f, 0.4f, 1.5f, 1), glm::vec4(0.4f, 0.4f, 1.5f, 1), Debug::RenderMode::AlwaysOnTop);
-            // Debug::DrawDebugText(std::to_string(entity->id).c_str(), entity->GetComponent<Components::TransformComponent>()->transform[3], { 0.9f,0.9f,1,1 });
-        }
+    uint32_t const shipTypes = SpatialHash::TypeMask(EntityType::SpaceShip) | SpatialHash::TypeMask(EntityType::EnemyShip);
+    auto isLiveShip = [ship](Entity* other)
+    {
+        if (other == ship) return false;
+        auto stateComp = other->GetComponent<Components::State>();
+        return stateComp && !stateComp->isDestroyed && !stateComp->isRespawning;
+    };
+    spatialHash.QueryNearest(position, perception->maxContacts, perception->sensingRadius, shipTypes, isLiveShip, contacts.ships);
+    contacts.nearestShip = !contacts.ships.empty() ? contacts.ships[0].entity
+        : spatialHash.FindNearestIf(position, perception->targetRadius, shipTypes, isLiveShip);
 
-        // Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(transformComponent->transform[3]), dir, len);
+    contacts.threats.clear();
+    for (SpatialHit const& contact : contacts.ships)
+    {
+        auto otherInput = contact.entity->GetComponent<Components::AIinputController>();
+        if (otherInput && otherInput->target == ship)
+            contacts.threats.push_back(contact);
+    }
 
+    spatialHash.QueryNearest(position, perception->maxContacts, perception->obstacleRadius, SpatialHash::TypeMask(EntityType::Asteroid),
+        [](Entity*) { return true; }, contacts.obstacles);
+}
+inline void World::ForgetContact(Entity* ship)
+{
+    auto isShip = [ship](SpatialHit const& contact) { return contact.entity == ship; };
+    for (auto other : pureEntityData->ships)
+    {
+        auto aiComponent = other->GetComponent<Components::AI>();
+        if (!aiComponent)
+            continue;
+        PerceptionContacts& contacts = aiComponent->contacts;
+        contacts.ships.erase(std::remove_if(contacts.ships.begin(), contacts.ships.end(), isShip), contacts.ships.end());
+        contacts.threats.erase(std::remove_if(contacts.threats.begin(), contacts.threats.end(), isShip), contacts.threats.end());
+        if (contacts.nearestShip == ship)
+            contacts.nearestShip = contacts.ships.empty() ? nullptr : contacts.ships[0].entity;
     }
 }
-inline void World::draw(Entity* entity) // literally draw everything that renders
+inline void World::UpdateAsteroid(Entity* entity, float dt)
 {
-    auto renderableComponent = entity->GetComponent<Components::RenderableComponent>();
-    /* auto AIInputComponent = entity->GetComponent<Components::AINavNodeComponent>();*/
-    auto trans = entity->GetComponent<Components::TransformComponent>();
-    if (renderableComponent)
+    if (entity->eType == EntityType::Asteroid) // asteroids
     {
-        Render::RenderDevice::Draw(renderableComponent->modelId, entity->GetComponent<Components::TransformComponent>()->transform);
-        //Debug::DrawDebugText(std::to_string(renderableComponent->ownerId).c_str(), entity->GetComponent<Components::TransformComponent>()->transform[3], { 0.9f,0.9f,1,1 });
+        auto transformComponent = entity->GetComponent<Components::TransformComponent>();
+        auto rigidBodyComponent = entity->GetComponent<Components::RigidBodyComponent>();
+
+        // motion is integrated by the physics module, collider is already moved along with the body
+        transformComponent->transform = Physics::GetRigidBodyTransform(rigidBodyComponent->rigidBodyId);
+        transformComponent->orientation = glm::quat_cast(glm::mat3(transformComponent->transform));
     }
 }
-inline void World::updateCamera(Entity* entity, float dt)
+inline bool World::TestCellOccupancy(glm::vec3 const& position)
 {
+    const glm::vec3 Axes[6] =
+    {
+        glm::vec3(-1.0f, 0.0f, 0.0f),  // left
+        glm::vec3(1.0f, 0.0f, 0.0f),  // right
 
+        glm::vec3(0.0f, -1.0f, 0.0f),  // down
+        glm::vec3(0.0f, 1.0f, 0.0f),  // up
 
-    if (entity->eType == EntityType::SpaceShip || entity->eType == EntityType::EnemyShip)
+        glm::vec3(0.0f, 0.0f, -1.0f),  // backward
+        glm::vec3(0.0f, 0.0f, 1.0f),  // forward
+    };
+
+    Physics::ScopedQueryTag queryTag(Physics::QueryTag::NavBaking);
+    for (int i = 0; i < sizeof(Axes) / sizeof(glm::vec3); i++)
     {
-        // First pass: Check if the selected entity already has a camera
-        auto camComp = entity->GetComponent<Components::CameraComponent>();
+        Physics::RaycastPayload payload = Physics::Raycast(position, Axes[i], 1.0f, (uint16_t)CollisionLayer::ASTEROID);
 
-        if (camComp)
-        {
-            int selectedID(Core::CVarReadInt(camComp->r_camera_id));
-            int isPlayerOrEnemy(Core::CVarReadInt(camComp->r_camera));
+        // debug draw collision rays
+        //Debug::DrawLine(position, position + Axes[i], 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
+
+        // colliders carry their entity as user data
+        if (payload.hit)
+        {
+            Entity* hitEntity = (Entity*)Physics::GetUserData(payload.collider);
+            if (hitEntity && hitEntity->eType == EntityType::Asteroid)
+                return true;
+        }
+    }
+    return false;
+}
+inline void World::UpdateNavOccupancy()
+{
+    navCellsRetested = 0;
+    navCellsChanged = 0;
+    NavVolume& volume = pureEntityData->navVolume;
+    if (volume.NumCells() == 0)
+        return;
+
+    int const size = volume.GetSize();
+    navRetestMarks.resize(volume.NumCells(), 0);
+
+    // a cell only sees asteroids within reach of its rays, so only cells that close to an asteroid's
+    // bounds, now or last frame, can have changed
+    float const reach = 1.0f;
+    auto queueCells = [&](glm::ivec3 const& min, glm::ivec3 const& max)
+    {
+        for (int z = min.z; z <= max.z; z++)
+            for (int y = min.y; y <= max.y; y++)
+                for (int x = min.x; x <= max.x; x++)
+                {
+                    int const cell = x + y * size + z * size * size;
+                    if (!navRetestMarks[cell])
+                    {
+                        navRetestMarks[cell] = 1;
+                        navRetestCells.push_back(cell);
+                    }
+                }
+    };
+    for (auto asteroid : pureEntityData->Asteroids)
+    {
+        auto colliderComponent = asteroid->GetComponent<Components::ColliderComponent>();
+        if (!colliderComponent || !Physics::IsValid(colliderComponent->colliderID))
+            continue;
+
+        glm::vec3 boundsMin, boundsMax;
+        Physics::GetBounds(colliderComponent->colliderID, boundsMin, boundsMax);
+        glm::ivec3 cellsMin, cellsMax;
+        volume.CellRange(boundsMin - reach, boundsMax + reach, cellsMin, cellsMax);
+
+        // empty ranges queue nothing
+        queueCells(colliderComponent->navCellsMin, colliderComponent->navCellsMax);
+        queueCells(cellsMin, cellsMax);
+        colliderComponent->navCellsMin = cellsMin;
+        colliderComponent->navCellsMax = cellsMax;
+    }
+
+    navChangedCells.clear();
+    for (int cell : navRetestCells)
+    {
+        navRetestMarks[cell] = 0;
+        bool const blocked = TestCellOccupancy(volume.CellPosition(cell));
+        navCellsRetested++;
+        if (blocked != volume.IsBlocked(cell))
+        {
+            volume.SetBlocked(cell, blocked);
+            navCellsChanged++;
+            navChangedCells.push_back(cell);
+        }
+    }
+    navRetestCells.clear();
+    // one grid snapshot for all of this frame's changes
+    if (!navChangedCells.empty())
+        AstarAlgorithm::Instance()->UpdateCellOccupancy(navChangedCells);
+}
+inline void World::UpdateDistanceField()
+{
+    std::vector<DistanceObstacle> obstacles;
+    std::vector<Physics::ColliderId> obstacleColliders;
+    float const tolerance = 0.5f * distanceField.voxelSize;
+    for (auto asteroid : pureEntityData->Asteroids)
+    {
+        auto colliderComponent = asteroid->GetComponent<Components::ColliderComponent>();
+        auto transformComponent = asteroid->GetComponent<Components::TransformComponent>();
+        if (!colliderComponent || !transformComponent || !Physics::IsValid(colliderComponent->colliderID))
+            continue;
+
+        DistanceObstacle obstacle;
+        Physics::GetBounds(colliderComponent->colliderID, obstacle.boundsMin, obstacle.boundsMax);
+        obstacles.push_back(obstacle);
+        obstacleColliders.push_back(colliderComponent->colliderID);
+
+        // furthest any surface point moved since the bake, from the translation and the change of the axes
+        glm::mat4 const& baked = colliderComponent->fieldTransform;
+        glm::mat4 const& current = transformComponent->transform;
+        float const radius = 0.5f * (obstacle.boundsMax.x - obstacle.boundsMin.x);
+        float const scale = std::max(glm::length(glm::vec3(current[0])), 1e-6f);
+        float axisChange = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            axisChange = std::max(axisChange, glm::length(glm::vec3(current[i] - baked[i])));
+        }
+        float const drift = glm::length(glm::vec3(current[3] - baked[3])) + radius * axisChange / scale;
+        if (colliderComponent->inDistanceField && drift <= tolerance)
+            continue;
+
+        if (colliderComponent->inDistanceField)
+            distanceField.MarkDirty(colliderComponent->fieldBoundsMin, colliderComponent->fieldBoundsMax);
+        distanceField.MarkDirty(obstacle.boundsMin, obstacle.boundsMax);
+        colliderComponent->fieldTransform = current;
+        colliderComponent->fieldBoundsMin = obstacle.boundsMin;
+        colliderComponent->fieldBoundsMax = obstacle.boundsMax;
+        colliderComponent->inDistanceField = true;
+    }
+
+    distanceField.Rebake(obstacles, [&obstacleColliders](int obstacle, glm::vec3 const& position)
+    {
+        return Physics::GetSignedDistance(obstacleColliders[obstacle], position);
+    });
+}
+inline void World::UpdateLocalAvoidance(float dt)
+{
+    LocalAvoidance* avoidance = LocalAvoidance::Instance();
+    avoidance->Clear();
+
+    auto agentRadius = [](Components::ColliderComponent* collider)
+    {
+        if (!collider || !Physics::IsValid(collider->colliderID))
+            return 1.0f;
+        glm::vec3 boundsMin, boundsMax;
+        Physics::GetBounds(collider->colliderID, boundsMin, boundsMax);
+        return 0.5f * (boundsMax.x - boundsMin.x);
+    };
+
+    // AI ships take part, player ships are avoided but don't avoid back
+    std::vector<std::pair<Components::AIinputController*, int>> aiAgents;
+    for (auto ship : pureEntityData->ships)
+    {
+        auto transformComponent = ship->GetComponent<Components::TransformComponent>();
+        auto stateComponent = ship->GetComponent<Components::State>();
+        if (!transformComponent || !stateComponent || stateComponent->isDestroyed)
+            continue;
+
+        AvoidanceAgent agent;
+        agent.position = glm::vec3(transformComponent->transform[3]);
+        agent.radius = agentRadius(ship->GetComponent<Components::ColliderComponent>());
+        auto aiInputComponent = ship->GetComponent<Components::AIinputController>();
+        if (ship->eType == EntityType::EnemyShip && aiInputComponent)
+        {
+            agent.preferredVelocity = transformComponent->linearVelocity;
+            // lean away from asteroid surfaces within clearance, keeping the speed. Only ships whose
+            // perception found obstacles look closer
+            auto aiComponent = ship->GetComponent<Components::AI>();
+            float const speed = glm::length(agent.preferredVelocity);
+            if (aiComponent && !aiComponent->contacts.obstacles.empty() && speed > 0.0f)
+            {
+                glm::vec3 gradient(0.0f);
+                float surfaceDistance;
+                if (useDistanceField)
+                    surfaceDistance = distanceField.Sample(agent.position, gradient) - agent.radius;
+                else
+                {
+                    // the closest obstacle as a sphere
+                    Entity* asteroid = aiComponent->contacts.obstacles[0].entity;
+                    glm::vec3 const fromAsteroid = agent.position - glm::vec3(asteroid->GetComponent<Components::TransformComponent>()->transform[3]);
+                    float const centerDistance = glm::length(fromAsteroid);
+                    surfaceDistance = centerDistance - agentRadius(asteroid->GetComponent<Components::ColliderComponent>()) - agent.radius;
+                    if (centerDistance > 0.0f)
+                        gradient = fromAsteroid / centerDistance;
+                }
+                if (surfaceDistance < asteroidClearance && glm::dot(gradient, gradient) > 0.0f)
+                {
+                    float const push = 1.0f - std::max(surfaceDistance, 0.0f) / asteroidClearance;
+                    glm::vec3 const steered = agent.preferredVelocity + glm::normalize(gradient) * speed * push;
+                    if (glm::dot(steered, steered) > 0.0f)
+                        agent.preferredVelocity = glm::normalize(steered) * speed;
+                }
+            }
+            agent.velocity = aiInputComponent->hasAvoidanceVelocity ? aiInputComponent->avoidanceVelocity : transformComponent->linearVelocity;
+            agent.maxSpeed = std::max(glm::length(agent.preferredVelocity), aiInputComponent->currentSpeed);
+            aiAgents.push_back({ aiInputComponent, avoidance->AddAgent(agent) });
+        }
+        else
+        {
+            // player ships move ten times their linear velocity
+            agent.velocity = transformComponent->linearVelocity * 10.0f;
+            agent.avoids = false;
+            avoidance->AddAgent(agent);
+        }
+    }
+    if (!useLocalAvoidance || aiAgents.empty())
+    {
+        for (auto const& aiAgent : aiAgents)
+        {
+            aiAgent.first->hasAvoidanceVelocity = false;
+        }
+        return;
+    }
+
+    for (auto asteroid : pureEntityData->Asteroids)
+    {
+        auto transformComponent = asteroid->GetComponent<Components::TransformComponent>();
+        auto rigidBodyComponent = asteroid->GetComponent<Components::RigidBodyComponent>();
+        AvoidanceAgent agent;
+        agent.position = glm::vec3(transformComponent->transform[3]);
+        agent.velocity = rigidBodyComponent ? rigidBodyComponent->velocity : glm::vec3(0.0f);
+        agent.radius = agentRadius(asteroid->GetComponent<Components::ColliderComponent>());
+        agent.avoids = false;
+        avoidance->AddAgent(agent);
+    }
+
+    avoidance->Solve(dt);
+    for (auto const& aiAgent : aiAgents)
+    {
+        aiAgent.first->avoidanceVelocity = avoidance->GetVelocity(aiAgent.second);
+        aiAgent.first->hasAvoidanceVelocity = true;
+    }
+}
+inline void World::UpdateContacts()
+{
+    // ship transforms are set by the game code, so move their colliders along before testing
+    for (auto ship : pureEntityData->ships)
+    {
+        auto transformComponent = ship->GetComponent<Components::TransformComponent>();
+        auto colliderComponent = ship->GetComponent<Components::ColliderComponent>();
+        auto stateComponent = ship->GetComponent<Components::State>();
+        if (!transformComponent || !colliderComponent || !stateComponent || colliderComponent->colliderID == Physics::ColliderId::Invalid())
+            continue;
+
+        Physics::SetTransform(colliderComponent->colliderID, transformComponent->transform);
+        stateComponent->isCollidingAsteroids = false;
+    }
+
+    {
+        Physics::ScopedQueryTag queryTag(Physics::QueryTag::HitDetection);
+        Physics::Collide();
+    }
+
+    // colliders carry their entity as user data
+    for (auto const& manifold : Physics::GetContactManifolds())
+    {
+        Entity* asteroid = (Entity*)Physics::GetUserData(manifold.colliderA);
+        Entity* other = (Entity*)Physics::GetUserData(manifold.colliderB);
+        if (!asteroid || !other)
+            continue;
+        if (other->eType == EntityType::Asteroid)
+            std::swap(asteroid, other);
+        if (asteroid->eType != EntityType::Asteroid || other->eType == EntityType::Asteroid)
+            continue;
+
+        auto stateComponent = other->GetComponent<Components::State>();
+        if (stateComponent)
+            stateComponent->isCollidingAsteroids = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Spawns one projectile from each cannon into the shared pool, unless the
+    weapon is still cooling down.
+*/
+inline void World::FireWeapon(Entity* entity)
+{
+    auto weapon = entity->GetComponent<Components::WeaponComponent>();
+    auto transformComponent = entity->GetComponent<Components::TransformComponent>();
+    auto colliderComponent = entity->GetComponent<Components::ColliderComponent>();
+    if (!weapon || !transformComponent || weapon->cooldownTimer > 0.0f)
+        return;
+
+    glm::mat4 const& transform = transformComponent->transform;
+    glm::vec3 const muzzle = glm::vec3(transform[3] + transform[2] * weapon->canonForwardOffset);
+    glm::vec3 const side = glm::vec3(transform[0]) * weapon->canonOffset;
+    glm::vec3 const velocity = glm::normalize(glm::vec3(transform[2])) * weapon->projectileSpeed;
+    Physics::ColliderId const owner = colliderComponent ? colliderComponent->colliderID : Physics::ColliderId::Invalid();
+
+    ProjectileSystem* projectiles = ProjectileSystem::Instance();
+    weapon->leftProjectile = projectiles->Spawn(muzzle - side, velocity, weapon->projectileLifetime, owner, (uint16_t)CollisionLayer::SHIP);
+    weapon->rightProjectile = projectiles->Spawn(muzzle + side, velocity, weapon->projectileLifetime, owner, (uint16_t)CollisionLayer::SHIP);
+    weapon->cooldownTimer = weapon->cooldown;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Advances every live projectile in one pass and resolves the hits. Runs
+    after the ships have updated, so shots fired this frame are swept right
+    away. The cannon emitters then read their position back from the pool.
+*/
+inline void World::UpdateProjectiles(float dt)
+{
+    ProjectileSystem* projectiles = ProjectileSystem::Instance();
+    {
+        Physics::ScopedQueryTag queryTag(Physics::QueryTag::HitDetection);
+        projectiles->Update(dt);
+    }
+
+    for (ProjectileHit const& hit : projectiles->GetHits())
+    {
+        // an earlier hit this tick may already have destroyed the target
+        if (!Physics::IsValid(hit.target))
+            continue;
+        Entity* target = (Entity*)Physics::GetUserData(hit.target);
+        auto targetState = target ? target->GetComponent<Components::State>() : nullptr;
+        if (!targetState || targetState->isRespawning)
+            continue;
+
+        std::cout << "CANNON HIT! Ship ID: " << target->id << std::endl;
+
+        // AI shooters go back to roaming after a kill
+        if (Physics::IsValid(hit.owner))
+        {
+            Entity* owner = (Entity*)Physics::GetUserData(hit.owner);
+            auto ownerInput = owner ? owner->GetComponent<Components::AIinputController>() : nullptr;
+            if (ownerInput)
+                ownerInput->currentState = AIState::Roaming;
+        }
+
+        targetState->isRespawning = true;
+        if (target->eType == EntityType::EnemyShip)
+        {
+            savedEnemyIDs.push(target->id);
+            CreateEnemyShip(true);
+        }
+        else if (target->eType == EntityType::SpaceShip)
+        {
+            savedIDs.push(target->id);
+            CreatePlayerShip(true);
+        }
+        DestroyShip(target->id, target->eType);
+        DestroyEntity(target->id, target->eType);
+    }
+
+    // cannon emitters trail the newest shot of their cannon and stop once it is gone
+    auto followProjectile = [projectiles](Render::ParticleEmitter* emitter, ProjectileId projectile)
+    {
+        if (!projectiles->IsAlive(projectile))
+        {
+            emitter->data.looping = 0;
+            return;
+        }
+        glm::vec3 const velocity = projectiles->GetVelocity(projectile);
+        float const speed = glm::length(velocity);
+        emitter->data.origin = glm::vec4(projectiles->GetPosition(projectile), 1.0f);
+        emitter->data.dir = glm::vec4(-velocity / speed, 0);
+        emitter->data.startSpeed = -speed;
+        emitter->data.endSpeed = -speed;
+        emitter->data.randomTimeOffsetDist = 0.01f;
+        emitter->data.looping = 1;
+    };
+    for (auto ship : pureEntityData->ships)
+    {
+        auto weapon = ship->GetComponent<Components::WeaponComponent>();
+        auto particle = ship->GetComponent<Components::ParticleEmitterComponent>();
+        if (!weapon || !particle)
+            continue;
+
+        weapon->cooldownTimer = glm::max(weapon->cooldownTimer - dt, 0.0f);
+        followProjectile(particle->particleCanonLeft, weapon->leftProjectile);
+        followProjectile(particle->particleCanonRight, weapon->rightProjectile);
+    }
+}
+inline void World::drawNavVolume()
+{
+    NavVolume const& volume = pureEntityData->navVolume;
+    int drawId = Core::CVarReadInt(r_draw_Node_Axis_id);
+    int drawBool = Core::CVarReadInt(r_draw_Node_Axis);
+    if (drawBool != 1 || drawId >= volume.NumCells())
+        return;
+
+    // -X, +X, -Y, +Y, -Z, +Z, the positive axes lighter
+    const glm::vec3 Axes[6] =
+    {
+        glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+    };
+    const glm::vec4 Colors[6] =
+    {
+        glm::vec4(1, 0, 0, 1), glm::vec4(1.5f, 0.4f, 0.4f, 1),
+        glm::vec4(0, 1, 0, 1), glm::vec4(0.4f, 1.5f, 0.4f, 1),
+        glm::vec4(0, 0, 1, 1), glm::vec4(0.4f, 0.4f, 1.5f, 1),
+    };
+
+    // a single cell is drawn thick and labelled
+    int const first = drawId >= 0 ? drawId : 0;
+    int const last = drawId >= 0 ? drawId + 1 : volume.NumCells();
+    float const width = drawId >= 0 ? 10.0f : 1.0f;
+    for (int cell = first; cell < last; cell++)
+    {
+        glm::vec3 const pos = volume.CellPosition(cell);
+        for (int i = 0; i < 6; i++)
+        {
+            Debug::DrawLine(pos, pos + Axes[i], width, Colors[i], Colors[i], Debug::RenderMode::AlwaysOnTop);
+        }
+        if (drawId >= 0)
+            Debug::DrawDebugText(std::to_string(cell).c_str(), pos, { 0.9f,0.9f,1,1 });
+    }
+}
+inline void World::draw(Entity* entity) // literally draw everything that renders
+{
+    auto renderableComponent = entity->GetComponent<Components::RenderableComponent>();
+    auto trans = entity->GetComponent<Components::TransformComponent>();
+    if (renderableComponent)
+    {
+        Render::RenderDevice::Draw(renderableComponent->modelId, entity->GetComponent<Components::TransformComponent>()->transform);
+        //Debug::DrawDebugText(std::to_string(renderableComponent->ownerId).c_str(), entity->GetComponent<Components::TransformComponent>()->transform[3], { 0.9f,0.9f,1,1 });
+    }
+}
+inline void World::updateCamera(Entity* entity, float dt)
+{
+
+
+    if (entity->eType == EntityType::SpaceShip || entity->eType == EntityType::EnemyShip)
+    {
+        // First pass: Check if the selected entity already has a camera
+        auto camComp = entity->GetComponent<Components::CameraComponent>();
+
+        if (camComp)
+        {
+            int selectedID(Core::CVarReadInt(camComp->r_camera_id));
+            int isPlayerOrEnemy(Core::CVarReadInt(camComp->r_camera));
 
             // Check if the entity is selected and has a camera
             if ((isPlayerOrEnemy == 1 && entity->eType == EntityType::SpaceShip) ||
@@ -1884,61 +2202,30 @@ inline void World::wanderingState(Entity* entity, float dt)
     AstarAlgorithm* astar = AstarAlgorithm::Instance();
     Debug::DrawDebugText(std::to_string(entity->id).c_str(), transformComponent->transform[3], { 0.9f,0.9f,1,1 });
 
-    Components::TransformComponent* closeNodeTranscomp = nullptr;
     glm::vec3 targetDirection;
     glm::quat targetRotation;
     glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
 
+    if (pureEntityData->navVolume.NumCells() == 0)
+    {
+        std::cerr << "[wanderingState] ❌ No nav cells available, destroying ship ID " << entity->id << "\n";
+
+        savedEnemyIDs.push(entity->id);
+        stateComponent->isRespawning = true;
+        CreateEnemyShip(true);
+        DestroyShip(entity->id, entity->eType);
+        DestroyEntity(entity->id, entity->eType); // implement or use your existing removal logic
+        return;
+    }
+
     // Find the closest node
     if (!AIcomponent->closestNodeCalled)
     {
-       
         AIcomponent->closestNodeCalled = true;
         AIcomponent->closestNodeFromShip = getclosestNodeFromAIship(entity);
-        // Fallback if closestNodeFromShip was nullptr
-        if (!AIcomponent->closestNodeFromShip)
-        {
-            int randomIndex = rand() % pureEntityData->nodes.size();
-            AIcomponent->closestNodeFromShip = pureEntityData->nodes[randomIndex];
-            std::cout << "[AI] Count not find closest node, using Fallback node selected at random index " << randomIndex << " for ship ID " << entity->id << "\n";
-           
-        }
-
     }
-        closeNodeTranscomp = AIcomponent->closestNodeFromShip->GetComponent<Components::TransformComponent>();
-       
-    // Fallback if closestNodeFromShip was nullptr
-    if (!closeNodeTranscomp)
-    {
-        if (!pureEntityData->nodes.empty())
-        {
-            int randomIndex = rand() % pureEntityData->nodes.size();
-            closeNodeTranscomp = pureEntityData->nodes[randomIndex]->GetComponent<Components::TransformComponent>();
-            if (!closeNodeTranscomp)
-            {
-                std::cerr << "[wanderingState] ❌ Random node transform is nullptr, destroying ship ID " << entity->id << "\n";
-
-       
-                savedEnemyIDs.push(entity->id);
-                stateComponent->isRespawning = true;
-                CreateEnemyShip(true);
-                DestroyShip(entity->id, entity->eType);
-                DestroyEntity(entity->id, entity->eType); // implement or use your existing removal logic
-                return; // exit early
-            }
-        }
-        else
-        {
-            std::cerr << "[wanderingState] ❌ No nodes available, destroying ship ID " << entity->id << "\n";
+    glm::vec3 const startNodePos = pureEntityData->navVolume.CellPosition(AIcomponent->closestNodeFromShip);
 
-            savedEnemyIDs.push(entity->id);
-            stateComponent->isRespawning = true;
-            CreateEnemyShip(true);
-            DestroyShip(entity->id, entity->eType);
-            DestroyEntity(entity->id, entity->eType); // implement or use your existing removal logic
-            return;
-        }
-    }
     if (transformComponent && glm::any(glm::isnan(glm::vec3(transformComponent->transform[3]))))
     {
         std::cerr << "[wanderingState] ❌ Fallback node transform is NaN! Destroying ship ID " << entity->id << "\n";
@@ -1960,7 +2247,7 @@ inline void World::wanderingState(Entity* entity, float dt)
     // If the ship hasn't reached the start node, go to start node
     if (!AIcomponent->hasReachedTheStartNode)
     {
-        moveToStartNode(entity, closeNodeTranscomp, dt);
+        moveToStartNode(entity, startNodePos, dt);
     }
 
     // If the ship is following the path
@@ -2001,65 +2288,21 @@ inline void World::wanderingState(Entity* entity, float dt)
     updateShipMovementAndParticles(entity, dt);
 
 
-    //checking if the colliders close to 8.0 radius or less, ray casting will be activated
-    bool colliderIsClose = false;
-    Entity* closeEntity;
-    Components::TransformComponent* closeTComp;
-    auto shipPos = glm::vec3(transformComponent->transform[3]);
-    for (auto entityIn : pureEntityData->Asteroids)
-    {
-        closeTComp = entityIn->GetComponent<Components::TransformComponent>();
-        auto closestPos = glm::vec3(closeTComp->transform[3]);
-        auto closestposLenght = glm::length(closestPos - shipPos);
-        if (closestposLenght <= 8.0f && closeTComp != nullptr)
-        {
-
-            colliderIsClose = true;
-            closeEntity = entityIn;
-            break;
-        }
-    }
-
-   
-    for (int i = 0; i < colliderComponent->colliderEndPoints.size(); i++)
+    // the contact pass flagged this ship as touching an asteroid
+    if (stateComponent->isCollidingAsteroids)
     {
-        glm::vec3 pos = glm::vec3(transformComponent->transform[3]);
-        glm::vec3 dir = transformComponent->transform * glm::vec4(glm::normalize(colliderComponent->colliderEndPoints[i]), 0.0f);
-        float len = glm::length(colliderComponent->colliderEndPoints[i]);
-        int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
-        if (colliderIsClose)
-        {
-            if (menuIsUsingRayCasts == 1.0f)
-            {
-                Debug::DrawLine(pos, pos + dir * len, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-            }
-            Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(transformComponent->transform[3]), dir, len);
-            if (payload.hit)
-            {
-                Debug::DrawDebugText("HIT", payload.hitPoint, glm::vec4(1, 1, 1, 1));
-                auto entComp = closeEntity->GetComponent<Components::ColliderComponent>();
-                if (payload.collider == entComp->colliderID && closeEntity->eType == EntityType::Asteroid)
-                {
-                    // Stop particle emitters
-                    particleComponent->particleCanonLeft->data.looping = 0;
-                    particleComponent->particleCanonRight->data.looping = 0;
-
-                    // Save and flag for respawn
-                    savedEnemyIDs.push(entity->id);
+        // Stop particle emitters
+        particleComponent->particleCanonLeft->data.looping = 0;
+        particleComponent->particleCanonRight->data.looping = 0;
 
-                    stateComponent->isRespawning = true;
-
-                    CreateEnemyShip(stateComponent->isRespawning);
-                    DestroyShip(entity->id, entity->eType);
-                    DestroyEntity(entity->id, entity->eType);
-
-
-                    return;
-                }
-
-            }
-        }
+        // Save and flag for respawn
+        savedEnemyIDs.push(entity->id);
 
+        stateComponent->isRespawning = true;
+        CreateEnemyShip(stateComponent->isRespawning);
+        DestroyShip(entity->id, entity->eType);
+        DestroyEntity(entity->id, entity->eType);
+        return;
     }
 
 
@@ -2100,24 +2343,7 @@ inline void World::attackState(Entity* entity, float dt)
     // --- Find a new target if needed ---
     if (!targetShip)
     {
-        float minDistSq = std::numeric_limits<float>::max();
-        for (auto ship : pureEntityData->ships)
-        {
-            if (ship == entity) continue; // skip self
-
-            auto stateComp = ship->GetComponent<Components::State>();
-            if (!stateComp || stateComp->isDestroyed || stateComp->isRespawning) continue;
-
-            auto tComp = ship->GetComponent<Components::TransformComponent>();
-            if (!tComp) continue;
-
-            float distSq = glm::length2(glm::vec3(tComp->transform[3]) - currentPos);
-            if (distSq < minDistSq)
-            {
-                minDistSq = distSq;
-                targetShip = ship;
-            }
-        }
+        targetShip = entity->GetComponent<Components::AI>()->contacts.nearestShip;
 
         if (!targetShip)
         {
@@ -2161,6 +2387,16 @@ inline void World::attackState(Entity* entity, float dt)
 
     glm::vec3 desiredDir = glm::normalize(toTarget);
 
+    // --- Further than a node away, follow the target's flow field around blocked nodes ---
+    // every ship chasing the same target samples the same field
+    const float flowFieldRange = 30.0f;
+    if (dist > flowFieldRange)
+    {
+        glm::vec3 flow = AstarAlgorithm::Instance()->FlowDirection(currentPos, glm::vec3(targetTransform->transform[3]));
+        if (flow != glm::vec3(0))
+            desiredDir = flow;
+    }
+
     // --- Debug line to target ---
     Debug::DrawLine(currentPos, glm::vec3(targetTransform->transform[3]), 1.0f,
         glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, 1, 1));
@@ -2182,220 +2418,30 @@ inline void World::attackState(Entity* entity, float dt)
     const float shootRange = 30.0f;
     aiInput->isShooting = (dist <= shootRange);
 
-    // --- Cannon base positions (for reset + initialization) ---
-    const float CanonPosOffset = 0.365f;
-    glm::vec3 leftOrigin = glm::vec3(transformComponent->transform[3] + transformComponent->transform[0] * -CanonPosOffset + transformComponent->transform[2] * particle->canonEmitterOffset);
-    glm::vec3 rightOrigin = glm::vec3(transformComponent->transform[3] + transformComponent->transform[0] * CanonPosOffset + transformComponent->transform[2] * particle->canonEmitterOffset);
-
-    if (particle->travelLeft == 0.0f) particle->leftCanonPos = leftOrigin;
-    if (particle->travelRight == 0.0f) particle->rightCanonPos = rightOrigin;
-
-    particle->particleCanonLeft->data.randomTimeOffsetDist = 0.01;
-    particle->particleCanonRight->data.randomTimeOffsetDist = 0.01;
-    particle->particleCanonLeft->data.startSpeed = -50.0f;
-    particle->particleCanonLeft->data.endSpeed = -50.0f;
-    particle->particleCanonRight->data.startSpeed = -50.0f;
-    particle->particleCanonRight->data.endSpeed = -50.0f;
-
-    const float maxDistance = 5000.0f;
-
     // --- Firing logic ---
     if (aiInput->isShooting)
-    {
-        particle->particleCanonLeft->data.looping = 1;
-        particle->particleCanonRight->data.looping = 1;
-        particle->hasFired = true;
-    }
-
-    // --- Bullet simulation ---
-    if (particle->hasFired)
-    {
-        Entity* closestEntity = nullptr;
-        Components::TransformComponent* closestTComp = nullptr;
+        FireWeapon(entity);
 
-        // Set direction once per shot
-        if (particle->travelLeft == 0.0f)
-            particle->particleCanonLeft->data.dir = glm::vec4(-glm::vec3(transformComponent->transform[2]), 0);
-        if (particle->travelRight == 0.0f)
-            particle->particleCanonRight->data.dir = glm::vec4(-glm::vec3(transformComponent->transform[2]), 0);
-
-        glm::vec3 leftDir = glm::normalize(glm::vec3(particle->particleCanonLeft->data.dir));
-        glm::vec3 rightDir = glm::normalize(glm::vec3(particle->particleCanonRight->data.dir));
-
-        float speedLeft = particle->particleCanonLeft->data.startSpeed;
-        float speedRight = particle->particleCanonRight->data.startSpeed;
-
-        // Move projectiles
-        particle->leftCanonPos += leftDir * speedLeft * dt;
-        particle->rightCanonPos += rightDir * speedRight * dt;
-
-        particle->travelLeft += glm::abs(speedLeft) * dt * 500.0f;
-        particle->travelRight += glm::abs(speedRight) * dt * 500.0f;
-
-        // --- Find closest target ---
-        const float hitRadius = 2.0f;
-        float minDistSq = std::numeric_limits<float>::max();
-
-        for (auto entityIn : pureEntityData->ships)
-        {
-            if (entityIn == entity) 
-                continue; // skip self
-            auto tComp = entityIn->GetComponent<Components::TransformComponent>();
-            if (!tComp)
-                continue;
-
-            glm::vec3 targetPos = glm::vec3(tComp->transform[3]);
-            // Check distance to both bullets
-            float leftDistSq = glm::length2(targetPos - particle->leftCanonPos);
-            float rightDistSq = glm::length2(targetPos - particle->rightCanonPos);
-            float currentMinDistSq = std::min(leftDistSq, rightDistSq);
-
-
-            if (currentMinDistSq < minDistSq)
-            {
-                minDistSq = currentMinDistSq;
-                closestEntity = entityIn;
-    
-            }
-        }
-
-        bool colliderIsClose = (closestEntity && glm::sqrt(minDistSq) < 2.0f);
-
-        // Debug bullet paths
-        Debug::DrawLine(particle->leftCanonPos, particle->leftCanonPos + leftDir * 200.0f, 1.0f, glm::vec4(1, 0, 0, 1), glm::vec4(1, 0, 0, 1));
-        Debug::DrawLine(particle->rightCanonPos, particle->rightCanonPos + rightDir * 200.0f, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1));
-
-        // --- Hit logic ---
-        if (closestEntity)
-        {
-            auto* closestEntityStateComp = closestEntity->GetComponent<Components::State>();
-
-            if (colliderIsClose && closestEntity != entity && !closestEntityStateComp->isRespawning)
-            {
-                if (closestEntity->eType == EntityType::EnemyShip || closestEntity->eType == EntityType::SpaceShip && closestEntity)
-                {
-                    std::cout << "AI CANNON HIT TARGET! Ship ID: " << closestEntity->id << std::endl;
-
-
-
-                    // Respawn only enemies
-                    if (closestEntity->eType == EntityType::EnemyShip)
-                    {
-                        if (closestEntityStateComp->isRespawning) return; // stop if already respawning
-                        savedEnemyIDs.push(closestEntity->id);
-                        closestEntityStateComp->isRespawning = true;
-                        CreateEnemyShip(true);
-
-
-
-                    }
-                    // Respawn only players
-                    if (closestEntity->eType == EntityType::SpaceShip)
-                    {
-                        if (closestEntityStateComp->isRespawning) return; // stop if already respawning
-                        savedIDs.push(closestEntity->id);
-                        closestEntityStateComp->isRespawning = true;
-                         CreatePlayerShip(true);
-
-
-                    }
-
-                    // Destroy logic
-                    DestroyShip(closestEntity->id, closestEntity->eType);
-                    DestroyEntity(closestEntity->id, closestEntity->eType);
-
-                    // Reset particle cannon
-                    particle->hasFired = false;
-                    particle->leftCanonPos = leftOrigin;
-                    particle->rightCanonPos = rightOrigin;
-                    particle->travelLeft = 0.0f;
-                    particle->travelRight = 0.0f;
-                    particle->particleCanonLeft->data.looping = 0;
-                    particle->particleCanonRight->data.looping = 0;
-                }
-                //return out of here after killing
-                aiInput->currentState = AIState::Roaming;
-                return;
-            }
-
-            // Reset if bullet exceeds range
-            if (particle->travelLeft >= maxDistance || particle->travelRight >= maxDistance)
-            {
-                particle->leftCanonPos = leftOrigin;
-                particle->rightCanonPos = rightOrigin;
-                particle->travelLeft = 0.0f;
-                particle->travelRight = 0.0f;
-                particle->hasFired = false;
-                particle->particleCanonLeft->data.looping = 0;
-                particle->particleCanonRight->data.looping = 0;
-            }
-        }
-
-        // Update emitter origins
-        particle->particleCanonLeft->data.origin = glm::vec4(particle->leftCanonPos, 1.0f);
-        particle->particleCanonRight->data.origin = glm::vec4(particle->rightCanonPos, 1.0f);
-
-        // --- Switch back to wandering if target too far ---
-        if (dist > 80.0f)
-            aiInput->currentState = AIState::Roaming;
-        }
-
-        //checking  collider asteroids
-        bool colliderIsClose = false;
-        Entity* closeEntity;
-        Components::TransformComponent* closeTComp;
-        auto shipPos = glm::vec3(transformComponent->transform[3]);
-        for (auto entityIn : pureEntityData->Asteroids)
-        {
-            closeTComp = entityIn->GetComponent<Components::TransformComponent>();
-            auto closestPos = glm::vec3(closeTComp->transform[3]);
-            auto closestposLenght = glm::length(closestPos - shipPos);
-            if (closestposLenght <= 8.0f && closeTComp != nullptr)
-            {
-
-                colliderIsClose = true;
-                closeEntity = entityIn;
-                break;
-            }
-        }
+    // --- Switch back to wandering if target too far ---
+    if (dist > 80.0f)
+        aiInput->currentState = AIState::Roaming;
 
-        for (int i = 0; i < colliderComponent->colliderEndPoints.size(); i++)
-        {
-            glm::vec3 pos = glm::vec3(transformComponent->transform[3]);
-            glm::vec3 dir = transformComponent->transform * glm::vec4(glm::normalize(colliderComponent->colliderEndPoints[i]), 0.0f);
-            float len = glm::length(colliderComponent->colliderEndPoints[i]);
-            int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
-            if (colliderIsClose)
-            {
-                if (menuIsUsingRayCasts == 1.0f)
-                {
-                    Debug::DrawLine(pos, pos + dir * len, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-                }
-                Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(transformComponent->transform[3]), dir, len);
-                if (payload.hit)
-                {
-                    Debug::DrawDebugText("HIT", payload.hitPoint, glm::vec4(1, 1, 1, 1));
-                    auto entComp = closeEntity->GetComponent<Components::ColliderComponent>();
-                    if (payload.collider == entComp->colliderID && closeEntity->eType == EntityType::Asteroid)
-                    {
-                        // Stop particle emitters
-                        particle->particleCanonLeft->data.looping = 0;
-                        particle->particleCanonRight->data.looping = 0;
-
-                        // Save and flag for respawn
-                        savedEnemyIDs.push(entity->id);
-
-                        stateComponent->isRespawning = true;
-                        CreateEnemyShip(stateComponent->isRespawning);
-                        DestroyShip(entity->id, entity->eType);
-                        DestroyEntity(entity->id, entity->eType);
-                        return;
-                    }
+    // crashed into an asteroid
+    if (stateComponent->isCollidingAsteroids)
+    {
+        // Stop particle emitters
+        particle->particleCanonLeft->data.looping = 0;
+        particle->particleCanonRight->data.looping = 0;
 
-                }
-            }
+        // Save and flag for respawn
+        savedEnemyIDs.push(entity->id);
 
-        }
+        stateComponent->isRespawning = true;
+        CreateEnemyShip(stateComponent->isRespawning);
+        DestroyShip(entity->id, entity->eType);
+        DestroyEntity(entity->id, entity->eType);
+        return;
+    }
   
 }
 inline void World::fleeingState(Entity* entity, float dt)
@@ -2428,22 +2474,7 @@ inline void World::fleeingState(Entity* entity, float dt)
     Entity* targetShip = static_cast<Entity*>(aiInput->target);
     if (!targetShip)
     {
-        float minDistSq = std::numeric_limits<float>::max();
-        targetShip = nullptr;
-        for (auto ship : pureEntityData->ships)
-        {
-            if ((ship->eType == EntityType::EnemyShip || ship->eType == EntityType::SpaceShip) && ship != entity)
-            {
-                auto tComp = ship->GetComponent<Components::TransformComponent>();
-                if (!tComp) continue;
-                float distSq = glm::length2(glm::vec3(tComp->transform[3]) - currentPos);
-                if (distSq < minDistSq)
-                {
-                    minDistSq = distSq;
-                    targetShip = ship;
-                }
-            }
-        }
+        targetShip = entity->GetComponent<Components::AI>()->contacts.nearestShip;
         aiInput->target = targetShip;
     }
     if (!aiInput->target)
@@ -2462,16 +2493,29 @@ inline void World::fleeingState(Entity* entity, float dt)
     float dist = glm::length(toTarget);
     if (dist < 0.001f) return;
 
-    // --- Stop fleeing if target is far enough ---
+    // --- Stop fleeing once the target is far enough and nothing else is chasing ---
     float fleeRadius = 80.0f; // tweak as needed
-    if (dist > fleeRadius)
+    if (dist > fleeRadius && entity->GetComponent<Components::AI>()->contacts.threats.empty())
     {
         aiInput->currentState = AIState::Roaming;
         aiInput->target = nullptr;
         return;
     }
 
-    glm::vec3 desiredDir = -glm::normalize(toTarget); // flee direction (opposite)
+    // --- Direction away from the target and every other ship chasing this one, closer ones count more ---
+    PerceptionContacts const& contacts = entity->GetComponent<Components::AI>()->contacts;
+    glm::vec3 away = -toTarget / (dist * dist);
+    for (SpatialHit const& threat : contacts.threats)
+    {
+        auto threatTransform = threat.entity->GetComponent<Components::TransformComponent>();
+        if (threat.entity == targetShip || !threatTransform)
+            continue;
+        glm::vec3 const fromThreat = currentPos - glm::vec3(threatTransform->transform[3]);
+        float const threatDistance = glm::length(fromThreat);
+        if (threatDistance > 0.001f)
+            away += fromThreat / (threatDistance * threatDistance);
+    }
+    glm::vec3 desiredDir = glm::dot(away, away) > 0.0f ? glm::normalize(away) : -toTarget / dist; // flee direction
 
     // --- Debug draw ---
     Debug::DrawLine(currentPos, currentPos + desiredDir * 10.0f, 1.0f,
@@ -2492,64 +2536,24 @@ inline void World::fleeingState(Entity* entity, float dt)
     // Optional: disable shooting while fleeing
     aiInput->isShooting = false;
 
-    //checking  collider asteroids
-    bool colliderIsClose = false;
-    Entity* closeEntity;
-    Components::TransformComponent* closeTComp;
-    auto shipPos = glm::vec3(transform->transform[3]);
-    for (auto entityIn : pureEntityData->Asteroids)
-    {
-        closeTComp = entityIn->GetComponent<Components::TransformComponent>();
-        auto closestPos = glm::vec3(closeTComp->transform[3]);
-        auto closestposLenght = glm::length(closestPos - shipPos);
-        if (closestposLenght <= 8.0f && closeTComp != nullptr)
-        {
-
-            colliderIsClose = true;
-            closeEntity = entityIn;
-            break;
-        }
-    }
-
-    for (int i = 0; i < collider->colliderEndPoints.size(); i++)
+    // crashed into an asteroid
+    if (stateComponent->isCollidingAsteroids)
     {
-        glm::vec3 pos = glm::vec3(transform->transform[3]);
-        glm::vec3 dir = transform->transform * glm::vec4(glm::normalize(collider->colliderEndPoints[i]), 0.0f);
-        float len = glm::length(collider->colliderEndPoints[i]);
-        int menuIsUsingRayCasts(Core::CVarReadInt(collider->r_Raycasts));
-        if (colliderIsClose)
-        {
-            if (menuIsUsingRayCasts == 1.0f)
-            {
-                Debug::DrawLine(pos, pos + dir * len, 1.0f, glm::vec4(0, 1, 0, 1), glm::vec4(0, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
-            }
-            Physics::RaycastPayload payload = Physics::Raycast(glm::vec3(transform->transform[3]), dir, len);
-            if (payload.hit)
-            {
-                Debug::DrawDebugText("HIT", payload.hitPoint, glm::vec4(1, 1, 1, 1));
-                auto entComp = closeEntity->GetComponent<Components::ColliderComponent>();
-                if (payload.collider == entComp->colliderID && closeEntity->eType == EntityType::Asteroid)
-                {
-                    // Stop particle emitters
-                    particle->particleCanonLeft->data.looping = 0;
-                    particle->particleCanonRight->data.looping = 0;
-
-                    // Save and flag for respawn
-                    savedEnemyIDs.push(entity->id);
-
-                    stateComponent->isRespawning = true;
-                    CreateEnemyShip(stateComponent->isRespawning);
-                    DestroyShip(entity->id, entity->eType);
-                    DestroyEntity(entity->id, entity->eType);
-                    return;
-                }
+        // Stop particle emitters
+        particle->particleCanonLeft->data.looping = 0;
+        particle->particleCanonRight->data.looping = 0;
 
-            }
-        }
+        // Save and flag for respawn
+        savedEnemyIDs.push(entity->id);
 
+        stateComponent->isRespawning = true;
+        CreateEnemyShip(stateComponent->isRespawning);
+        DestroyShip(entity->id, entity->eType);
+        DestroyEntity(entity->id, entity->eType);
+        return;
     }
 }
-inline void World::moveToStartNode(Entity* entity, Components::TransformComponent* startNode, float dt)
+inline void World::moveToStartNode(Entity* entity, glm::vec3 const& startNodePos, float dt)
 {
     auto aiInputComponent = entity->GetComponent<Components::AIinputController>();
     auto transformComponent = entity->GetComponent<Components::TransformComponent>();
@@ -2560,28 +2564,33 @@ inline void World::moveToStartNode(Entity* entity, Components::TransformComponen
 
     AstarAlgorithm* astar = AstarAlgorithm::Instance();
 
-    Components::TransformComponent* closeNodeTranscomp = startNode;
     glm::vec3 targetDirection;
     glm::quat targetRotation;
     glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
 
-    glm::vec3 targetPos = glm::vec3(closeNodeTranscomp->transform[3]);
+    glm::vec3 targetPos = startNodePos;
     glm::vec3 fromCurrent2Target = targetPos - currentPos;
     float distance = glm::dot(fromCurrent2Target, fromCurrent2Target);
 
     int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
     if (menuIsUsingRayCasts == 1.0f)
     {
-        Debug::DrawLine(transformComponent->transform[3], closeNodeTranscomp->transform[3], 1.0f, glm::vec4(1, 1, 0, 1), glm::vec4(1, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
+        Debug::DrawLine(transformComponent->transform[3], startNodePos, 1.0f, glm::vec4(1, 1, 0, 1), glm::vec4(1, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
     }
 
     if (distance <= 40.0f &&  AIcomponent->path.empty()) // automatic waypoint system
     {
-         AIcomponent->hasReachedTheStartNode = true;
-
-        // Request the actual path
-        auto randomDestination = randomGetNode();
-         AIcomponent->path = astar->findPath( AIcomponent->closestNodeFromShip, randomDestination);
+        // Request the actual path, it is solved on the path workers
+        if (!AIcomponent->pathRequest.valid())
+        {
+            auto randomDestination = randomGetNode();
+            AIcomponent->pathRequest = astar->RequestPath(AIcomponent->closestNodeFromShip, randomDestination);
+        }
+        else if (AIcomponent->pathRequest.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            AIcomponent->path = astar->ResolvePath(AIcomponent->pathRequest.get());
+            AIcomponent->hasReachedTheStartNode = !AIcomponent->path.empty();
+        }
     }
 
     else
@@ -2618,29 +2627,15 @@ inline void World::drawPath(Entity* entity)
 {
     auto* AIcomponent = entity->GetComponent<Components::AI>();
     // Draw the path
-    for (auto node : AIcomponent->path)
+    for (size_t i = 1; i < AIcomponent->path.size(); i++)
     {
-        auto aiComp = node->GetComponent<Components::AINavNodeComponent>();
-        int menuIsUsingDrawPath(Core::CVarReadInt(aiComp->r_draw_path));
-        if (menuIsUsingDrawPath)
-        {
-            auto* nodeAI = node->GetComponent<Components::AI>();
-
-            auto* nextNode = nodeAI->parentNode;
-            auto currentNode = node;
-
-            if (nextNode != nullptr)
-            {
-                auto transformComponentdestNode = nextNode->GetComponent<Components::TransformComponent>();
-                auto transformComponentprevNode = currentNode->GetComponent<Components::TransformComponent>();
-                Debug::DrawLine(transformComponentprevNode->transform[3], transformComponentdestNode->transform[3], 1.0f, glm::vec4(0, 1, 1, 1), glm::vec4(0, 1, 1, 1), Debug::RenderMode::AlwaysOnTop);
-            }
-        }
-        else
-        {
+        int menuIsUsingDrawPath(Core::CVarReadInt(r_draw_path));
+        if (!menuIsUsingDrawPath)
             break;
-        }
 
+        glm::vec3 prevNodePos = pureEntityData->navVolume.CellPosition(AIcomponent->path[i - 1]);
+        glm::vec3 destNodePos = pureEntityData->navVolume.CellPosition(AIcomponent->path[i]);
+        Debug::DrawLine(prevNodePos, destNodePos, 1.0f, glm::vec4(0, 1, 1, 1), glm::vec4(0, 1, 1, 1), Debug::RenderMode::AlwaysOnTop);
     }
 }
 inline void World::resetPath(Entity* entity)
@@ -2648,8 +2643,9 @@ inline void World::resetPath(Entity* entity)
     auto aiComp = entity->GetComponent<Components::AI>();
     aiComp->closestNodeCalled = false;
     aiComp->path.clear();
+    aiComp->pathRequest = {};
     aiComp->hasReachedTheStartNode = false;
-    aiComp->closestNodeFromShip = nullptr;
+    aiComp->closestNodeFromShip = -1;
     aiComp->pathIndex = 0;
 }
 inline void World::followPath(Entity* entity, float dt)
@@ -2667,15 +2663,13 @@ inline void World::followPath(Entity* entity, float dt)
     glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
 
     auto currentPos = glm::vec3(transformComponent->transform[3]);
-    Entity* nextNode =  AIcomponent->path[ AIcomponent->pathIndex];
-    auto nextTransform = nextNode->GetComponent<Components::TransformComponent>();
-    glm::vec3 targetPos = glm::vec3(nextTransform->transform[3]);
+    glm::vec3 targetPos = pureEntityData->navVolume.CellPosition(AIcomponent->path[AIcomponent->pathIndex]);
     glm::vec3 fromCurrent2Target = targetPos - currentPos;
     float distance = glm::dot(fromCurrent2Target, fromCurrent2Target);
     int menuIsUsingRayCasts(Core::CVarReadInt(colliderComponent->r_Raycasts));
     if (menuIsUsingRayCasts == 1.0f)
     {
-        Debug::DrawLine(transformComponent->transform[3], nextTransform->transform[3], 1.0f, glm::vec4(1, 1, 0, 1), glm::vec4(1, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
+        Debug::DrawLine(transformComponent->transform[3], targetPos, 1.0f, glm::vec4(1, 1, 0, 1), glm::vec4(1, 1, 0, 1), Debug::RenderMode::AlwaysOnTop);
     }
     // If close enough to the target node
     if (distance <= 40.0f)
@@ -2748,7 +2742,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     // --- Decide behavior based on state ---
     float targetSpeed = aiInput->normalSpeed;
     float rotationFactor = 0.5f;   // base smoothing
-    bool isAggressive = false;
 
     switch (aiInput->currentState)
     {
@@ -2756,7 +2749,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     {
         targetSpeed *= 10.0f;        // full speed
         rotationFactor = 10.0f;      // rotate faster toward target
-        isAggressive = false;
         break;
     }
         
@@ -2764,7 +2756,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     {
         targetSpeed *= 12.0f;        // full speed
         rotationFactor = 10.0f;      // rotate faster toward target
-        isAggressive = true;
         break;
     }
       
@@ -2773,7 +2764,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     {
          targetSpeed *= 10.0f;        // full speed
         rotationFactor = 10.0f;      // rotate faster toward target
-        isAggressive = false;
         break;
     }
        
@@ -2800,7 +2790,8 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     );
 
     // Apply movement – FIX: Removed dt * 10.0f
-    transform->transform[3] += glm::vec4(transform->linearVelocity * dt, 0.0f);
+    glm::vec3 velocity = aiInput->hasAvoidanceVelocity ? aiInput->avoidanceVelocity : transform->linearVelocity;
+    transform->transform[3] += glm::vec4(velocity * dt, 0.0f);
 
 
     // ================================================
@@ -2829,7 +2820,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     // PARTICLE UPDATE (unchanged, clean)
     // ================================================
     const float thrusterOffset = 0.365f;
-    const float canonOffset = 0.365f;
     float speedFactor = aiInput->currentSpeed / aiInput->normalSpeed;
 
     // Thrusters
@@ -2850,37 +2840,6 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
     particle->particleEmitterRight->data.endSpeed = 0.0f + 3.0f * speedFactor;
 
 
-    // ================================================
-    //  CANNON PARTICLES (unchanged)
-    // ================================================
-    particle->particleCanonLeft->data.origin =
-        glm::vec4(glm::vec3(transform->transform[3] + transform->transform[0] * -canonOffset +
-            transform->transform[2] * particle->canonEmitterOffset), 1);
-
-    particle->particleCanonRight->data.origin =
-        glm::vec4(glm::vec3(transform->transform[3] + transform->transform[0] * canonOffset +
-            transform->transform[2] * particle->canonEmitterOffset), 1);
-
-    particle->particleCanonLeft->data.dir = glm::vec4(-glm::vec3(transform->transform[2]), 0);
-    particle->particleCanonRight->data.dir = glm::vec4(-glm::vec3(transform->transform[2]), 0);
-
-    if (aiInput->isShooting && isAggressive)
-    {
-        particle->particleCanonLeft->data.looping = 1;
-        particle->particleCanonRight->data.looping = 1;
-
-        particle->particleCanonLeft->data.startSpeed = -500.0f;
-        particle->particleCanonRight->data.startSpeed = -500.0f;
-        particle->particleCanonLeft->data.endSpeed = -500.0f;
-        particle->particleCanonRight->data.endSpeed = -500.0f;
-    }
-    else
-    {
-        particle->particleCanonLeft->data.looping = 0;
-        particle->particleCanonRight->data.looping = 0;
-    }
-
-
     // ================================================
     //  CAMERA UPDATE (unchanged)
     // ================================================
@@ -2899,22 +2858,10 @@ inline void World::updateShipMovementAndParticles(Entity* entity, float dt)
 }
 inline bool World::IsShipNearby(Entity* entity, float detectionRadius, Entity*& outShip)
 {
-    glm::vec3 shipPos = glm::vec3(entity->GetComponent<Components::TransformComponent>()->transform[3]);
-
-    for (auto other : pureEntityData->ships) // or whatever container holds other ships
-    {
-        if (other == entity) continue; // skip self
-
-        auto otherTrans = other->GetComponent<Components::TransformComponent>();
-        glm::vec3 otherPos = glm::vec3(otherTrans->transform[3]);
-        float distance = glm::length(otherPos - shipPos);
-
-        if (distance <= detectionRadius)
-        {
-            outShip = other;
-            return true;
-        }
-    }
-
-    return false;
+    // contacts are sorted, the closest one decides
+    PerceptionContacts const& contacts = entity->GetComponent<Components::AI>()->contacts;
+    if (contacts.ships.empty() || contacts.ships[0].distance > detectionRadius)
+        return false;
+    outShip = contacts.ships[0].entity;
+    return true;
 }
\ No newline at end of file
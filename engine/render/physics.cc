@@ -9,35 +9,498 @@
 #include "debugrender.h"
 #include "core/random.h"
 #include "core/cvar.h"
+#include "gtx/norm.hpp"
 #include <iostream>
+#include <unordered_map>
+#include <cfloat>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 namespace Physics
 {
 
+//------------------------------------------------------------------------------
+/**
+    Read only view of a whole file mapped into memory.
+*/
+struct MappedFile
+{
+    void const* data = nullptr;
+    size_t size = 0;
+#if _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+//------------------------------------------------------------------------------
+/**
+    Indexed triangle mesh with 16 bit vertex coordinates relative to the mesh
+    bounds, position = boundsMin + vertex * boundsScale. Queries run directly in
+    this quantized space and derive triangle normals on the fly.
+
+    The vertex and index buffers are views, either into a mapped cooked file or
+    into the owned vectors when the mesh was built at runtime. The vertices are
+    unique, so they double as the point set whose hull the narrowphase uses.
+*/
 struct ColliderMesh
 {
-    struct Triangle
+    struct Vertex
     {
-        glm::vec3 vertices[3];
-        glm::vec3 normal;
+        uint16_t x, y, z;
     };
-    std::vector<Triangle> tris;
+    Vertex const* vertices = nullptr;
+    uint32_t numVertices = 0;
+    /// three per triangle
+    uint16_t const* indices = nullptr;
+    uint32_t numTris = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsScale = glm::vec3(0.0f);
+    glm::vec3 invBoundsScale = glm::vec3(0.0f);
+    float bSphereRadius = 0.0f;
+    /// signed distance to the surface at distanceGridSize^3 points over the padded bounds, x fastest
+    float const* distances = nullptr;
+    uint32_t distanceGridSize = 0;
+
+    MappedFile file;
+    std::vector<Vertex> ownedVertices;
+    std::vector<uint16_t> ownedIndices;
+    std::vector<float> ownedDistances;
+    /// registry key, empty for meshes built at runtime
+    std::string path;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Registry entry for a collider mesh loaded from a file. The future is shared
+    by every caller, so a mesh that is still loading on another thread is
+    waited for instead of loaded twice.
+*/
+struct ColliderMeshResource
+{
+    std::shared_future<ColliderMeshId> mesh;
+    uint32_t refCount = 0;
+};
+
+//------------------------------------------------------------------------------
+/**
+    Cooked collider mesh layout: header, vertices, indices, then the distance
+    grid aligned to 4 bytes. The arrays are written exactly as ColliderMesh
+    uses them so the file can be used in place.
+*/
+struct CookedColliderMeshHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numVertices;
+    uint32_t numTris;
+    float boundsMin[3];
+    float boundsScale[3];
     float bSphereRadius;
+    uint32_t distanceGridSize;
 };
 
+static constexpr uint32_t CookedColliderMeshMagic = 'C' | ('M' << 8) | ('S' << 16) | ('H' << 24);
+
+//------------------------------------------------------------------------------
+/**
+    Byte offset of the distance grid in a cooked file.
+*/
+static size_t
+CookedDistanceGridOffset(uint32_t numVertices, uint32_t numTris)
+{
+    size_t const end = sizeof(CookedColliderMeshHeader) + sizeof(ColliderMesh::Vertex) * numVertices + sizeof(uint16_t) * 3 * numTris;
+    return (end + 3) & ~(size_t)3;
+}
+static constexpr uint32_t CookedColliderMeshVersion = 3;
+static_assert(sizeof(CookedColliderMeshHeader) == 48, "cooked header must stay 48 bytes");
+static_assert(sizeof(ColliderMesh::Vertex) == 6, "vertices are stored tightly packed");
+
+//------------------------------------------------------------------------------
+/**
+    Live colliders are kept packed in [0, ids.size()). Destroying a collider
+    swaps the last one into its slot, so queries never visit dead colliders.
+*/
 struct Colliders
 {
-    std::vector<bool> active;
     std::vector<uint16_t> masks;
     std::vector<void*> userData;
     std::vector<glm::vec4> positionsAndScales;
     std::vector<glm::mat4> invTransforms;
     std::vector<ColliderMeshId> meshes;
+    /// dense slot -> collider id index
+    std::vector<uint32_t> ids;
+    /// collider id index -> dense slot
+    std::vector<uint32_t> slots;
+};
+
+static constexpr uint32_t InvalidSlot = 0xFFFFFFFF;
+
+//------------------------------------------------------------------------------
+/**
+    Rigid body state in structure-of-arrays form, packed like the colliders,
+    so that integration is a straight run over float arrays.
+*/
+struct RigidBodies
+{
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> fx, fy, fz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> wx, wy, wz;
+    std::vector<float> invMass;
+    std::vector<float> scale;
+    std::vector<glm::mat4> transforms;
+    std::vector<ColliderId> colliders;
+    /// dense slot -> body id index
+    std::vector<uint32_t> ids;
+    /// body id index -> dense slot
+    std::vector<uint32_t> slots;
 };
 
 static Colliders colliders;
 static std::vector<ColliderMesh> meshes;
 static Util::IdPool<ColliderMeshId> colliderMeshPool;
+static std::unordered_map<std::string, ColliderMeshResource> colliderMeshRegistry;
+/// guards the registry, the mesh pool and the mesh table while loads run on other threads
+static std::mutex colliderMeshLock;
 static Util::IdPool<ColliderId> colliderPool;
+static RigidBodies bodies;
+static Util::IdPool<RigidBodyId> rigidBodyPool;
+
+//------------------------------------------------------------------------------
+/**
+    Sort and sweep broadphase. Boxes stay sorted on their min x between frames,
+    and since colliders move little per frame the insertion sort that restores
+    the order is close to linear.
+*/
+struct Broadphase
+{
+    struct Box
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        uint32_t index; // collider id index
+    };
+    std::vector<Box> boxes;
+    /// boxes [0, numSorted) have bounds from the last update and are sorted, boxes created since are appended
+    uint32_t numSorted = 0;
+    /// sorted keys of the overlapping pairs, this and last update
+    std::vector<uint64_t> pairKeys;
+    std::vector<uint64_t> prevPairKeys;
+    std::vector<ColliderPair> pairs;
+    std::vector<ColliderPair> addedPairs;
+    std::vector<ColliderPair> removedPairs;
+};
+
+static Broadphase broadphase;
+
+/// manifolds of the last narrowphase keyed by collider pair, and the ones being built this frame
+static std::unordered_map<uint64_t, ContactManifold> manifoldCache;
+static std::unordered_map<uint64_t, ContactManifold> nextManifoldCache;
+static std::vector<ContactManifold> touchingManifolds;
+
+/// contact points drifting further apart than this are dropped from a manifold
+static constexpr float ContactBreakingThreshold = 0.05f;
+
+enum QueryCounter
+{
+    QueryRays,
+    QuerySphereTests,
+    QuerySphereRejects,
+    QueryTrianglesTested,
+    QueryHits,
+    QueryPairsTested,
+    QueryNanoseconds,
+    NumQueryCounters
+};
+
+static constexpr int NumQueryTags = (int)QueryTag::NumQueryTags;
+
+//------------------------------------------------------------------------------
+/**
+    Monotonic query counters of one thread. Only the owning thread writes them,
+    so relaxed load and store is enough and costs the same as a plain add. The
+    per frame merge reads them from the main thread.
+*/
+struct ThreadQueryCounters
+{
+    std::atomic<uint64_t> counters[NumQueryTags][NumQueryCounters] = {};
+    QueryTag tag = QueryTag::Untagged;
+
+    ThreadQueryCounters();
+    ~ThreadQueryCounters();
+
+    void Add(QueryCounter counter, uint64_t n)
+    {
+        std::atomic<uint64_t>& c = counters[(int)tag][counter];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+static std::mutex queryStatsLock;
+static std::vector<ThreadQueryCounters*> queryThreads;
+/// totals of threads that have exited
+static uint64_t retiredQueryCounters[NumQueryTags][NumQueryCounters] = {};
+/// totals at the last merge, the next frame is the difference
+static uint64_t lastQueryTotals[NumQueryTags][NumQueryCounters] = {};
+static QueryStats frameQueryStats[NumQueryTags];
+static thread_local ThreadQueryCounters threadQueryCounters;
+
+//------------------------------------------------------------------------------
+/**
+    Order independent key for a collider pair, lower index in the high bits.
+*/
+static inline uint64_t
+PairKey(ColliderId a, ColliderId b)
+{
+    if (b < a)
+        std::swap(a, b);
+    return ((uint64_t)(uint32_t)a << 32) | (uint64_t)(uint32_t)b;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline ColliderPair
+PairFromKey(uint64_t key)
+{
+    return { ColliderId::Create((uint32_t)(key >> 32)), ColliderId::Create((uint32_t)key) };
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline glm::vec3
+DequantizeVertex(ColliderMesh const* mesh, ColliderMesh::Vertex const& v)
+{
+    return mesh->boundsMin + glm::vec3(v.x, v.y, v.z) * mesh->boundsScale;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Samples per axis of the distance grid baked for every collider mesh.
+*/
+static constexpr uint32_t MeshDistanceGridSize = 16;
+
+//------------------------------------------------------------------------------
+/**
+    The distance grid spans the mesh bounds padded by an eighth of their
+    largest extent, so its border always lies outside the mesh.
+*/
+static void
+DistanceGridFrame(ColliderMesh const* mesh, glm::vec3& origin, glm::vec3& spacing)
+{
+    glm::vec3 const extents = mesh->boundsScale * 65535.0f;
+    float const pad = 0.125f * std::max(extents.x, std::max(extents.y, extents.z));
+    origin = mesh->boundsMin - glm::vec3(pad);
+    spacing = (extents + glm::vec3(2.0f * pad)) / float(MeshDistanceGridSize - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Closest point on triangle abc, from Ericson's Real-Time Collision Detection.
+*/
+static glm::vec3
+ClosestPointOnTriangle(glm::vec3 const& p, glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& c)
+{
+    glm::vec3 const ab = b - a;
+    glm::vec3 const ac = c - a;
+    glm::vec3 const ap = p - a;
+    float const d1 = glm::dot(ab, ap);
+    float const d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 const bp = p - b;
+    float const d3 = glm::dot(ab, bp);
+    float const d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float const vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 const cp = p - c;
+    float const d5 = glm::dot(ab, cp);
+    float const d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float const vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float const va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float const denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Bakes the signed distance grid into the mesh's owned storage. Distances
+    come from the closest triangle. The sign comes from flooding the outside
+    in from the grid border: if the surface passed between two neighbouring
+    samples, their distances would add up to at most the step between them.
+    Samples within half a step of the surface that the flood doesn't reach
+    take the side of the closest triangle's face instead.
+*/
+static void
+BakeDistanceGrid(ColliderMesh* mesh)
+{
+    mesh->ownedDistances.clear();
+    mesh->distances = nullptr;
+    mesh->distanceGridSize = 0;
+    if (mesh->numTris == 0)
+        return;
+
+    std::vector<glm::vec3> corners(mesh->numTris * 3);
+    for (uint32_t i = 0; i < mesh->numTris * 3; i++)
+        corners[i] = DequantizeVertex(mesh, mesh->vertices[mesh->indices[i]]);
+
+    int const n = (int)MeshDistanceGridSize;
+    glm::vec3 origin, spacing;
+    DistanceGridFrame(mesh, origin, spacing);
+    std::vector<float> distances(n * n * n);
+    std::vector<float> faceSides(n * n * n);
+    for (int z = 0; z < n; z++)
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < n; x++)
+            {
+                glm::vec3 const p = origin + glm::vec3(x, y, z) * spacing;
+                float bestDistSq = FLT_MAX;
+                float side = 1.0f;
+                for (uint32_t tri = 0; tri < mesh->numTris; tri++)
+                {
+                    glm::vec3 const& a = corners[tri * 3];
+                    glm::vec3 const& b = corners[tri * 3 + 1];
+                    glm::vec3 const& c = corners[tri * 3 + 2];
+                    glm::vec3 const closest = ClosestPointOnTriangle(p, a, b, c);
+                    float const distSq = glm::length2(p - closest);
+                    if (distSq < bestDistSq)
+                    {
+                        bestDistSq = distSq;
+                        side = glm::dot(p - closest, glm::cross(b - a, c - a)) >= 0.0f ? 1.0f : -1.0f;
+                    }
+                }
+                int const index = x + y * n + z * n * n;
+                distances[index] = sqrtf(bestDistSq);
+                faceSides[index] = side;
+            }
+
+    float const halfStep = 0.5f * std::max(spacing.x, std::max(spacing.y, spacing.z));
+    std::vector<uint8_t> outside(n * n * n, 0);
+    std::vector<int> open;
+    for (int z = 0; z < n; z++)
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < n; x++)
+            {
+                if (x == 0 || y == 0 || z == 0 || x == n - 1 || y == n - 1 || z == n - 1)
+                {
+                    int const index = x + y * n + z * n * n;
+                    outside[index] = 1;
+                    open.push_back(index);
+                }
+            }
+    int const offsets[6] = { 1, -1, n, -n, n * n, -n * n };
+    // a little over the step, so samples right at half a step on both sides don't leak
+    float const steps[6] = { spacing.x * 1.001f, spacing.x * 1.001f, spacing.y * 1.001f, spacing.y * 1.001f, spacing.z * 1.001f, spacing.z * 1.001f };
+    while (!open.empty())
+    {
+        int const index = open.back();
+        open.pop_back();
+        int const x = index % n;
+        int const y = (index / n) % n;
+        int const z = index / (n * n);
+        bool const inGrid[6] = { x < n - 1, x > 0, y < n - 1, y > 0, z < n - 1, z > 0 };
+        for (int i = 0; i < 6; i++)
+        {
+            int const neighbor = index + offsets[i];
+            if (inGrid[i] && !outside[neighbor] && distances[index] + distances[neighbor] > steps[i])
+            {
+                outside[neighbor] = 1;
+                open.push_back(neighbor);
+            }
+        }
+    }
+
+    for (int i = 0; i < n * n * n; i++)
+    {
+        if (outside[i])
+            continue;
+        distances[i] *= distances[i] > halfStep ? -1.0f : faceSides[i];
+    }
+
+    mesh->ownedDistances = std::move(distances);
+    mesh->distances = mesh->ownedDistances.data();
+    mesh->distanceGridSize = MeshDistanceGridSize;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Welds identical positions, then quantizes them against the mesh bounds into
+    the owned buffers. Triangles are index triples into positions.
+*/
+static void
+BuildQuantizedMesh(std::vector<glm::vec3> const& positions, std::vector<uint32_t> const& triIndices, ColliderMesh* mesh)
+{
+    auto less = [](glm::vec3 const& a, glm::vec3 const& b) { return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z); };
+    std::vector<glm::vec3> unique = positions;
+    std::sort(unique.begin(), unique.end(), less);
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    n_assert2(unique.size() <= 0x10000, "Collider mesh has too many vertices for 16 bit indices");
+
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+    mesh->boundsMin = glm::vec3(FLT_MAX);
+    for (glm::vec3 const& p : unique)
+    {
+        mesh->boundsMin = glm::min(mesh->boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+    if (unique.empty())
+        mesh->boundsMin = boundsMax = glm::vec3(0.0f);
+    // flat meshes still need a non zero scale on every axis
+    mesh->boundsScale = glm::max(boundsMax - mesh->boundsMin, glm::vec3(1e-6f)) / 65535.0f;
+    mesh->invBoundsScale = 1.0f / mesh->boundsScale;
+
+    mesh->ownedVertices.clear();
+    mesh->ownedVertices.reserve(unique.size());
+    mesh->bSphereRadius = 0.0f;
+    for (glm::vec3 const& p : unique)
+    {
+        glm::vec3 const q = glm::round((p - mesh->boundsMin) * mesh->invBoundsScale);
+        ColliderMesh::Vertex const v = { (uint16_t)q.x, (uint16_t)q.y, (uint16_t)q.z };
+        mesh->ownedVertices.push_back(v);
+        // bounding sphere radius is the distance to the furthest vertex, as stored
+        mesh->bSphereRadius = std::max(mesh->bSphereRadius, glm::length(DequantizeVertex(mesh, v)));
+    }
+
+    mesh->ownedIndices.clear();
+    mesh->ownedIndices.reserve(triIndices.size());
+    for (uint32_t index : triIndices)
+    {
+        auto const it = std::lower_bound(unique.begin(), unique.end(), positions[index], less);
+        mesh->ownedIndices.push_back((uint16_t)(it - unique.begin()));
+    }
+}
 
 //------------------------------------------------------------------------------
 /**
@@ -65,59 +528,153 @@ LoadFromIndexBuffer(fx::gltf::Document const& doc, ColliderMesh* mesh)
     assert(vbAccessor.type == fx::gltf::Accessor::Type::Vec3 || vbAccessor.type == fx::gltf::Accessor::Type::Vec4);
 #endif
     size_t vSize = (vbAccessor.type == fx::gltf::Accessor::Type::Vec3) ? 3 : 4; // HACK: Assumes 3d or 4d vertex positions
-    for (int i = 0; i < numIndices; i += 3)
-    {
-        ColliderMesh::Triangle tri;
-        tri.vertices[0] = glm::vec3(
-            vertexBuffer[vSize * indexBuffer[i]],
-            vertexBuffer[vSize * indexBuffer[i] + 1],
-            vertexBuffer[vSize * indexBuffer[i] + 2]
-        );
-        tri.vertices[1] = glm::vec3(
-            vertexBuffer[vSize * indexBuffer[i + 1]],
-            vertexBuffer[vSize * indexBuffer[i + 1] + 1],
-            vertexBuffer[vSize * indexBuffer[i + 1] + 2]
-        );
-        tri.vertices[2] = glm::vec3(
-            vertexBuffer[vSize * indexBuffer[i + 2]],
-            vertexBuffer[vSize * indexBuffer[i + 2] + 1],
-            vertexBuffer[vSize * indexBuffer[i + 2] + 2]
-        );
+    size_t numVertices = vbAccessor.count;
+    std::vector<glm::vec3> positions;
+    positions.reserve(numVertices);
+    for (size_t i = 0; i < numVertices; i++)
+        positions.push_back(glm::vec3(vertexBuffer[vSize * i], vertexBuffer[vSize * i + 1], vertexBuffer[vSize * i + 2]));
 
-        // compute plane's normal
-        glm::vec3 AB = tri.vertices[1] - tri.vertices[0];
-        glm::vec3 AC = tri.vertices[2] - tri.vertices[0];
-        tri.normal = glm::cross(AC, AB);
+    std::vector<uint32_t> triIndices;
+    triIndices.reserve(numIndices);
+    for (size_t i = 0; i < numIndices; i++)
+        triIndices.push_back((uint32_t)indexBuffer[i]);
 
-        mesh->tris.push_back(std::move(tri));
-    }
+    BuildQuantizedMesh(positions, triIndices, mesh);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+UnmapFile(MappedFile& file)
+{
+#if _WIN32
+    if (file.data != nullptr)
+        UnmapViewOfFile(file.data);
+    if (file.mapping != nullptr)
+        CloseHandle(file.mapping);
+    if (file.file != INVALID_HANDLE_VALUE)
+        CloseHandle(file.file);
+    file.mapping = nullptr;
+    file.file = INVALID_HANDLE_VALUE;
+#else
+    if (file.data != nullptr)
+        munmap((void*)file.data, file.size);
+    if (file.fd >= 0)
+        close(file.fd);
+    file.fd = -1;
+#endif
+    file.data = nullptr;
+    file.size = 0;
+}
 
-    // bounding sphere radius is max of x, y or z from aabb
-    mesh->bSphereRadius = vbAccessor.max[0];
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, vbAccessor.max[1]);
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, vbAccessor.max[2]);
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[0]));
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[1]));
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[2]));
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+MapFile(std::string const& path, MappedFile& file)
+{
+#if _WIN32
+    file.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file.file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.file, &size) || size.QuadPart == 0)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    file.size = (size_t)size.QuadPart;
+    file.mapping = CreateFileMappingA(file.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file.mapping != nullptr)
+        file.data = MapViewOfFile(file.mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    file.fd = open(path.c_str(), O_RDONLY);
+    if (file.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(file.fd, &st) != 0 || st.st_size == 0)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    file.size = (size_t)st.st_size;
+    void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    if (data != MAP_FAILED)
+        file.data = data;
+#endif
+    if (file.data == nullptr)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    return true;
 }
 
+//------------------------------------------------------------------------------
+/**
+    Drops whatever storage a recycled mesh slot still holds.
+*/
+static void
+ResetColliderMesh(ColliderMesh* mesh)
+{
+    UnmapFile(mesh->file);
+    mesh->ownedVertices.clear();
+    mesh->ownedIndices.clear();
+    mesh->vertices = nullptr;
+    mesh->numVertices = 0;
+    mesh->indices = nullptr;
+    mesh->numTris = 0;
+    mesh->bSphereRadius = 0.0f;
+    mesh->ownedDistances.clear();
+    mesh->distances = nullptr;
+    mesh->distanceGridSize = 0;
+    mesh->path.clear();
+}
 
 //------------------------------------------------------------------------------
 /**
+    Moves a finished mesh into the mesh table. Caller holds colliderMeshLock.
 */
-ColliderMeshId
-LoadColliderMesh(std::string path)
+static ColliderMeshId
+AddColliderMesh(ColliderMesh&& mesh)
 {
     ColliderMeshId id;
-    ColliderMesh* mesh;
     if (colliderMeshPool.Allocate(id))
-    {
-        ColliderMesh newMesh;
-        meshes.push_back(std::move(newMesh));
-    }
-    mesh = &meshes[id.index];
+        meshes.push_back(std::move(mesh));
+    else
+        meshes[id.index] = std::move(mesh);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+UseOwnedStorage(ColliderMesh* mesh)
+{
+    mesh->vertices = mesh->ownedVertices.data();
+    mesh->numVertices = (uint32_t)mesh->ownedVertices.size();
+    mesh->indices = mesh->ownedIndices.data();
+    mesh->numTris = (uint32_t)mesh->ownedIndices.size() / 3;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static std::string
+CookedColliderMeshPath(std::string const& path)
+{
+    return path + ".collider";
+}
 
-    // Load mesh from file
+//------------------------------------------------------------------------------
+/**
+    Parses the glTF into the mesh's owned storage.
+*/
+static bool
+LoadGltfColliderMesh(std::string const& path, ColliderMesh* mesh)
+{
     fx::gltf::Document doc;
     try
     {
@@ -130,8 +687,7 @@ LoadColliderMesh(std::string path)
     {
         printf(err.what());
         //assert(false);
-        colliderMeshPool.Deallocate(id);
-        return ColliderMeshId();
+        return false;
     }
 
     // HACK: currently only supports one primtive per collider mesh. Needs to be the only one in the GLTF as well...
@@ -161,181 +717,1650 @@ LoadColliderMesh(std::string path)
         break;
     }
 
-    return id;
+    UseOwnedStorage(mesh);
+    BakeDistanceGrid(mesh);
+    return true;
 }
 
 //------------------------------------------------------------------------------
 /**
 */
-ColliderId
-CreateCollider(ColliderMeshId meshId, glm::mat4 const& transform, uint16_t mask, void* userData)
+static bool
+WriteCookedColliderMesh(std::string const& cookedPath, ColliderMesh const* mesh)
 {
-#if _DEBUG
-    {
-        // Only allows uniform scaling along all axes
-        float x = glm::length(glm::vec3(transform[0]));
-        float y = glm::length(glm::vec3(transform[1]));
-        float z = glm::length(glm::vec3(transform[2]));
-        assert(fabs(x - y) < 0.00001f && fabs(x - z) < 0.00001f);
-    }
-#endif
-    glm::vec4 PS = glm::vec4(transform[3]);
-    PS.w = glm::length(transform[0]);
+    std::ofstream out(cookedPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
 
-    ColliderId id;
-    if (colliderPool.Allocate(id))
+    CookedColliderMeshHeader header = {};
+    header.magic = CookedColliderMeshMagic;
+    header.version = CookedColliderMeshVersion;
+    header.numVertices = mesh->numVertices;
+    header.numTris = mesh->numTris;
+    for (int i = 0; i < 3; i++)
     {
-        colliders.positionsAndScales.push_back(PS);
-        colliders.invTransforms.push_back(glm::inverse(transform));
-        colliders.meshes.push_back(meshId);
-        colliders.active.push_back(true);
-        colliders.userData.push_back(userData);
-        colliders.masks.push_back(mask);
+        header.boundsMin[i] = mesh->boundsMin[i];
+        header.boundsScale[i] = mesh->boundsScale[i];
     }
-    else
-    {
-        colliders.positionsAndScales[id.index] = PS;
-        colliders.invTransforms[id.index] = glm::inverse(transform);
-        colliders.meshes[id.index] = meshId;
-        colliders.active[id.index] = true;
-        colliders.userData[id.index] = userData;
-        colliders.masks[id.index] = mask;
-    }
-    return id;
+    header.bSphereRadius = mesh->bSphereRadius;
+    header.distanceGridSize = mesh->distanceGridSize;
+    out.write((char const*)&header, sizeof(header));
+    out.write((char const*)mesh->vertices, sizeof(ColliderMesh::Vertex) * mesh->numVertices);
+    out.write((char const*)mesh->indices, sizeof(uint16_t) * 3 * mesh->numTris);
+    size_t const gridOffset = CookedDistanceGridOffset(mesh->numVertices, mesh->numTris);
+    char const padding[4] = {};
+    out.write(padding, gridOffset - (size_t)out.tellp());
+    size_t const gridSize = mesh->distanceGridSize;
+    out.write((char const*)mesh->distances, sizeof(float) * gridSize * gridSize * gridSize);
+    return (bool)out;
 }
 
 //------------------------------------------------------------------------------
 /**
+    Maps a cooked file and points the mesh straight into it. Fails on anything
+    that does not look like the current version, so the caller can recook.
 */
-void
-SetTransform(ColliderId collider, glm::mat4 const& transform)
+static bool
+MapCookedColliderMesh(std::string const& cookedPath, ColliderMesh* mesh)
 {
-    assert(colliderPool.IsValid(collider));
-#if _DEBUG
+    if (!MapFile(cookedPath, mesh->file))
+        return false;
+
+    CookedColliderMeshHeader const* header = (CookedColliderMeshHeader const*)mesh->file.data;
+    bool const hasHeader = mesh->file.size >= sizeof(CookedColliderMeshHeader);
+    size_t const gridSize = hasHeader ? header->distanceGridSize : 0;
+    size_t const expectedSize = hasHeader
+        ? CookedDistanceGridOffset(header->numVertices, header->numTris) + sizeof(float) * gridSize * gridSize * gridSize
+        : 0;
+    if (!hasHeader
+        || header->magic != CookedColliderMeshMagic
+        || header->version != CookedColliderMeshVersion
+        || mesh->file.size != expectedSize)
     {
-        // Only allows uniform scaling along all axes
-        float x = glm::length(glm::vec3(transform[0]));
-        float y = glm::length(glm::vec3(transform[1]));
-        float z = glm::length(glm::vec3(transform[2]));
-        assert(fabs(x - y) < 0.00001f && fabs(x - z) < 0.00001f);
+        UnmapFile(mesh->file);
+        return false;
     }
-#endif
-    glm::vec4 PS = glm::vec4(transform[3]);
-    PS.w = glm::length(transform[0]);
-    colliders.positionsAndScales[collider.index] = PS;
-    colliders.invTransforms[collider.index] = glm::inverse(transform);
+
+    char const* data = (char const*)mesh->file.data + sizeof(CookedColliderMeshHeader);
+    mesh->vertices = (ColliderMesh::Vertex const*)data;
+    mesh->numVertices = header->numVertices;
+    mesh->indices = (uint16_t const*)(data + sizeof(ColliderMesh::Vertex) * header->numVertices);
+    mesh->numTris = header->numTris;
+    mesh->boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+    mesh->boundsScale = glm::vec3(header->boundsScale[0], header->boundsScale[1], header->boundsScale[2]);
+    mesh->invBoundsScale = 1.0f / mesh->boundsScale;
+    mesh->bSphereRadius = header->bSphereRadius;
+    mesh->distances = (float const*)((char const*)mesh->file.data + CookedDistanceGridOffset(header->numVertices, header->numTris));
+    mesh->distanceGridSize = header->distanceGridSize;
+    if (mesh->distanceGridSize == 0)
+        mesh->distances = nullptr;
+    return true;
 }
 
 //------------------------------------------------------------------------------
 /**
-    Cast ray from start point in direction. Make sure the direction is a unit vector.
 */
-RaycastPayload
-Raycast(glm::vec3 start, glm::vec3 dir, float maxDistance, uint16_t mask)
+static bool
+IsCookedColliderMeshStale(std::string const& path, std::string const& cookedPath)
 {
-    RaycastPayload ret;
-    ret.hitDistance = maxDistance;
-    // TODO: spatial acceleration instead of just checking everything...
-    int numColliders = (int)colliders.active.size();
-    for (int colliderIndex = 0; colliderIndex < numColliders; colliderIndex++)
-    {
-        if (colliders.active[colliderIndex] && (mask == 0 || (colliders.masks[colliderIndex] & mask) != 0))
-        {
-            ColliderMesh const* const mesh = &meshes[colliders.meshes[colliderIndex].index];
-            glm::vec3 bSphereCenter = colliders.positionsAndScales[colliderIndex];
-            float radius = mesh->bSphereRadius * colliders.positionsAndScales[colliderIndex][3];
-
-            // Coarse check against bounding sphere
-            {
-                glm::vec3 cDir = bSphereCenter - start;
-
-                float r2 = radius * radius;
-                float c2 = glm::dot(cDir, cDir);
+    std::error_code err;
+    auto const cookedTime = std::filesystem::last_write_time(cookedPath, err);
+    if (err)
+        return true;
+    auto const sourceTime = std::filesystem::last_write_time(path, err);
+    // a cooked file without its source is still usable
+    return !err && sourceTime > cookedTime;
+}
 
-                if (c2 < r2)
-                    goto CHECK_MESH; // ray starts within sphere
+//------------------------------------------------------------------------------
+/**
+    Offline entry point, parses the glTF and writes the cooked blob next to it.
+*/
+bool
+CookColliderMesh(std::string path)
+{
+    ColliderMesh mesh;
+    if (!LoadGltfColliderMesh(path, &mesh))
+        return false;
+    return WriteCookedColliderMesh(CookedColliderMeshPath(path), &mesh);
+}
 
-                float d = glm::dot(cDir, dir);
-                if (d < 0.0f)
-                    continue; // ray is pointing away from sphere
 
-                float discr = d * d - (c2 - r2);
+//------------------------------------------------------------------------------
+/**
+    Reads a mesh from disk without touching any shared state, so loads of
+    different files can run in parallel.
+*/
+static bool
+LoadColliderMeshResource(std::string const& path, ColliderMesh& mesh)
+{
+    // use the cooked blob in place when it is up to date
+    std::string const cookedPath = CookedColliderMeshPath(path);
+    if (!IsCookedColliderMeshStale(path, cookedPath) && MapCookedColliderMesh(cookedPath, &mesh))
+        return true;
 
-                // A negative discriminant corresponds to ray missing sphere 
-                if (discr < 0.0f)
+    // first load, or the source changed. Parse the glTF and cook it for next time
+    if (!LoadGltfColliderMesh(path, &mesh))
+    {
+        ResetColliderMesh(&mesh);
+        return false;
+    }
+    if (!WriteCookedColliderMesh(cookedPath, &mesh))
+        n_warning("Could not write cooked collider mesh '%s'\n", cookedPath.c_str());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Returns the registered mesh for path and adds a reference, or loads it.
+*/
+ColliderMeshId
+LoadColliderMesh(std::string path)
+{
+    std::promise<ColliderMeshId> promise;
+    std::shared_future<ColliderMeshId> pending;
+    {
+        std::lock_guard<std::mutex> lock(colliderMeshLock);
+        auto iter = colliderMeshRegistry.find(path);
+        if (iter != colliderMeshRegistry.end())
+        {
+            iter->second.refCount++;
+            pending = iter->second.mesh;
+        }
+        else
+        {
+            ColliderMeshResource& resource = colliderMeshRegistry[path];
+            resource.refCount = 1;
+            resource.mesh = promise.get_future().share();
+        }
+    }
+
+    // loaded already, or in flight on another thread
+    if (pending.valid())
+        return pending.get();
+
+    ColliderMesh mesh;
+    ColliderMeshId id = ColliderMeshId::Invalid();
+    bool const loaded = LoadColliderMeshResource(path, mesh);
+    {
+        std::lock_guard<std::mutex> lock(colliderMeshLock);
+        if (loaded)
+        {
+            mesh.path = path;
+            id = AddColliderMesh(std::move(mesh));
+        }
+        else
+            colliderMeshRegistry.erase(path);
+    }
+    promise.set_value(id);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Loads all paths in parallel. Each returned id holds one reference.
+*/
+std::vector<ColliderMeshId>
+PreloadColliderMeshes(std::vector<std::string> const& paths)
+{
+    std::vector<std::future<ColliderMeshId>> loads;
+    loads.reserve(paths.size());
+    for (std::string const& path : paths)
+        loads.push_back(std::async(std::launch::async, LoadColliderMesh, path));
+
+    std::vector<ColliderMeshId> ids;
+    ids.reserve(paths.size());
+    for (auto& load : loads)
+        ids.push_back(load.get());
+    return ids;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Drops a reference, the mesh is released with the last one. Meshes built at
+    runtime are not shared and are released right away.
+*/
+void
+UnloadColliderMesh(ColliderMeshId meshId)
+{
+    std::lock_guard<std::mutex> lock(colliderMeshLock);
+    assert(colliderMeshPool.IsValid(meshId));
+    ColliderMesh& mesh = meshes[meshId.index];
+    if (!mesh.path.empty())
+    {
+        auto iter = colliderMeshRegistry.find(mesh.path);
+        assert(iter != colliderMeshRegistry.end());
+        if (--iter->second.refCount > 0)
+            return;
+        colliderMeshRegistry.erase(iter);
+    }
+    ResetColliderMesh(&mesh);
+    colliderMeshPool.Deallocate(meshId);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Brute force hull, every plane through three points that has all other points
+    behind it becomes a face. Only meant for small point clouds.
+*/
+ColliderMeshId
+CreateConvexColliderMesh(std::vector<glm::vec3> const& points)
+{
+    float radius = 0.0f;
+    for (glm::vec3 const& p : points)
+        radius = std::max(radius, glm::length(p));
+
+    std::vector<uint32_t> triIndices;
+    float const eps = 0.0001f * std::max(radius, 1.0f);
+    int const numPoints = (int)points.size();
+    for (int i = 0; i < numPoints; i++)
+    {
+        for (int j = i + 1; j < numPoints; j++)
+        {
+            for (int k = j + 1; k < numPoints; k++)
+            {
+                glm::vec3 n = glm::cross(points[j] - points[i], points[k] - points[i]);
+                float const len = glm::length(n);
+                if (len < eps)
+                    continue; // degenerate
+                n /= len;
+
+                bool anyFront = false;
+                bool anyBack = false;
+                for (int m = 0; m < numPoints && !(anyFront && anyBack); m++)
+                {
+                    float const d = glm::dot(n, points[m] - points[i]);
+                    anyFront |= d > eps;
+                    anyBack |= d < -eps;
+                }
+                if (anyFront && anyBack)
+                    continue; // not on the hull
+
+                // counter clockwise seen from outside, like the gltf meshes
+                triIndices.push_back(i);
+                triIndices.push_back(anyFront ? k : j);
+                triIndices.push_back(anyFront ? j : k);
+            }
+        }
+    }
+
+    ColliderMesh newMesh;
+    BuildQuantizedMesh(points, triIndices, &newMesh);
+    UseOwnedStorage(&newMesh);
+    BakeDistanceGrid(&newMesh);
+
+    std::lock_guard<std::mutex> lock(colliderMeshLock);
+    return AddColliderMesh(std::move(newMesh));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ColliderId
+CreateCollider(ColliderMeshId meshId, glm::mat4 const& transform, uint16_t mask, void* userData)
+{
+#if _DEBUG
+    {
+        // Only allows uniform scaling along all axes
+        float x = glm::length(glm::vec3(transform[0]));
+        float y = glm::length(glm::vec3(transform[1]));
+        float z = glm::length(glm::vec3(transform[2]));
+        assert(fabs(x - y) < 0.00001f && fabs(x - z) < 0.00001f);
+    }
+#endif
+    glm::vec4 PS = glm::vec4(transform[3]);
+    PS.w = glm::length(transform[0]);
+
+    ColliderId id;
+    if (colliderPool.Allocate(id))
+        colliders.slots.push_back(InvalidSlot);
+
+    colliders.slots[id.index] = (uint32_t)colliders.ids.size();
+    colliders.ids.push_back(id.index);
+    colliders.positionsAndScales.push_back(PS);
+    colliders.invTransforms.push_back(glm::inverse(transform));
+    colliders.meshes.push_back(meshId);
+    colliders.userData.push_back(userData);
+    colliders.masks.push_back(mask);
+
+    // bounds are filled in on the next broadphase update
+    broadphase.boxes.push_back({ glm::vec3(PS), glm::vec3(PS), id.index });
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Swap-removes the collider from the packed arrays and recycles its id.
+*/
+void
+DestroyCollider(ColliderId collider)
+{
+    assert(colliderPool.IsValid(collider));
+    uint32_t const slot = colliders.slots[collider.index];
+    uint32_t const last = (uint32_t)colliders.ids.size() - 1;
+    if (slot != last)
+    {
+        colliders.ids[slot] = colliders.ids[last];
+        colliders.positionsAndScales[slot] = colliders.positionsAndScales[last];
+        colliders.invTransforms[slot] = colliders.invTransforms[last];
+        colliders.meshes[slot] = colliders.meshes[last];
+        colliders.userData[slot] = colliders.userData[last];
+        colliders.masks[slot] = colliders.masks[last];
+        colliders.slots[colliders.ids[slot]] = slot;
+    }
+    colliders.ids.pop_back();
+    colliders.positionsAndScales.pop_back();
+    colliders.invTransforms.pop_back();
+    colliders.meshes.pop_back();
+    colliders.userData.pop_back();
+    colliders.masks.pop_back();
+    colliders.slots[collider.index] = InvalidSlot;
+
+    // erase keeps the remaining boxes sorted
+    for (auto it = broadphase.boxes.begin(); it != broadphase.boxes.end(); it++)
+    {
+        if (it->index == collider.index)
+        {
+            if (it - broadphase.boxes.begin() < (ptrdiff_t)broadphase.numSorted)
+                broadphase.numSorted--;
+            broadphase.boxes.erase(it);
+            break;
+        }
+    }
+
+    colliderPool.Deallocate(collider);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+IsValid(ColliderId collider)
+{
+    return colliderPool.IsValid(collider);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void*
+GetUserData(ColliderId collider)
+{
+    assert(colliderPool.IsValid(collider));
+    return colliders.userData[colliders.slots[collider.index]];
+}
+
+//------------------------------------------------------------------------------
+/**
+    Same bounds the broadphase uses, but from the current transform rather
+    than the last broadphase update.
+*/
+void
+GetBounds(ColliderId collider, glm::vec3& min, glm::vec3& max)
+{
+    assert(colliderPool.IsValid(collider));
+    uint32_t const slot = colliders.slots[collider.index];
+    glm::vec4 const& PS = colliders.positionsAndScales[slot];
+    glm::vec3 const extents = glm::vec3(meshes[colliders.meshes[slot].index].bSphereRadius * PS.w);
+    min = glm::vec3(PS) - extents;
+    max = glm::vec3(PS) + extents;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Trilinear lookup in the mesh's distance grid. Outside the grid the
+    distance to the grid is added on, which never overestimates by more than
+    the grid's own error.
+*/
+float
+GetSignedDistance(ColliderId collider, glm::vec3 const& point)
+{
+    assert(colliderPool.IsValid(collider));
+    uint32_t const slot = colliders.slots[collider.index];
+    glm::vec4 const& PS = colliders.positionsAndScales[slot];
+    ColliderMesh const* const mesh = &meshes[colliders.meshes[slot].index];
+    if (mesh->distanceGridSize == 0)
+        return glm::length(point - glm::vec3(PS)) - mesh->bSphereRadius * PS.w;
+
+    int const n = (int)mesh->distanceGridSize;
+    glm::vec3 origin, spacing;
+    DistanceGridFrame(mesh, origin, spacing);
+    glm::vec3 const local = glm::vec3(colliders.invTransforms[slot] * glm::vec4(point, 1.0f));
+    glm::vec3 const clamped = glm::clamp(local, origin, origin + spacing * float(n - 1));
+    glm::vec3 const f = (clamped - origin) / spacing;
+    glm::ivec3 const cell = glm::min(glm::ivec3(f), glm::ivec3(n - 2));
+    glm::vec3 const t = f - glm::vec3(cell);
+
+    float const* d = mesh->distances + cell.x + cell.y * n + cell.z * n * n;
+    int const dy = n;
+    int const dz = n * n;
+    float const x00 = glm::mix(d[0], d[1], t.x);
+    float const x10 = glm::mix(d[dy], d[dy + 1], t.x);
+    float const x01 = glm::mix(d[dz], d[dz + 1], t.x);
+    float const x11 = glm::mix(d[dy + dz], d[dy + dz + 1], t.x);
+    float const distance = glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+    return (distance + glm::length(local - clamped)) * PS.w;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetTransform(ColliderId collider, glm::mat4 const& transform)
+{
+    assert(colliderPool.IsValid(collider));
+#if _DEBUG
+    {
+        // Only allows uniform scaling along all axes
+        float x = glm::length(glm::vec3(transform[0]));
+        float y = glm::length(glm::vec3(transform[1]));
+        float z = glm::length(glm::vec3(transform[2]));
+        assert(fabs(x - y) < 0.00001f && fabs(x - z) < 0.00001f);
+    }
+#endif
+    glm::vec4 PS = glm::vec4(transform[3]);
+    PS.w = glm::length(transform[0]);
+    uint32_t const slot = colliders.slots[collider.index];
+    colliders.positionsAndScales[slot] = PS;
+    colliders.invTransforms[slot] = glm::inverse(transform);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+RigidBodyId
+CreateRigidBody(glm::mat4 const& transform, float mass, ColliderId collider)
+{
+    RigidBodyId id;
+    if (rigidBodyPool.Allocate(id))
+        bodies.slots.push_back(InvalidSlot);
+
+    float const scale = glm::length(glm::vec3(transform[0]));
+    glm::quat const q = glm::quat_cast(glm::mat3(transform) / scale);
+
+    bodies.slots[id.index] = (uint32_t)bodies.ids.size();
+    bodies.ids.push_back(id.index);
+    bodies.px.push_back(transform[3].x);
+    bodies.py.push_back(transform[3].y);
+    bodies.pz.push_back(transform[3].z);
+    bodies.vx.push_back(0.0f);
+    bodies.vy.push_back(0.0f);
+    bodies.vz.push_back(0.0f);
+    bodies.fx.push_back(0.0f);
+    bodies.fy.push_back(0.0f);
+    bodies.fz.push_back(0.0f);
+    bodies.qx.push_back(q.x);
+    bodies.qy.push_back(q.y);
+    bodies.qz.push_back(q.z);
+    bodies.qw.push_back(q.w);
+    bodies.wx.push_back(0.0f);
+    bodies.wy.push_back(0.0f);
+    bodies.wz.push_back(0.0f);
+    bodies.invMass.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+    bodies.scale.push_back(scale);
+    bodies.transforms.push_back(transform);
+    bodies.colliders.push_back(collider);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DestroyRigidBody(RigidBodyId body)
+{
+    assert(rigidBodyPool.IsValid(body));
+    uint32_t const slot = bodies.slots[body.index];
+    uint32_t const last = (uint32_t)bodies.ids.size() - 1;
+    if (slot != last)
+    {
+        bodies.ids[slot] = bodies.ids[last];
+        bodies.px[slot] = bodies.px[last];
+        bodies.py[slot] = bodies.py[last];
+        bodies.pz[slot] = bodies.pz[last];
+        bodies.vx[slot] = bodies.vx[last];
+        bodies.vy[slot] = bodies.vy[last];
+        bodies.vz[slot] = bodies.vz[last];
+        bodies.fx[slot] = bodies.fx[last];
+        bodies.fy[slot] = bodies.fy[last];
+        bodies.fz[slot] = bodies.fz[last];
+        bodies.qx[slot] = bodies.qx[last];
+        bodies.qy[slot] = bodies.qy[last];
+        bodies.qz[slot] = bodies.qz[last];
+        bodies.qw[slot] = bodies.qw[last];
+        bodies.wx[slot] = bodies.wx[last];
+        bodies.wy[slot] = bodies.wy[last];
+        bodies.wz[slot] = bodies.wz[last];
+        bodies.invMass[slot] = bodies.invMass[last];
+        bodies.scale[slot] = bodies.scale[last];
+        bodies.transforms[slot] = bodies.transforms[last];
+        bodies.colliders[slot] = bodies.colliders[last];
+        bodies.slots[bodies.ids[slot]] = slot;
+    }
+    bodies.ids.pop_back();
+    bodies.px.pop_back();
+    bodies.py.pop_back();
+    bodies.pz.pop_back();
+    bodies.vx.pop_back();
+    bodies.vy.pop_back();
+    bodies.vz.pop_back();
+    bodies.fx.pop_back();
+    bodies.fy.pop_back();
+    bodies.fz.pop_back();
+    bodies.qx.pop_back();
+    bodies.qy.pop_back();
+    bodies.qz.pop_back();
+    bodies.qw.pop_back();
+    bodies.wx.pop_back();
+    bodies.wy.pop_back();
+    bodies.wz.pop_back();
+    bodies.invMass.pop_back();
+    bodies.scale.pop_back();
+    bodies.transforms.pop_back();
+    bodies.colliders.pop_back();
+    bodies.slots[body.index] = InvalidSlot;
+
+    rigidBodyPool.Deallocate(body);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetVelocity(RigidBodyId body, glm::vec3 const& velocity, glm::vec3 const& angularVelocity)
+{
+    assert(rigidBodyPool.IsValid(body));
+    uint32_t const slot = bodies.slots[body.index];
+    bodies.vx[slot] = velocity.x;
+    bodies.vy[slot] = velocity.y;
+    bodies.vz[slot] = velocity.z;
+    bodies.wx[slot] = angularVelocity.x;
+    bodies.wy[slot] = angularVelocity.y;
+    bodies.wz[slot] = angularVelocity.z;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+AddForce(RigidBodyId body, glm::vec3 const& force)
+{
+    assert(rigidBodyPool.IsValid(body));
+    uint32_t const slot = bodies.slots[body.index];
+    bodies.fx[slot] += force.x;
+    bodies.fy[slot] += force.y;
+    bodies.fz[slot] += force.z;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+glm::mat4 const&
+GetRigidBodyTransform(RigidBodyId body)
+{
+    assert(rigidBodyPool.IsValid(body));
+    return bodies.transforms[bodies.slots[body.index]];
+}
+
+//------------------------------------------------------------------------------
+/**
+    Semi-implicit Euler over all bodies. The loops only touch contiguous float
+    arrays and have no branches, so the compiler can vectorize them across bodies.
+    Afterwards the transforms are rebuilt and attached colliders are updated in one go.
+*/
+void
+IntegrateRigidBodies(float dt)
+{
+    int const numBodies = (int)bodies.ids.size();
+    if (numBodies == 0)
+        return;
+
+    // linear
+    {
+        float* const px = bodies.px.data(); float* const py = bodies.py.data(); float* const pz = bodies.pz.data();
+        float* const vx = bodies.vx.data(); float* const vy = bodies.vy.data(); float* const vz = bodies.vz.data();
+        float* const fx = bodies.fx.data(); float* const fy = bodies.fy.data(); float* const fz = bodies.fz.data();
+        float const* const invMass = bodies.invMass.data();
+        for (int i = 0; i < numBodies; i++)
+        {
+            float const k = invMass[i] * dt;
+            vx[i] += fx[i] * k;
+            vy[i] += fy[i] * k;
+            vz[i] += fz[i] * k;
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+            pz[i] += vz[i] * dt;
+            fx[i] = 0.0f;
+            fy[i] = 0.0f;
+            fz[i] = 0.0f;
+        }
+    }
+
+    // angular, q' = q + dt/2 * (0, w) * q
+    {
+        float* const qx = bodies.qx.data(); float* const qy = bodies.qy.data(); float* const qz = bodies.qz.data(); float* const qw = bodies.qw.data();
+        float const* const wx = bodies.wx.data(); float const* const wy = bodies.wy.data(); float const* const wz = bodies.wz.data();
+        float const h = 0.5f * dt;
+        for (int i = 0; i < numBodies; i++)
+        {
+            float const x = qx[i] + h * (wx[i] * qw[i] + wy[i] * qz[i] - wz[i] * qy[i]);
+            float const y = qy[i] + h * (wy[i] * qw[i] + wz[i] * qx[i] - wx[i] * qz[i]);
+            float const z = qz[i] + h * (wz[i] * qw[i] + wx[i] * qy[i] - wy[i] * qx[i]);
+            float const w = qw[i] - h * (wx[i] * qx[i] + wy[i] * qy[i] + wz[i] * qz[i]);
+            float const invLen = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+            qx[i] = x * invLen;
+            qy[i] = y * invLen;
+            qz[i] = z * invLen;
+            qw[i] = w * invLen;
+        }
+    }
+
+    // rebuild transforms and move attached colliders
+    for (int i = 0; i < numBodies; i++)
+    {
+        glm::mat3 const R = glm::mat3_cast(glm::quat(bodies.qw[i], bodies.qx[i], bodies.qy[i], bodies.qz[i]));
+        glm::vec3 const P = glm::vec3(bodies.px[i], bodies.py[i], bodies.pz[i]);
+        float const s = bodies.scale[i];
+
+        glm::mat4& T = bodies.transforms[i];
+        T[0] = glm::vec4(R[0] * s, 0.0f);
+        T[1] = glm::vec4(R[1] * s, 0.0f);
+        T[2] = glm::vec4(R[2] * s, 0.0f);
+        T[3] = glm::vec4(P, 1.0f);
+
+        ColliderId const collider = bodies.colliders[i];
+        if (!colliderPool.IsValid(collider))
+            continue;
+
+        // inverse of a rotation with uniform scale is the transposed rotation over scale
+        glm::mat3 const invRS = glm::transpose(R) / s;
+        glm::mat4& invT = colliders.invTransforms[colliders.slots[collider.index]];
+        invT[0] = glm::vec4(invRS[0], 0.0f);
+        invT[1] = glm::vec4(invRS[1], 0.0f);
+        invT[2] = glm::vec4(invRS[2], 0.0f);
+        invT[3] = glm::vec4(-(invRS * P), 1.0f);
+        colliders.positionsAndScales[colliders.slots[collider.index]] = glm::vec4(P, s);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Coarse ray test against a collider's bounding sphere, rejecting spheres
+    that lie beyond maxDistance.
+*/
+static inline bool
+RayIntersectsBoundingSphere(uint32_t slot, glm::vec3 const& start, glm::vec3 const& dir, float maxDistance)
+{
+    ColliderMesh const* const mesh = &meshes[colliders.meshes[slot].index];
+    glm::vec3 bSphereCenter = colliders.positionsAndScales[slot];
+    float radius = mesh->bSphereRadius * colliders.positionsAndScales[slot][3];
+
+    glm::vec3 cDir = bSphereCenter - start;
+
+    float r2 = radius * radius;
+    float c2 = glm::dot(cDir, cDir);
+
+    if (c2 < r2)
+        return true; // ray starts within sphere
+
+    float d = glm::dot(cDir, dir);
+    if (d < 0.0f)
+        return false; // ray is pointing away from sphere
+
+    float discr = d * d - (c2 - r2);
+
+    // A negative discriminant corresponds to ray missing sphere 
+    if (discr < 0.0f)
+        return false;
+
+    // NOTE: this should be equivalent to this: (sqrtf(c2) - radius > maxDistance)), but faster
+    if ((c2 > (maxDistance * maxDistance) + (2 * radius * maxDistance) + r2))
+        return false; // ray is too short
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Fine ray test against a collider's triangles. Lowers hitDistance and
+    returns true if a triangle is hit closer than it.
+*/
+static bool
+RaycastColliderMesh(uint32_t slot, glm::vec3 const& start, glm::vec3 const& dir, float& hitDistance, uint64_t& trianglesTested)
+{
+    ColliderMesh const* const mesh = &meshes[colliders.meshes[slot].index];
+
+    // transform ray into modelspace
+    glm::mat4 const& invT = colliders.invTransforms[slot];
+    glm::vec3 invRayStart = invT * glm::vec4(start, 1.0f);
+    glm::vec3 invRayDir = invT * glm::vec4(dir, 0);
+
+    // and on into the quantized vertex space. The mapping is affine, so t stays the same
+    invRayStart = (invRayStart - mesh->boundsMin) * mesh->invBoundsScale;
+    invRayDir = invRayDir * mesh->invBoundsScale;
+
+    bool hit = false;
+    int numTris = (int)mesh->numTris;
+    trianglesTested += numTris;
+    uint16_t const* const indices = mesh->indices;
+    ColliderMesh::Vertex const* const vertices = mesh->vertices;
+    for (int i = 0; i < numTris; ++i)
+    {
+        ColliderMesh::Vertex const& a = vertices[indices[i * 3]];
+        ColliderMesh::Vertex const& b = vertices[indices[i * 3 + 1]];
+        ColliderMesh::Vertex const& c = vertices[indices[i * 3 + 2]];
+        glm::vec3 const A = glm::vec3(a.x, a.y, a.z);
+        glm::vec3 const B = glm::vec3(b.x, b.y, b.z);
+        glm::vec3 const C = glm::vec3(c.x, c.y, c.z);
+
+        // plane normal, same winding as the gltf loader used to store
+        glm::vec3 const N = glm::cross(C - A, B - A);
+
+        float NdotRayDirection = glm::dot(N, invRayDir);
+        if (NdotRayDirection < 0)
+            continue; // backfacing surface
+
+        float d = -glm::dot(N, A);
+        float t = -(glm::dot(N, invRayStart) + d) / NdotRayDirection;
+
+        if (t < 0)
+            continue;  //the triangle is behind the ray
+
+        glm::vec3 P = invRayStart + invRayDir * t;
+
+        // check triangle bounds
+        glm::vec3 K;  //vector perpendicular to one of three subdivided triangles's plane 
+        glm::vec3 edge0 = B - A;
+        glm::vec3 vp0 = P - A;
+        K = glm::cross(vp0, edge0);
+        if (glm::dot(N, K) < 0)
+            continue;
+
+        glm::vec3 edge1 = C - B;
+        glm::vec3 vp1 = P - B;
+        K = glm::cross(vp1, edge1);
+        if (glm::dot(N, K) < 0)
+            continue;
+
+        glm::vec3 edge2 = A - C;
+        glm::vec3 vp2 = P - C;
+        K = glm::cross(vp2, edge2);
+        if (glm::dot(N, K) < 0)
+            continue;
+
+        // intersection with at least one triangle
+        if (hitDistance >= t)
+        {
+            hit = true;
+            hitDistance = t;
+        }
+    }
+    return hit;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Cast ray from start point in direction. Make sure the direction is a unit vector.
+*/
+RaycastPayload
+Raycast(glm::vec3 start, glm::vec3 dir, float maxDistance, uint16_t mask)
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    uint64_t sphereTests = 0;
+    uint64_t meshTests = 0;
+    uint64_t trianglesTested = 0;
+
+    RaycastPayload ret;
+    ret.hitDistance = maxDistance;
+    // TODO: spatial acceleration instead of just checking everything...
+    int numColliders = (int)colliders.ids.size();
+    for (int colliderIndex = 0; colliderIndex < numColliders; colliderIndex++)
+    {
+        if (mask == 0 || (colliders.masks[colliderIndex] & mask) != 0)
+        {
+            sphereTests++;
+            if (!RayIntersectsBoundingSphere(colliderIndex, start, dir, ret.hitDistance))
+                continue;
+
+            meshTests++;
+            if (RaycastColliderMesh(colliderIndex, start, dir, ret.hitDistance, trianglesTested))
+            {
+                ret.hit = true;
+                uint32_t const index = colliders.ids[colliderIndex];
+                ret.collider = ColliderId::Create(index, colliderPool.generations[index]);
+            }
+        }
+    }
+
+    if (ret.hit)
+    {
+        //calculate hitpoint
+        ret.hitPoint = start + dir * ret.hitDistance;
+    }
+
+    ThreadQueryCounters& counters = threadQueryCounters;
+    counters.Add(QueryRays, 1);
+    counters.Add(QuerySphereTests, sphereTests);
+    counters.Add(QuerySphereRejects, sphereTests - meshTests);
+    counters.Add(QueryTrianglesTested, trianglesTested);
+    counters.Add(QueryHits, ret.hit ? 1 : 0);
+    counters.Add(QueryNanoseconds, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeStart).count());
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Swept test for a point moving from start to end within one tick, so fast
+    bodies cannot tunnel through thin colliders between frames. Candidates come
+    from the broadphase boxes: the sorted boxes are scanned until they start
+    past the segment's max x, and boxes created since the last update, which
+    have no bounds yet, go straight to the sphere test.
+*/
+RaycastPayload
+SegmentCast(glm::vec3 start, glm::vec3 end, uint16_t mask, ColliderId ignore)
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    uint64_t sphereTests = 0;
+    uint64_t meshTests = 0;
+    uint64_t trianglesTested = 0;
+
+    RaycastPayload ret;
+    float const length = glm::length(end - start);
+    ret.hitDistance = length;
+    if (length > 0.0f)
+    {
+        glm::vec3 const dir = (end - start) / length;
+        glm::vec3 const segMin = glm::min(start, end);
+        glm::vec3 const segMax = glm::max(start, end);
+
+        std::vector<Broadphase::Box> const& boxes = broadphase.boxes;
+        uint32_t const numBoxes = (uint32_t)boxes.size();
+        for (uint32_t i = 0; i < numBoxes; i++)
+        {
+            Broadphase::Box const& box = boxes[i];
+            if (i < broadphase.numSorted)
+            {
+                if (box.min.x > segMax.x)
+                {
+                    i = broadphase.numSorted - 1; // no later sorted box can overlap, skip to the unsorted ones
                     continue;
+                }
+                if (box.max.x < segMin.x || box.max.y < segMin.y || box.min.y > segMax.y || box.max.z < segMin.z || box.min.z > segMax.z)
+                    continue;
+            }
+            if (box.index == ignore.index && colliderPool.generations[box.index] == ignore.generation)
+                continue;
+
+            uint32_t const slot = colliders.slots[box.index];
+            if (mask != 0 && (colliders.masks[slot] & mask) == 0)
+                continue;
+
+            sphereTests++;
+            if (!RayIntersectsBoundingSphere(slot, start, dir, ret.hitDistance))
+                continue;
+
+            meshTests++;
+            if (RaycastColliderMesh(slot, start, dir, ret.hitDistance, trianglesTested))
+            {
+                ret.hit = true;
+                ret.collider = ColliderId::Create(box.index, colliderPool.generations[box.index]);
+            }
+        }
+    }
+
+    if (ret.hit)
+        ret.hitPoint = start + (end - start) * (ret.hitDistance / length);
+
+    ThreadQueryCounters& counters = threadQueryCounters;
+    counters.Add(QueryRays, 1);
+    counters.Add(QuerySphereTests, sphereTests);
+    counters.Add(QuerySphereRejects, sphereTests - meshTests);
+    counters.Add(QueryTrianglesTested, trianglesTested);
+    counters.Add(QueryHits, ret.hit ? 1 : 0);
+    counters.Add(QueryNanoseconds, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeStart).count());
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Point on the minkowski difference A - B, remembering the points on A and B
+    that produced it so contact points can be recovered.
+*/
+struct SupportPoint
+{
+    glm::vec3 p;
+    glm::vec3 a;
+    glm::vec3 b;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+struct ConvexShape
+{
+    ColliderMesh const* mesh;
+    glm::mat4 transform;
+    glm::mat3 invRotationScale;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+static glm::vec3
+ConvexSupport(ConvexShape const& shape, glm::vec3 const& dir)
+{
+    // the inverse transform maps the direction into model space, scale does not change the argmax.
+    // dot(min + q * scale, d) orders vertices like dot(q, scale * d), so search the quantized vertices
+    glm::vec3 const localDir = (shape.invRotationScale * dir) * shape.mesh->boundsScale;
+    ColliderMesh::Vertex const* const verts = shape.mesh->vertices;
+    int best = 0;
+    float bestDot = -FLT_MAX;
+    int const numVerts = (int)shape.mesh->numVertices;
+    for (int i = 0; i < numVerts; i++)
+    {
+        float const d = verts[i].x * localDir.x + verts[i].y * localDir.y + verts[i].z * localDir.z;
+        if (d > bestDot)
+        {
+            bestDot = d;
+            best = i;
+        }
+    }
+    return glm::vec3(shape.transform * glm::vec4(DequantizeVertex(shape.mesh, verts[best]), 1.0f));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static SupportPoint
+MinkowskiSupport(ConvexShape const& a, ConvexShape const& b, glm::vec3 const& dir)
+{
+    SupportPoint ret;
+    ret.a = ConvexSupport(a, dir);
+    ret.b = ConvexSupport(b, -dir);
+    ret.p = ret.a - ret.b;
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Reduces the simplex to the feature closest to the origin and picks the next
+    search direction. Returns true once a tetrahedron encloses the origin.
+    The newest point is always simplex[0].
+*/
+static bool
+NextSimplex(SupportPoint* simplex, int& size, glm::vec3& dir)
+{
+    auto sameDirection = [](glm::vec3 const& d, glm::vec3 const& ao) { return glm::dot(d, ao) > 0.0f; };
+
+    switch (size)
+    {
+    case 2:
+    {
+        glm::vec3 const ab = simplex[1].p - simplex[0].p;
+        glm::vec3 const ao = -simplex[0].p;
+        if (sameDirection(ab, ao))
+            dir = glm::cross(glm::cross(ab, ao), ab);
+        else
+        {
+            size = 1;
+            dir = ao;
+        }
+        break;
+    }
+    case 3:
+    {
+        SupportPoint const a = simplex[0], b = simplex[1], c = simplex[2];
+        glm::vec3 const ab = b.p - a.p;
+        glm::vec3 const ac = c.p - a.p;
+        glm::vec3 const ao = -a.p;
+        glm::vec3 const abc = glm::cross(ab, ac);
 
-                // NOTE: this should be equivalent to this: (sqrtf(c2) - radius > ret.hitDistance)), but faster
-                if ((c2 > (ret.hitDistance * ret.hitDistance) + (2 * radius * ret.hitDistance) + r2))
-                    continue; // ray is too short
+        if (sameDirection(glm::cross(abc, ac), ao))
+        {
+            if (sameDirection(ac, ao))
+            {
+                simplex[1] = c;
+                size = 2;
+                dir = glm::cross(glm::cross(ac, ao), ac);
+            }
+            else
+            {
+                simplex[1] = b;
+                size = 2;
+                return NextSimplex(simplex, size, dir);
             }
+        }
+        else if (sameDirection(glm::cross(ab, abc), ao))
+        {
+            size = 2;
+            return NextSimplex(simplex, size, dir);
+        }
+        else if (sameDirection(abc, ao))
+            dir = abc;
+        else
+        {
+            simplex[1] = c;
+            simplex[2] = b;
+            dir = -abc;
+        }
+        break;
+    }
+    case 4:
+    {
+        SupportPoint const a = simplex[0], b = simplex[1], c = simplex[2], d = simplex[3];
+        glm::vec3 const ab = b.p - a.p;
+        glm::vec3 const ac = c.p - a.p;
+        glm::vec3 const ad = d.p - a.p;
+        glm::vec3 const ao = -a.p;
 
-        CHECK_MESH:
-            // transform ray into modelspace
-            glm::mat4 const& invT = colliders.invTransforms[colliderIndex];
-            glm::vec3 invRayStart = invT * glm::vec4(start, 1.0f);
-            glm::vec3 invRayDir = invT * glm::vec4(dir, 0);
+        if (sameDirection(glm::cross(ab, ac), ao))
+        {
+            size = 3;
+            return NextSimplex(simplex, size, dir);
+        }
+        if (sameDirection(glm::cross(ac, ad), ao))
+        {
+            simplex[1] = c;
+            simplex[2] = d;
+            size = 3;
+            return NextSimplex(simplex, size, dir);
+        }
+        if (sameDirection(glm::cross(ad, ab), ao))
+        {
+            simplex[1] = d;
+            simplex[2] = b;
+            size = 3;
+            return NextSimplex(simplex, size, dir);
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+    return false;
+}
 
-            // fine check against mesh
-            int numTris = (int)mesh->tris.size();
-            for (int i = 0; i < numTris; ++i)
-            {
-                glm::vec3 const& N = mesh->tris[i].normal;
+//------------------------------------------------------------------------------
+/**
+    GJK intersection test. On overlap the enclosing tetrahedron is left in simplex.
+*/
+static bool
+Gjk(ConvexShape const& a, ConvexShape const& b, SupportPoint* simplex)
+{
+    glm::vec3 dir = glm::vec3(b.transform[3] - a.transform[3]);
+    if (glm::dot(dir, dir) < 1e-12f)
+        dir = glm::vec3(1.0f, 0.0f, 0.0f);
 
-                float NdotRayDirection = glm::dot(N, invRayDir);
-                if (NdotRayDirection < 0)
-                    continue; // backfacing surface
+    int size = 1;
+    simplex[0] = MinkowskiSupport(a, b, dir);
+    dir = -simplex[0].p;
 
-                glm::vec3 const& A = mesh->tris[i].vertices[0];
-                glm::vec3 const& B = mesh->tris[i].vertices[1];
-                glm::vec3 const& C = mesh->tris[i].vertices[2];
+    for (int iteration = 0; iteration < 64; iteration++)
+    {
+        if (glm::dot(dir, dir) < 1e-12f)
+            return false; // origin sits on the boundary, treat as touching only
 
-                float d = -glm::dot(N, A);
-                float t = -(glm::dot(N, invRayStart) + d) / NdotRayDirection;
+        SupportPoint const s = MinkowskiSupport(a, b, dir);
+        if (glm::dot(s.p, dir) <= 0.0f)
+            return false; // no point past the origin, separated
 
-                if (t < 0)
-                    continue;  //the triangle is behind the ray
+        for (int i = size; i > 0; i--)
+            simplex[i] = simplex[i - 1];
+        simplex[0] = s;
+        size++;
 
-                glm::vec3 P = invRayStart + invRayDir * t;
+        if (NextSimplex(simplex, size, dir))
+            return true;
+    }
+    return false;
+}
 
-                // check triangle bounds
-                glm::vec3 K;  //vector perpendicular to one of three subdivided triangles's plane 
-                glm::vec3 edge0 = B - A;
-                glm::vec3 vp0 = P - A;
-                K = glm::cross(vp0, edge0);
-                if (glm::dot(N, K) < 0)
-                    continue;
+//------------------------------------------------------------------------------
+/**
+*/
+struct EpaResult
+{
+    glm::vec3 normal; // from A towards B
+    float depth;
+    glm::vec3 pointA;
+    glm::vec3 pointB;
+};
 
-                glm::vec3 edge1 = C - B;
-                glm::vec3 vp1 = P - B;
-                K = glm::cross(vp1, edge1);
-                if (glm::dot(N, K) < 0)
-                    continue;
+//------------------------------------------------------------------------------
+/**
+    Expanding polytope algorithm, grows the GJK tetrahedron towards the face of
+    the minkowski difference closest to the origin.
+*/
+static bool
+Epa(ConvexShape const& a, ConvexShape const& b, SupportPoint const* simplex, EpaResult& result)
+{
+    struct Face
+    {
+        int v[3];
+        glm::vec3 normal;
+        float distance;
+    };
 
-                glm::vec3 edge2 = A - C;
-                glm::vec3 vp2 = P - C;
-                K = glm::cross(vp2, edge2);
-                if (glm::dot(N, K) < 0)
-                    continue;
+    std::vector<SupportPoint> polytope(simplex, simplex + 4);
+    std::vector<Face> faces;
+    std::vector<std::pair<int, int>> edges;
+
+    auto addFace = [&](int i0, int i1, int i2) -> bool
+    {
+        Face f = { { i0, i1, i2 }, glm::vec3(0), 0.0f };
+        glm::vec3 n = glm::cross(polytope[i1].p - polytope[i0].p, polytope[i2].p - polytope[i0].p);
+        float const len = glm::length(n);
+        if (len < 1e-12f)
+            return false;
+        n /= len;
+        float dist = glm::dot(n, polytope[i0].p);
+        if (dist < 0.0f)
+        {
+            // keep faces wound so that the normal points away from the origin
+            std::swap(f.v[1], f.v[2]);
+            n = -n;
+            dist = -dist;
+        }
+        f.normal = n;
+        f.distance = dist;
+        faces.push_back(f);
+        return true;
+    };
+
+    if (!addFace(0, 1, 2) || !addFace(0, 3, 1) || !addFace(0, 2, 3) || !addFace(1, 3, 2))
+        return false;
+
+    for (int iteration = 0; iteration < 64; iteration++)
+    {
+        int closest = 0;
+        for (int i = 1; i < (int)faces.size(); i++)
+        {
+            if (faces[i].distance < faces[closest].distance)
+                closest = i;
+        }
+        Face const face = faces[closest];
+
+        SupportPoint const s = MinkowskiSupport(a, b, face.normal);
+        float const sDistance = glm::dot(face.normal, s.p);
+        if (sDistance - face.distance < 0.0001f || iteration == 63)
+        {
+            // project the origin onto the face and interpolate the original support points
+            SupportPoint const& p0 = polytope[face.v[0]];
+            SupportPoint const& p1 = polytope[face.v[1]];
+            SupportPoint const& p2 = polytope[face.v[2]];
+            glm::vec3 const p = face.normal * face.distance;
+            glm::vec3 const v0 = p1.p - p0.p, v1 = p2.p - p0.p, v2 = p - p0.p;
+            float const d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+            float const d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+            float const denom = d00 * d11 - d01 * d01;
+            float v = 0.0f, w = 0.0f;
+            if (fabs(denom) > 1e-12f)
+            {
+                v = (d11 * d20 - d01 * d21) / denom;
+                w = (d00 * d21 - d01 * d20) / denom;
+            }
+            float const u = 1.0f - v - w;
+
+            result.normal = face.normal;
+            result.depth = face.distance;
+            result.pointA = p0.a * u + p1.a * v + p2.a * w;
+            result.pointB = p0.b * u + p1.b * v + p2.b * w;
+            return true;
+        }
 
-                // intersection with at least one triangle
-                if (ret.hitDistance >= t)
+        // remove every face the new point can see and stitch the hole back up from its horizon
+        int const newIndex = (int)polytope.size();
+        polytope.push_back(s);
+        edges.clear();
+        for (int i = 0; i < (int)faces.size();)
+        {
+            if (glm::dot(faces[i].normal, s.p - polytope[faces[i].v[0]].p) > 0.0f)
+            {
+                for (int e = 0; e < 3; e++)
                 {
-                    ret.hit = true;
-                    ret.hitDistance = t;
-                    ret.collider = ColliderId::Create(colliderIndex, colliderPool.generations[colliderIndex]);
+                    std::pair<int, int> const edge = { faces[i].v[e], faces[i].v[(e + 1) % 3] };
+                    auto reverse = std::find(edges.begin(), edges.end(), std::make_pair(edge.second, edge.first));
+                    if (reverse != edges.end())
+                        edges.erase(reverse); // shared by two removed faces, not on the horizon
+                    else
+                        edges.push_back(edge);
                 }
+                faces[i] = faces.back();
+                faces.pop_back();
             }
+            else
+                i++;
         }
+        for (auto const& edge : edges)
+            addFace(edge.first, edge.second, newIndex);
+
+        if (faces.empty())
+            return false;
     }
+    return false;
+}
 
-    if (ret.hit)
+//------------------------------------------------------------------------------
+/**
+*/
+static ConvexShape
+GetConvexShape(uint32_t slot)
+{
+    ConvexShape shape;
+    shape.mesh = &meshes[colliders.meshes[slot].index];
+    shape.transform = glm::inverse(colliders.invTransforms[slot]);
+    shape.invRotationScale = glm::mat3(colliders.invTransforms[slot]);
+    return shape;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Keeps the deepest point, then the points spanning the largest area.
+    Called with exactly MaxContacts + 1 candidates.
+*/
+static void
+ReduceContacts(ContactPoint* points, ContactManifold& manifold)
+{
+    int const numPoints = ContactManifold::MaxContacts + 1;
+    int keep[ContactManifold::MaxContacts];
+
+    keep[0] = 0;
+    for (int i = 1; i < numPoints; i++)
     {
-        //calculate hitpoint
-        ret.hitPoint = start + dir * ret.hitDistance;
+        if (points[i].depth > points[keep[0]].depth)
+            keep[0] = i;
     }
 
-    return ret;
+    float best = -1.0f;
+    for (int i = 0; i < numPoints; i++)
+    {
+        float const d = glm::length2(points[i].pointA - points[keep[0]].pointA);
+        if (i != keep[0] && d > best)
+        {
+            best = d;
+            keep[1] = i;
+        }
+    }
+
+    best = -1.0f;
+    for (int i = 0; i < numPoints; i++)
+    {
+        if (i == keep[0] || i == keep[1])
+            continue;
+        float const area = glm::length2(glm::cross(points[keep[1]].pointA - points[keep[0]].pointA, points[i].pointA - points[keep[0]].pointA));
+        if (area > best)
+        {
+            best = area;
+            keep[2] = i;
+        }
+    }
+
+    // the last point is whichever adds the most area outside the triangle
+    best = -1.0f;
+    for (int i = 0; i < numPoints; i++)
+    {
+        if (i == keep[0] || i == keep[1] || i == keep[2])
+            continue;
+        float area = 0.0f;
+        for (int e = 0; e < 3; e++)
+        {
+            glm::vec3 const& p0 = points[keep[e]].pointA;
+            glm::vec3 const& p1 = points[keep[(e + 1) % 3]].pointA;
+            area = std::max(area, glm::length2(glm::cross(p1 - p0, points[i].pointA - p0)));
+        }
+        if (area > best)
+        {
+            best = area;
+            keep[3] = i;
+        }
+    }
+
+    for (int i = 0; i < ContactManifold::MaxContacts; i++)
+        manifold.contacts[i] = points[keep[i]];
+    manifold.numContacts = ContactManifold::MaxContacts;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Moves the cached points along with both colliders and drops the ones that
+    separated or slid too far, then merges the new EPA point into the manifold.
+*/
+static void
+UpdateManifold(ContactManifold& manifold, ConvexShape const& a, ConvexShape const& b, glm::mat4 const& invA, glm::mat4 const& invB, EpaResult const& epa)
+{
+    manifold.normal = epa.normal;
+
+    float const threshold2 = ContactBreakingThreshold * ContactBreakingThreshold;
+    int numKept = 0;
+    for (int i = 0; i < manifold.numContacts; i++)
+    {
+        ContactPoint c = manifold.contacts[i];
+        c.pointA = glm::vec3(a.transform * glm::vec4(c.localA, 1.0f));
+        c.pointB = glm::vec3(b.transform * glm::vec4(c.localB, 1.0f));
+        glm::vec3 const d = c.pointA - c.pointB;
+        c.depth = glm::dot(d, manifold.normal);
+        if (c.depth < -ContactBreakingThreshold)
+            continue;
+        if (glm::length2(d - manifold.normal * c.depth) > threshold2)
+            continue;
+        c.lifetime++;
+        manifold.contacts[numKept++] = c;
+    }
+    manifold.numContacts = numKept;
+
+    ContactPoint fresh;
+    fresh.pointA = epa.pointA;
+    fresh.pointB = epa.pointB;
+    fresh.localA = glm::vec3(invA * glm::vec4(epa.pointA, 1.0f));
+    fresh.localB = glm::vec3(invB * glm::vec4(epa.pointB, 1.0f));
+    fresh.depth = epa.depth;
+
+    // a point close to one we already have just refreshes it
+    for (int i = 0; i < manifold.numContacts; i++)
+    {
+        if (glm::length2(manifold.contacts[i].localA - fresh.localA) < threshold2)
+        {
+            fresh.lifetime = manifold.contacts[i].lifetime;
+            manifold.contacts[i] = fresh;
+            return;
+        }
+    }
+
+    if (manifold.numContacts < ContactManifold::MaxContacts)
+    {
+        manifold.contacts[manifold.numContacts++] = fresh;
+        return;
+    }
+
+    ContactPoint candidates[ContactManifold::MaxContacts + 1];
+    for (int i = 0; i < ContactManifold::MaxContacts; i++)
+        candidates[i] = manifold.contacts[i];
+    candidates[ContactManifold::MaxContacts] = fresh;
+    ReduceContacts(candidates, manifold);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Bounds come from the bounding spheres, so they do not depend on rotation.
+    After sorting, each box only has to be tested against the boxes that start
+    before it ends on the sweep axis.
+*/
+void
+UpdateBroadphase()
+{
+    std::vector<Broadphase::Box>& boxes = broadphase.boxes;
+    int const numBoxes = (int)boxes.size();
+    for (int i = 0; i < numBoxes; i++)
+    {
+        uint32_t const slot = colliders.slots[boxes[i].index];
+        glm::vec4 const& PS = colliders.positionsAndScales[slot];
+        glm::vec3 const extents = glm::vec3(meshes[colliders.meshes[slot].index].bSphereRadius * PS.w);
+        boxes[i].min = glm::vec3(PS) - extents;
+        boxes[i].max = glm::vec3(PS) + extents;
+    }
+
+    // insertion sort, nearly sorted from last frame
+    for (int i = 1; i < numBoxes; i++)
+    {
+        Broadphase::Box const box = boxes[i];
+        int j = i - 1;
+        while (j >= 0 && boxes[j].min.x > box.min.x)
+        {
+            boxes[j + 1] = boxes[j];
+            j--;
+        }
+        boxes[j + 1] = box;
+    }
+
+    broadphase.prevPairKeys.swap(broadphase.pairKeys);
+    broadphase.pairKeys.clear();
+    for (int i = 0; i < numBoxes; i++)
+    {
+        Broadphase::Box const& a = boxes[i];
+        for (int j = i + 1; j < numBoxes && boxes[j].min.x <= a.max.x; j++)
+        {
+            Broadphase::Box const& b = boxes[j];
+            if (a.max.y < b.min.y || b.max.y < a.min.y || a.max.z < b.min.z || b.max.z < a.min.z)
+                continue;
+            ColliderId const idA = ColliderId::Create(a.index, colliderPool.generations[a.index]);
+            ColliderId const idB = ColliderId::Create(b.index, colliderPool.generations[b.index]);
+            broadphase.pairKeys.push_back(PairKey(idA, idB));
+        }
+    }
+    std::sort(broadphase.pairKeys.begin(), broadphase.pairKeys.end());
+    broadphase.numSorted = (uint32_t)numBoxes;
+
+    // both key lists are sorted, so the difference falls out of a single merge
+    broadphase.pairs.clear();
+    broadphase.addedPairs.clear();
+    broadphase.removedPairs.clear();
+    std::vector<uint64_t> const& cur = broadphase.pairKeys;
+    std::vector<uint64_t> const& prev = broadphase.prevPairKeys;
+    size_t c = 0, p = 0;
+    while (c < cur.size() || p < prev.size())
+    {
+        if (p == prev.size() || (c < cur.size() && cur[c] < prev[p]))
+        {
+            broadphase.pairs.push_back(PairFromKey(cur[c]));
+            broadphase.addedPairs.push_back(PairFromKey(cur[c++]));
+        }
+        else if (c == cur.size() || prev[p] < cur[c])
+            broadphase.removedPairs.push_back(PairFromKey(prev[p++]));
+        else
+        {
+            broadphase.pairs.push_back(PairFromKey(cur[c++]));
+            p++;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<ColliderPair> const&
+GetOverlappingPairs()
+{
+    return broadphase.pairs;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<ColliderPair> const&
+GetAddedPairs()
+{
+    return broadphase.addedPairs;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<ColliderPair> const&
+GetRemovedPairs()
+{
+    return broadphase.removedPairs;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Runs GJK/EPA on each pair. Manifolds are looked up by pair, so the points
+    found in earlier frames are carried over while the pair keeps touching.
+    Pairs that separate or leave the pair list lose their manifold.
+*/
+void
+UpdateContactManifolds(std::vector<ColliderPair> const& pairs)
+{
+    nextManifoldCache.clear();
+    touchingManifolds.clear();
+
+    for (ColliderPair const& pair : pairs)
+    {
+        if (!colliderPool.IsValid(pair.a) || !colliderPool.IsValid(pair.b))
+            continue;
+
+        // always order the pair the same way so the normal keeps its direction
+        ColliderId const idA = pair.a < pair.b ? pair.a : pair.b;
+        ColliderId const idB = pair.a < pair.b ? pair.b : pair.a;
+        uint32_t const slotA = colliders.slots[idA.index];
+        uint32_t const slotB = colliders.slots[idB.index];
+
+        ConvexShape const a = GetConvexShape(slotA);
+        ConvexShape const b = GetConvexShape(slotB);
+        if (a.mesh->numVertices == 0 || b.mesh->numVertices == 0)
+            continue;
+
+        SupportPoint simplex[4];
+        if (!Gjk(a, b, simplex))
+            continue;
+        EpaResult epa;
+        if (!Epa(a, b, simplex, epa))
+            continue;
+
+        uint64_t const key = PairKey(idA, idB);
+        ContactManifold manifold;
+        auto it = manifoldCache.find(key);
+        if (it != manifoldCache.end())
+            manifold = it->second;
+        else
+        {
+            manifold.colliderA = idA;
+            manifold.colliderB = idB;
+        }
+
+        UpdateManifold(manifold, a, b, colliders.invTransforms[slotA], colliders.invTransforms[slotB], epa);
+        nextManifoldCache[key] = manifold;
+        touchingManifolds.push_back(manifold);
+    }
+
+    manifoldCache.swap(nextManifoldCache);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Collide()
+{
+    auto const timeStart = std::chrono::steady_clock::now();
+    UpdateBroadphase();
+    UpdateContactManifolds(broadphase.pairs);
+
+    ThreadQueryCounters& counters = threadQueryCounters;
+    counters.Add(QueryPairsTested, broadphase.pairs.size());
+    counters.Add(QueryNanoseconds, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeStart).count());
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<ContactManifold> const&
+GetContactManifolds()
+{
+    return touchingManifolds;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ThreadQueryCounters::ThreadQueryCounters()
+{
+    std::lock_guard<std::mutex> lock(queryStatsLock);
+    queryThreads.push_back(this);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Keeps the totals monotonic after the thread is gone.
+*/
+ThreadQueryCounters::~ThreadQueryCounters()
+{
+    std::lock_guard<std::mutex> lock(queryStatsLock);
+    for (int t = 0; t < NumQueryTags; t++)
+        for (int c = 0; c < NumQueryCounters; c++)
+            retiredQueryCounters[t][c] += this->counters[t][c].load(std::memory_order_relaxed);
+    queryThreads.erase(std::find(queryThreads.begin(), queryThreads.end(), this));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ScopedQueryTag::ScopedQueryTag(QueryTag tag)
+{
+    this->previous = threadQueryCounters.tag;
+    threadQueryCounters.tag = tag;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ScopedQueryTag::~ScopedQueryTag()
+{
+    threadQueryCounters.tag = this->previous;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Sums every thread's counters and takes the difference to the last merge.
+*/
+void
+UpdateQueryStats()
+{
+    uint64_t totals[NumQueryTags][NumQueryCounters];
+    {
+        std::lock_guard<std::mutex> lock(queryStatsLock);
+        for (int t = 0; t < NumQueryTags; t++)
+        {
+            for (int c = 0; c < NumQueryCounters; c++)
+            {
+                totals[t][c] = retiredQueryCounters[t][c];
+                for (ThreadQueryCounters const* thread : queryThreads)
+                    totals[t][c] += thread->counters[t][c].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    for (int t = 0; t < NumQueryTags; t++)
+    {
+        uint64_t delta[NumQueryCounters];
+        for (int c = 0; c < NumQueryCounters; c++)
+        {
+            delta[c] = totals[t][c] - lastQueryTotals[t][c];
+            lastQueryTotals[t][c] = totals[t][c];
+        }
+        QueryStats& stats = frameQueryStats[t];
+        stats.rays = delta[QueryRays];
+        stats.sphereTests = delta[QuerySphereTests];
+        stats.sphereRejects = delta[QuerySphereRejects];
+        stats.trianglesTested = delta[QueryTrianglesTested];
+        stats.hits = delta[QueryHits];
+        stats.pairsTested = delta[QueryPairsTested];
+        stats.nanoseconds = delta[QueryNanoseconds];
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+QueryStats const&
+GetQueryStats(QueryTag tag)
+{
+    return frameQueryStats[(int)tag];
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+char const*
+GetQueryTagName(QueryTag tag)
+{
+    switch (tag)
+    {
+    case QueryTag::Untagged: return "Untagged";
+    case QueryTag::AISensing: return "AI sensing";
+    case QueryTag::HitDetection: return "Hit detection";
+    case QueryTag::NavBaking: return "Nav baking";
+    default: return "Unknown";
+    }
 }
 
 } // namespace Physics
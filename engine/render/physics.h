@@ -8,6 +8,7 @@
 */
 //------------------------------------------------------------------------------
 #include <string>
+#include <vector>
 
 namespace Physics
 {
@@ -75,6 +76,34 @@ struct ColliderMeshId
     const bool operator>(const ColliderMeshId& rhs) const { return index > rhs.index; }
 };
 
+struct RigidBodyId
+{
+    uint32_t index : 22; // 4M concurrent bodies
+    uint32_t generation : 10; // 1024 generations per index
+
+    constexpr static RigidBodyId Create(uint32_t id)
+    {
+        RigidBodyId ret { id & 0x003FFFFF, (id & 0xFFC00000) >> 22 };
+        return ret;
+    }
+    explicit constexpr operator uint32_t() const
+    {
+        return ((generation << 22) & 0xFFC00000ul) + (index & 0x003FFFFFul);
+    }
+    static constexpr RigidBodyId Invalid()
+    {
+        return Create(0xFFFFFFFF);
+    }
+    constexpr uint32_t HashCode() const
+    {
+        return index;
+    }
+    const bool operator==(const RigidBodyId& rhs) const { return uint32_t(*this) == uint32_t(rhs); }
+    const bool operator!=(const RigidBodyId& rhs) const { return uint32_t(*this) != uint32_t(rhs); }
+    const bool operator<(const RigidBodyId& rhs) const { return index < rhs.index; }
+    const bool operator>(const RigidBodyId& rhs) const { return index > rhs.index; }
+};
+
 struct RaycastPayload
 {
     bool hit = false;
@@ -83,12 +112,137 @@ struct RaycastPayload
     ColliderId collider;
 };
 
+struct ContactPoint
+{
+    glm::vec3 pointA; // world space point on the surface of A
+    glm::vec3 pointB; // world space point on the surface of B
+    glm::vec3 localA; // pointA in A's model space, used to refresh the point in later frames
+    glm::vec3 localB; // pointB in B's model space
+    float depth = 0; // penetration along the manifold normal
+    uint32_t lifetime = 0; // number of frames this point has persisted
+};
+
+struct ContactManifold
+{
+    static constexpr int MaxContacts = 4;
+    ColliderId colliderA;
+    ColliderId colliderB;
+    glm::vec3 normal; // from A towards B
+    int numContacts = 0;
+    ContactPoint contacts[MaxContacts];
+};
+
+struct ColliderPair
+{
+    ColliderId a;
+    ColliderId b;
+};
+
+/// caller categories that physics queries are attributed to
+enum class QueryTag : uint8_t
+{
+    Untagged,
+    AISensing,
+    HitDetection,
+    NavBaking,
+    NumQueryTags
+};
+
+/// query counters for one tag, summed over all threads
+struct QueryStats
+{
+    uint64_t rays = 0;
+    uint64_t sphereTests = 0; // colliders that passed the mask and got a bounding sphere test
+    uint64_t sphereRejects = 0; // of those, the ones culled by the sphere
+    uint64_t trianglesTested = 0;
+    uint64_t hits = 0;
+    uint64_t pairsTested = 0; // narrowphase collider pairs
+    uint64_t nanoseconds = 0;
+};
+
+/// attributes the physics queries issued on this thread to a tag while in scope
+class ScopedQueryTag
+{
+public:
+    explicit ScopedQueryTag(QueryTag tag);
+    ~ScopedQueryTag();
+private:
+    QueryTag previous;
+};
+
 RaycastPayload Raycast(glm::vec3 start, glm::vec3 dir, float maxDistance, uint16_t mask = 0);
 
+/// swept test for a small fast body moving from start to end this tick, culled through the broadphase.
+/// hitDistance is measured from start. Colliders are considered with their bounds as of the last broadphase update.
+RaycastPayload SegmentCast(glm::vec3 start, glm::vec3 end, uint16_t mask = 0, ColliderId ignore = ColliderId::Invalid());
+
 ColliderId CreateCollider(ColliderMeshId meshId, glm::mat4 const& transform, uint16_t mask = 0, void* userData = nullptr);
 
+/// destroy a collider and return its id to the pool
+void DestroyCollider(ColliderId collider);
+
+/// loads a collider mesh, using its cooked blob if one is up to date and cooking it otherwise.
+/// meshes are shared by path and refcounted, loading a path that is already loaded is a lookup.
 ColliderMeshId LoadColliderMesh(std::string path);
 
+/// load several collider meshes in parallel, each returned id holds a reference
+std::vector<ColliderMeshId> PreloadColliderMeshes(std::vector<std::string> const& paths);
+
+/// release a reference taken by LoadColliderMesh or PreloadColliderMeshes
+void UnloadColliderMesh(ColliderMeshId mesh);
+
+/// parse a glTF collider mesh and write its cooked blob next to it
+bool CookColliderMesh(std::string path);
+
+/// create a collider mesh from the convex hull of a point cloud
+ColliderMeshId CreateConvexColliderMesh(std::vector<glm::vec3> const& points);
+
+/// false once the collider has been destroyed
+bool IsValid(ColliderId collider);
+
+/// returns the user data pointer the collider was created with
+void* GetUserData(ColliderId collider);
+
+/// world space bounds of the collider's bounding sphere at its current transform
+void GetBounds(ColliderId collider, glm::vec3& min, glm::vec3& max);
+/// world space signed distance from the point to the collider's surface, negative inside. Sampled from a grid baked with the mesh
+float GetSignedDistance(ColliderId collider, glm::vec3 const& point);
+
 void SetTransform(ColliderId collider, glm::mat4 const& transform);
 
+/// create a rigid body from a transform with uniform scale. If a collider is given, it follows the body.
+RigidBodyId CreateRigidBody(glm::mat4 const& transform, float mass, ColliderId collider = ColliderId::Invalid());
+/// destroy a rigid body and return its id to the pool
+void DestroyRigidBody(RigidBodyId body);
+/// set linear velocity and world space angular velocity (radians per second)
+void SetVelocity(RigidBodyId body, glm::vec3 const& velocity, glm::vec3 const& angularVelocity);
+/// accumulate a force for the next integration step
+void AddForce(RigidBodyId body, glm::vec3 const& force);
+/// transform of the body as of the last integration step
+glm::mat4 const& GetRigidBodyTransform(RigidBodyId body);
+/// integrate all rigid bodies and move their colliders along
+void IntegrateRigidBodies(float dt);
+
+/// refresh collider bounds and re-sort them, then sweep for overlapping pairs
+void UpdateBroadphase();
+/// all pairs with overlapping bounds as of the last broadphase update
+std::vector<ColliderPair> const& GetOverlappingPairs();
+/// pairs that started overlapping in the last broadphase update
+std::vector<ColliderPair> const& GetAddedPairs();
+/// pairs that stopped overlapping in the last broadphase update
+std::vector<ColliderPair> const& GetRemovedPairs();
+/// run the narrowphase over a pair list and update the persistent contact manifolds
+void UpdateContactManifolds(std::vector<ColliderPair> const& pairs);
+/// broadphase and narrowphase over all colliders
+void Collide();
+/// all touching manifolds as of the last narrowphase
+std::vector<ContactManifold> const& GetContactManifolds();
+
+/// merge the counters of all threads and compute the stats of the frame that just ended. Call once per frame.
+void UpdateQueryStats();
+/// counters of the last merged frame
+QueryStats const& GetQueryStats(QueryTag tag);
+/// display name of a tag
+char const* GetQueryTagName(QueryTag tag);
+
 } // namespace Physics
@@ -93,6 +93,8 @@ SpaceGameApp::Run()
     //sngleton world
     World* world = World::instance();
    
+    // load asteroid resources once, spawning only looks them up
+    world->PreloadAsteroids();
 
     // Setup asteroids far
     for (int i = 0; i < 10; i++)
@@ -107,24 +109,10 @@ SpaceGameApp::Run()
          world->pureEntityData->Asteroids.push_back(Asteroid);
     }
 
-    //gridbased nodes
+    //grid based nav volume
     int size3D = 10;
-    world->pureEntityData->NodestackSizescubicRoot = size3D;
-
     float distanceBetweenPoints = 30.0f;
-    for (int i = 0; i < size3D; i++)
-    {
-        for (int j = 0; j < size3D; j++)
-        {
-            for (int k = 0; k < size3D; k++)
-            {
-                auto node = world->CreatePathNode(k, j, i, distanceBetweenPoints);
-                world->pureEntityData->nodes.push_back(node);
-            }
-        }
-      
-
-    }
+    world->CreateNavVolume(size3D, glm::vec3(-100.0f), distanceBetweenPoints);
     // Setup skybox
     std::vector<const char*> skybox
     {
@@ -203,6 +191,7 @@ SpaceGameApp::Run()
         Debug::DrawDebugText("FOOBAR", glm::vec3(0), {1,0,1,1});
       
         world->Update(dt);
+        Physics::UpdateQueryStats();
 
 
         // Execute the entire rendering pipeline
@@ -308,6 +297,115 @@ SpaceGameApp::RenderUI()
         
         ImGui::End();
 
+        // physics query cost of the last frame, per caller
+        ImGui::Begin("Physics");
+        if (ImGui::BeginTable("queries", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Tag");
+            ImGui::TableSetupColumn("Rays");
+            ImGui::TableSetupColumn("Sphere tests");
+            ImGui::TableSetupColumn("Sphere rejects");
+            ImGui::TableSetupColumn("Triangles");
+            ImGui::TableSetupColumn("Hits");
+            ImGui::TableSetupColumn("Pairs");
+            ImGui::TableSetupColumn("ms");
+            ImGui::TableHeadersRow();
+            for (int i = 0; i < (int)Physics::QueryTag::NumQueryTags; i++)
+            {
+                Physics::QueryStats const& stats = Physics::GetQueryStats((Physics::QueryTag)i);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(Physics::GetQueryTagName((Physics::QueryTag)i));
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.rays);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.sphereTests);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.sphereRejects);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.trianglesTested);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.hits);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.pairsTested);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.nanoseconds / 1000000.0);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+
+        // A* on synthetic grids, run on demand
+        ImGui::Begin("Pathfinding");
+        static AstarAlgorithm::BenchmarkResult pathBenchmarks[6];
+        if (ImGui::Button("Benchmark 10^3"))
+            pathBenchmarks[0] = AstarAlgorithm::Benchmark(10, 1000);
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark 50^3"))
+            pathBenchmarks[1] = AstarAlgorithm::Benchmark(50, 100);
+        if (ImGui::Button("JPS 10^3"))
+            pathBenchmarks[4] = AstarAlgorithm::Benchmark(10, 1000, false, false, PathAlgorithm::JumpPoint);
+        ImGui::SameLine();
+        if (ImGui::Button("JPS 50^3"))
+            pathBenchmarks[5] = AstarAlgorithm::Benchmark(50, 100, false, false, PathAlgorithm::JumpPoint);
+        if (ImGui::Button("A* 50^3 walls"))
+            pathBenchmarks[2] = AstarAlgorithm::Benchmark(50, 100, false, true);
+        ImGui::SameLine();
+        if (ImGui::Button("HPA* 50^3 walls"))
+            pathBenchmarks[3] = AstarAlgorithm::Benchmark(50, 100, true, true);
+        static char const* pathBenchmarkNames[6] = { "A*", "A*", "A* walls", "HPA* walls", "JPS", "JPS" };
+        for (int i = 0; i < 6; i++)
+        {
+            AstarAlgorithm::BenchmarkResult const& result = pathBenchmarks[i];
+            if (result.numQueries == 0)
+                continue;
+            ImGui::Text("%s, %d nodes: %d queries in %.2f ms (%.4f ms each), %lld nodes expanded, %lld pushed",
+                pathBenchmarkNames[i], result.numNodes, result.numQueries, result.milliseconds, result.milliseconds / result.numQueries, result.expanded, result.pushed);
+            if (result.buildMilliseconds > 0)
+            {
+                ImGui::SameLine();
+                ImGui::Text("(hierarchy built in %.2f ms)", result.buildMilliseconds);
+            }
+        }
+        PathCache const& pathCache = AstarAlgorithm::Instance()->cache;
+        ImGui::Text("Path cache: %zu entries, %llu hits, %llu sub-path hits, %llu misses", pathCache.GetNumEntries(),
+            (unsigned long long)pathCache.hits, (unsigned long long)pathCache.subPathHits, (unsigned long long)pathCache.misses);
+        FlowFieldCache const& flowFields = AstarAlgorithm::Instance()->flowFields;
+        ImGui::Text("Flow fields: %zu cached, %llu built, %llu reused", flowFields.GetNumFields(),
+            (unsigned long long)flowFields.builds, (unsigned long long)flowFields.hits);
+        ImGui::Text("Nav occupancy: %d cells re-tested, %d changed", World::instance()->navCellsRetested, World::instance()->navCellsChanged);
+        ImGui::Checkbox("Local avoidance", &World::instance()->useLocalAvoidance);
+        LocalAvoidance* avoidance = LocalAvoidance::Instance();
+        ImGui::SameLine();
+        ImGui::Text("%d agents in %.3f ms on %d threads", avoidance->GetNumAgents(), avoidance->lastMilliseconds, avoidance->lastNumThreads);
+        ImGui::End();
+
+        // AI level of detail, per level ships and ticks of the last frame
+        ImGui::Begin("AI");
+        AIScheduler* aiScheduler = AIScheduler::Instance();
+        static char const* aiLodNames[AIScheduler::NumLods] = { "Near", "Medium", "Far" };
+        for (int i = 0; i < AIScheduler::NumLods; i++)
+        {
+            ImGui::Text("%s: %d ships, %d ticked", aiLodNames[i], aiScheduler->numAgents[i], aiScheduler->numTicked[i]);
+        }
+        ImGui::Text("%d deferred, %.3f ms", aiScheduler->numDeferred, aiScheduler->lastMilliseconds);
+        SpatialHash const& spatialHash = World::instance()->spatialHash;
+        ImGui::Text("Spatial hash: %d entities in %d cells", spatialHash.GetNumEntries(), spatialHash.GetNumCells());
+        Perception const* perception = Perception::Instance();
+        ImGui::Text("Perception: %d ships in %.3f ms on %d threads", perception->lastNumShips, perception->lastMilliseconds, perception->lastNumThreads);
+        DistanceField const& distanceField = World::instance()->distanceField;
+        ImGui::Checkbox("Distance field", &World::instance()->useDistanceField);
+        ImGui::SameLine();
+        ImGui::Text("%d bricks, %d rebaked in %.3f ms", distanceField.GetNumBricks(), distanceField.lastBricksBaked, distanceField.lastMilliseconds);
+        SensorScheduler* sensors = SensorScheduler::Instance();
+        ImGui::SliderInt("Sensor rays per ship", &sensors->raysPerShip, 1, 9);
+        ImGui::Text("Sensors: %d requested, %d cast, %d promoted, %d skipped", sensors->raysRequested, sensors->raysCast, sensors->raysPromoted, sensors->raysSkipped);
+        ImGui::Text("Staleness: %.2f frames on average, %u at most", sensors->raysRequested ? (double)sensors->staleFrames / sensors->raysRequested : 0.0, sensors->maxStaleFrames);
+        ImGui::Checkbox("Validate sensor cache", &sensors->validate);
+        if (sensors->validate)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%d of %d cached answers wrong", sensors->raysWrong, sensors->raysValidated);
+        }
+        ImGui::SliderFloat("Near distance", &aiScheduler->nearDistance, 0.0f, 500.0f);
+        ImGui::SliderFloat("Far distance", &aiScheduler->farDistance, 0.0f, 1000.0f);
+        float aiBudget = (float)aiScheduler->budgetMilliseconds;
+        if (ImGui::SliderFloat("Budget (ms)", &aiBudget, 0.0f, 16.0f))
+            aiScheduler->budgetMilliseconds = aiBudget;
+        ImGui::End();
+
         Debug::DispatchDebugTextDrawing();
 	}
 }